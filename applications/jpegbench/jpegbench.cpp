@@ -0,0 +1,430 @@
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+// Time JPEG decoding with different reader configurations. The files
+// are read into memory first, so that only decoding is timed. Without
+// any files, sets of small images are generated with the JPEG writer,
+// as that is where the per-image overhead matters most. With
+// --decoders, the decoders that the reader can use are compared
+// instead of the decompressor pool settings, and each one's pixels
+// are compared with those of the libjpeg scanline decoder. With
+// --quality, the decode qualities are compared with exact, and PNG
+// files can be given too.
+
+#include <vsg/all.h>
+
+#include "jpeg/ReaderWriter_jpeg.h"
+#include "png/ReaderWriter_png.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // A JPEG held in memory, and the group it is reported in
+    struct Sample
+    {
+        std::string group;
+        std::string data;
+        std::uint64_t pixels = 0;
+        // The kind of JPEG, from its header
+        std::string kind;
+        bool png = false;
+    };
+
+    // A way of reading the samples. setup() is run before the
+    // configuration is timed.
+    struct Configuration
+    {
+        std::string name;
+        std::function<void()> setup;
+        vsg::ref_ptr<vsg::Options> options;
+    };
+
+    // Reads a block of memory in place
+    class MemoryBuffer : public std::streambuf
+    {
+    public:
+        MemoryBuffer(const std::string& data)
+        {
+            char* begin = const_cast<char*>(data.data());
+            setg(begin, begin, begin + data.size());
+        }
+    };
+
+    // A test image with smooth gradients and some noise, which
+    // compresses about like a photograph
+    vsg::ref_ptr<vsg::Data> makeImage(std::uint32_t width, std::uint32_t height, std::uint32_t seed)
+    {
+        auto image = vsg::ubvec3Array2D::create(width, height);
+        image->setFormat(VK_FORMAT_R8G8B8_SRGB);
+        std::uint32_t state = seed * 2654435761u + 1;
+        for (std::uint32_t y = 0; y < height; ++y)
+        {
+            for (std::uint32_t x = 0; x < width; ++x)
+            {
+                state = state * 1664525u + 1013904223u;
+                int noise = static_cast<int>(state >> 28) - 8;
+                auto clamp = [](int value) { return static_cast<std::uint8_t>(value < 0 ? 0 : value > 255 ? 255 : value); };
+                image->at(x, y) = vsg::ubvec3(clamp(static_cast<int>(255 * x / width) + noise),
+                                              clamp(static_cast<int>(255 * y / height) + noise),
+                                              clamp(static_cast<int>((seed * 37 + x + y) & 255) + noise));
+            }
+        }
+        return image;
+    }
+
+    // Describe the coding of a JPEG: baseline or progressive, the
+    // chroma subsampling and whether it has restart markers
+    std::string describe(const std::string& data)
+    {
+        auto byte = [&data](std::size_t pos) { return static_cast<unsigned int>(static_cast<unsigned char>(data[pos])); };
+        std::string coding;
+        std::string sampling;
+        bool restarts = false;
+        std::size_t pos = 2;
+        while (pos + 4 <= data.size() && byte(pos) == 0xFF)
+        {
+            unsigned int marker = byte(pos + 1);
+            std::size_t length = (byte(pos + 2) << 8) | byte(pos + 3);
+            if (marker == 0xDA || pos + 2 + length > data.size())
+                break;
+            if (marker == 0xDD)
+                restarts = true;
+            if (marker >= 0xC0 && marker <= 0xC2 && length >= 11)
+            {
+                coding = marker == 0xC2 ? "progressive" : "baseline";
+                unsigned int components = byte(pos + 9);
+                unsigned int h = byte(pos + 11) >> 4;
+                unsigned int v = byte(pos + 11) & 15;
+                if (components == 1)
+                    sampling = "gray";
+                else if (components != 3)
+                    sampling = std::to_string(components) + " components";
+                else if (h == 2 && v == 2)
+                    sampling = "4:2:0";
+                else if (h == 2 && v == 1)
+                    sampling = "4:2:2";
+                else if (h == 1 && v == 2)
+                    sampling = "4:4:0";
+                else
+                    sampling = "4:4:4";
+            }
+            pos += 2 + length;
+        }
+        if (coding.empty())
+            return "unknown";
+        return coding + " " + sampling + (restarts ? " restarts" : "");
+    }
+
+    void generateSamples(std::vector<Sample>& samples, std::uint32_t size, unsigned int count)
+    {
+        vsgsandbox::ReaderWriter_jpeg writer;
+        auto options = vsg::Options::create();
+        options->setValue(vsgsandbox::ReaderWriter_jpeg::quality, 85u);
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            std::ostringstream out;
+            if (!writer.write(makeImage(size, size, i), out, options)) continue;
+            Sample sample;
+            sample.group = std::to_string(size) + "x" + std::to_string(size);
+            sample.data = out.str();
+            sample.pixels = static_cast<std::uint64_t>(size) * size;
+            sample.kind = describe(sample.data);
+            samples.push_back(sample);
+        }
+    }
+
+    bool isPNG(const std::string& data)
+    {
+        return data.compare(0, 8, "\x89PNG\r\n\x1a\n") == 0;
+    }
+
+    bool loadSample(std::vector<Sample>& samples, const std::string& filename, bool allowPNG)
+    {
+        std::ifstream fin(filename, std::ios::in | std::ios::binary);
+        if (!fin) return false;
+        Sample sample;
+        sample.group = filename;
+        sample.data.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+        sample.png = allowPNG && isPNG(sample.data);
+        MemoryBuffer buffer(sample.data);
+        std::istream in(&buffer);
+        vsg::ref_ptr<vsgsandbox::ImageInfo> info;
+        if (sample.png)
+            info = vsgsandbox::ReaderWriter_png().probe(in);
+        else
+            info = vsgsandbox::ReaderWriter_jpeg().probe(in);
+        if (!info) return false;
+        sample.pixels = static_cast<std::uint64_t>(info->width) * info->height;
+        if (sample.png)
+            sample.kind = "PNG, " + std::to_string(info->components) + " x " + std::to_string(info->bitDepth) + " bit";
+        else
+            sample.kind = describe(sample.data);
+        samples.push_back(sample);
+        return true;
+    }
+
+    vsg::ref_ptr<vsg::Object> read(const Sample& sample, vsg::ref_ptr<const vsg::Options> options)
+    {
+        MemoryBuffer buffer(sample.data);
+        std::istream in(&buffer);
+        if (sample.png)
+            return vsgsandbox::ReaderWriter_png().read(in, options);
+        return vsgsandbox::ReaderWriter_jpeg().read(in, options);
+    }
+
+    // Decode every sample of group in turn, passes times, and return
+    // the mean time per image in microseconds.
+    double timeGroup(const std::vector<Sample>& samples, const std::string& group, const Configuration& config,
+                     unsigned int passes, bool* failed)
+    {
+        std::uint64_t images = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int pass = 0; pass < passes; ++pass)
+        {
+            for (auto& sample : samples)
+            {
+                if (sample.group != group) continue;
+                if (!read(sample, config.options)) *failed = true;
+                ++images;
+            }
+        }
+        auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        return images > 0 ? elapsed / images : 0.0;
+    }
+
+    vsg::ref_ptr<vsg::Data> decode(const Sample& sample, const vsg::Options* options)
+    {
+        return vsg::ref_ptr<vsg::Data>(dynamic_cast<vsg::Data*>(read(sample, vsg::ref_ptr<const vsg::Options>(options)).get()));
+    }
+
+    // How the samples of a group decoded with one configuration
+    // differ from those decoded with another, in bytes of the image
+    // data. largest is -1 if the images don't match in size or one
+    // couldn't be decoded.
+    struct Difference
+    {
+        int largest = 0;
+        double rms = 0.0;
+    };
+
+    Difference difference(const std::vector<Sample>& samples, const std::string& group, const Configuration& config,
+                          const Configuration& reference)
+    {
+        Difference result;
+        double sumSquares = 0.0;
+        std::uint64_t count = 0;
+        for (auto& sample : samples)
+        {
+            if (sample.group != group) continue;
+            auto image = decode(sample, config.options);
+            auto expected = decode(sample, reference.options);
+            if (!image || !expected || image->dataSize() != expected->dataSize()
+                || image->width() != expected->width() || image->getFormat() != expected->getFormat())
+            {
+                result.largest = -1;
+                return result;
+            }
+            auto pixels = static_cast<const unsigned char*>(image->dataPointer());
+            auto expectedPixels = static_cast<const unsigned char*>(expected->dataPointer());
+            for (std::size_t i = 0; i < image->dataSize(); ++i)
+            {
+                int d = std::abs(static_cast<int>(pixels[i]) - static_cast<int>(expectedPixels[i]));
+                result.largest = std::max(result.largest, d);
+                sumSquares += static_cast<double>(d) * d;
+            }
+            count += image->dataSize();
+        }
+        if (count > 0)
+            result.rms = std::sqrt(sumSquares / static_cast<double>(count));
+        return result;
+    }
+
+    vsg::ref_ptr<vsg::Options> decoderOptions(vsgsandbox::JPEGDecoder decoder)
+    {
+        auto options = vsg::Options::create();
+        options->setValue(vsgsandbox::ReaderWriter_jpeg::decoder, static_cast<unsigned int>(decoder));
+        return options;
+    }
+
+    vsg::ref_ptr<vsg::Options> qualityOptions(vsgsandbox::DecodeQuality::Quality quality)
+    {
+        auto options = vsg::Options::create();
+        options->setValue(vsgsandbox::ReaderWriter_jpeg::decodeQuality,
+                          std::string(vsgsandbox::DecodeQuality::name(quality)));
+        return options;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    vsg::CommandLine arguments(&argc, argv);
+    // Number of times each group is decoded with each configuration
+    unsigned int passes = 20;
+    arguments.read({"--passes", "-n"}, passes);
+    // The configurations take turns this many times, and the best
+    // time of each is reported, which filters out most of the noise
+    unsigned int rounds = 5;
+    arguments.read("--rounds", rounds);
+    // Number of images generated of each size
+    unsigned int count = 50;
+    arguments.read("--count", count);
+    // Generate images of only this size
+    std::uint32_t size = 0;
+    arguments.read("--size", size);
+    // Compare the decoders instead of the pool settings
+    bool decoders = arguments.read("--decoders");
+    // Compare the decode qualities instead
+    bool quality = arguments.read("--quality");
+    // Either way, the first configuration is the reference that the
+    // others' pixels are compared with
+    const bool compare = decoders || quality;
+
+    if (arguments.errors()) return arguments.writeErrorMessages(std::cerr);
+
+    std::vector<Sample> samples;
+    std::vector<std::string> groups;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!loadSample(samples, arguments[i], quality))
+            std::cerr << arguments[i] << (quality ? ": not a JPEG or PNG file" : ": not a JPEG file") << std::endl;
+        else
+            groups.push_back(arguments[i]);
+    }
+    if (argc < 2)
+    {
+        std::vector<std::uint32_t> sizes{32, 64, 128, 256};
+        if (size > 0) sizes = {size};
+        for (auto s : sizes)
+        {
+            generateSamples(samples, s, count);
+            groups.push_back(std::to_string(s) + "x" + std::to_string(s));
+        }
+    }
+    if (samples.empty())
+    {
+        std::cerr << "usage: " << argv[0]
+                  << " [-n passes] [--rounds N] [--count N] [--size N] [--decoders | --quality] [file.jpg ...]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::vector<Configuration> configurations;
+    if (decoders)
+    {
+        using vsgsandbox::JPEGDecoder;
+        // The first one is the reference for the pixel comparison
+        configurations.push_back({"libjpeg", {}, decoderOptions(JPEGDecoder::LibJPEG)});
+        if (vsgsandbox::ReaderWriter_jpeg::hasDecoder(JPEGDecoder::TurboJPEG))
+            configurations.push_back({"TurboJPEG", {}, decoderOptions(JPEGDecoder::TurboJPEG)});
+        configurations.push_back({"stb_image", {}, decoderOptions(JPEGDecoder::STBImage)});
+    }
+    else if (quality)
+    {
+        using vsgsandbox::DecodeQuality;
+        for (auto q : {DecodeQuality::Exact, DecodeQuality::Balanced, DecodeQuality::Fast})
+            configurations.push_back({DecodeQuality::name(q), {}, qualityOptions(q)});
+    }
+    else
+    {
+        // A new libjpeg decompressor for every image
+        configurations.push_back({"fresh", []() { vsgsandbox::ReaderWriter_jpeg::setDecompressorPoolSize(0); },
+                                  vsg::Options::create()});
+        // Decompressors reused from this thread's pool
+        configurations.push_back({"pooled", []() { vsgsandbox::ReaderWriter_jpeg::setDecompressorPoolSize(4); },
+                                  vsg::Options::create()});
+    }
+
+    bool failed = false;
+    std::cout << std::left << std::setw(24) << "images";
+    for (auto& config : configurations)
+        std::cout << std::right << std::setw(14) << config.name;
+    std::cout << "   (microseconds per image)" << std::endl;
+    for (auto& group : groups)
+    {
+        std::vector<double> best(configurations.size(), 0.0);
+        for (unsigned int round = 0; round < std::max(rounds, 1u); ++round)
+        {
+            for (std::size_t c = 0; c < configurations.size(); ++c)
+            {
+                auto& config = configurations[c];
+                if (config.setup) config.setup();
+                // One untimed pass, to warm up the caches and the pool
+                timeGroup(samples, group, config, 1, &failed);
+                double time = timeGroup(samples, group, config, passes, &failed);
+                if (round == 0 || time < best[c]) best[c] = time;
+            }
+        }
+        std::cout << std::left << std::setw(24) << group << std::right << std::fixed << std::setprecision(1);
+        for (double time : best)
+            std::cout << std::setw(14) << time;
+        if (compare)
+        {
+            auto sample = std::find_if(samples.begin(), samples.end(),
+                                       [&group](const Sample& s) { return s.group == group; });
+            std::cout << "   " << sample->kind;
+        }
+        std::cout << std::endl;
+    }
+    if (compare)
+    {
+        std::vector<std::vector<Difference>> differences;
+        for (auto& group : groups)
+        {
+            differences.emplace_back();
+            for (std::size_t c = 1; c < configurations.size(); ++c)
+                differences.back().push_back(difference(samples, group, configurations[c], configurations[0]));
+        }
+        for (bool rms : {false, true})
+        {
+            std::cout << std::endl << std::left << std::setw(24) << "images";
+            for (std::size_t c = 1; c < configurations.size(); ++c)
+                std::cout << std::right << std::setw(14) << configurations[c].name;
+            std::cout << "   (" << (rms ? "RMS" : "largest") << " difference from " << configurations[0].name << ")"
+                      << std::endl;
+            for (std::size_t g = 0; g < groups.size(); ++g)
+            {
+                std::cout << std::left << std::setw(24) << groups[g] << std::right;
+                for (auto& d : differences[g])
+                {
+                    if (d.largest < 0)
+                        std::cout << std::setw(14) << "differs";
+                    else if (d.largest == 0)
+                        std::cout << std::setw(14) << "identical";
+                    else if (rms)
+                        std::cout << std::setw(14) << std::setprecision(3) << d.rms;
+                    else
+                        std::cout << std::setw(14) << d.largest;
+                }
+                std::cout << std::endl;
+            }
+        }
+    }
+    if (failed)
+    {
+        std::cerr << "some images could not be decoded" << std::endl;
+        return 1;
+    }
+    return 0;
+}
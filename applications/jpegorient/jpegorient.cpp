@@ -0,0 +1,121 @@
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+// Rewrite JPEG files so that their pixels are the right way up and
+// their EXIF orientation is TopLeft. The rotation is done losslessly
+// on the DCT coefficients.
+
+#include <vsg/all.h>
+
+#include "jpeg/JPEG_Transform.h"
+#include "ReaderWriter_sandbox/MappedFile.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+bool writeFile(const fs::path& path, const std::vector<unsigned char>& data)
+{
+    std::ofstream fout(path, std::ios::out | std::ios::binary);
+    if (!fout) return false;
+    fout.write(reinterpret_cast<const char*>(data.data()), data.size());
+    return static_cast<bool>(fout);
+}
+
+int main(int argc, char** argv)
+{
+    vsg::CommandLine arguments(&argc, argv);
+    // Write the results to this directory instead of replacing the
+    // input files
+    std::string outputDir;
+    arguments.read({"--output", "-o"}, outputDir);
+    bool verbose = arguments.read({"--verbose", "-v"});
+    // Write progressive files as baseline, which is quicker
+    bool baseline = arguments.read("--baseline");
+
+    if (arguments.errors()) return arguments.writeErrorMessages(std::cerr);
+
+    if (argc < 2)
+    {
+        std::cerr << "usage: " << argv[0] << " [-o directory] [-v] [--baseline] file.jpg ..." << std::endl;
+        return 1;
+    }
+    if (!outputDir.empty())
+    {
+        std::error_code ec;
+        fs::create_directories(outputDir, ec);
+    }
+
+    int transformed = 0;
+    int unchanged = 0;
+    int failed = 0;
+    auto startTime = std::chrono::steady_clock::now();
+    std::vector<unsigned char> result;
+    for (int i = 1; i < argc; ++i)
+    {
+        fs::path inputPath(arguments[i]);
+        vsgsandbox::OrientResult status;
+        std::string message;
+        {
+            vsgsandbox::MappedFile mappedFile(inputPath.string());
+            if (!mappedFile.valid())
+            {
+                std::cerr << inputPath.string() << ": could not read file" << std::endl;
+                ++failed;
+                continue;
+            }
+            status = vsgsandbox::normalizeOrientation(mappedFile.data(), mappedFile.size(), result,
+                                                          !baseline, &message);
+        }
+        fs::path outputPath = outputDir.empty() ? inputPath : fs::path(outputDir) / inputPath.filename();
+        if (status == vsgsandbox::OrientResult::Failed)
+        {
+            std::cerr << inputPath.string() << ": " << message << std::endl;
+            ++failed;
+            continue;
+        }
+        if (status == vsgsandbox::OrientResult::AlreadyNormal)
+        {
+            ++unchanged;
+            if (verbose) std::cout << inputPath.string() << ": unchanged" << std::endl;
+            // Copy it anyway, so that the output directory has the
+            // whole set
+            if (outputPath != inputPath)
+            {
+                std::error_code ec;
+                fs::copy_file(inputPath, outputPath, fs::copy_options::overwrite_existing, ec);
+            }
+            continue;
+        }
+        // Replace files by renaming a complete new one over them, so
+        // that an error can't leave a truncated image behind.
+        fs::path tempPath = outputPath;
+        tempPath += ".tmp";
+        std::error_code ec;
+        if (!writeFile(tempPath, result) || (fs::rename(tempPath, outputPath, ec), ec))
+        {
+            std::cerr << outputPath.string() << ": could not write file" << std::endl;
+            fs::remove(tempPath, ec);
+            ++failed;
+            continue;
+        }
+        ++transformed;
+        if (verbose) std::cout << inputPath.string() << ": transformed" << std::endl;
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::cout << transformed << " transformed, " << unchanged << " unchanged, " << failed << " failed in "
+              << elapsed << " s" << std::endl;
+    return failed > 0 ? 1 : 0;
+}
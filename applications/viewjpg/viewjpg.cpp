@@ -30,6 +30,8 @@ vsg::DescriptorSetLayoutBindings descriptorBindings
 
 vsg::ref_ptr<vsg::MatrixTransform> createTextureGraph(vsg::ref_ptr<vsg::Data> textureData,
                                                       vsg::ref_ptr<vsgsandbox::EXIF> exif,
+                                                      vsg::ref_ptr<vsgsandbox::ImageScale> scale,
+                                                      vsg::ref_ptr<vsgsandbox::ImageOrigin> origin,
                                                       vsg::ref_ptr<vsg::PipelineLayout> pipelineLayout,
                                                       vsg::ref_ptr<vsg::DescriptorSetLayout> descriptorSetLayout)
 {
@@ -37,6 +39,12 @@ vsg::ref_ptr<vsg::MatrixTransform> createTextureGraph(vsg::ref_ptr<vsg::Data> te
     auto imageWidth = textureData->width();
     auto imageHeight = textureData->height();
     float ratio = static_cast<float>(imageWidth) / static_cast<float>(imageHeight);
+    // A reduced resolution image is rounded up in size; use the
+    // original dimensions to get the true aspect ratio.
+    if (scale && scale->fullWidth > 0 && scale->fullHeight > 0)
+    {
+        ratio = static_cast<float>(scale->fullWidth) / static_cast<float>(scale->fullHeight);
+    }
     float maxLod = ceil(std::log2(std::max(imageWidth, imageHeight)));
     auto sampler = vsg::Sampler::create();
     sampler->info().maxLod = maxLod;
@@ -82,6 +90,14 @@ vsg::ref_ptr<vsg::MatrixTransform> createTextureGraph(vsg::ref_ptr<vsg::Data> te
         {1.0f, 1.0f},
         {0.0f, 1.0f}
     }); // VK_FORMAT_R32G32_SFLOAT, VK_VERTEX_INPUT_RATE_VERTEX, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_SHARING_MODE_EXCLUSIVE
+    // An image stored top row first has its top at v = 0
+    if (origin && origin->origin == vsgsandbox::ImageOrigin::TopLeft)
+    {
+        for (auto& texcoord : *texcoords)
+        {
+            texcoord.y = 1.0f - texcoord.y;
+        }
+    }
     {
         using namespace vsgsandbox;
         EXIF::Orientation orient = exif ? exif->orientation : EXIF::TopLeft;
@@ -173,6 +189,43 @@ int main(int argc, char** argv)
     windowTraits->debugLayer = arguments.read({"--debug","-d"});
     windowTraits->apiDumpLayer = arguments.read({"--api","-a"});
     arguments.read({"--window", "-w"}, windowTraits->width, windowTraits->height);
+    auto readOptions = vsg::Options::create();
+    // Decode straight into the layout of the textures, so that
+    // ImageTranslator doesn't need to expand the images
+    readOptions->setValue(vsgsandbox::ReaderWriter_jpeg::outputFormat,
+                          static_cast<unsigned int>(VK_FORMAT_R8G8B8A8_SRGB));
+    // Keep the rows in the order they are decoded in; the texture
+    // coordinates are flipped instead
+    readOptions->setValue(vsgsandbox::ReaderWriter_jpeg::topDown, true);
+    // Decode JPEGs at reduced resolution
+    unsigned int scaleDenominator = 1;
+    if (arguments.read("--scale", scaleDenominator))
+    {
+        readOptions->setValue(vsgsandbox::ReaderWriter_jpeg::scaleDenominator, scaleDenominator);
+    }
+    unsigned int targetSize = 0;
+    if (arguments.read("--target-size", targetSize))
+    {
+        readOptions->setValue(vsgsandbox::ReaderWriter_jpeg::targetSize, targetSize);
+    }
+    // Stop decoding progressive JPEGs early
+    unsigned int maxScans = 0;
+    if (arguments.read("--max-scans", maxScans))
+    {
+        readOptions->setValue(vsgsandbox::ReaderWriter_jpeg::maxScans, maxScans);
+    }
+    // Show the EXIF thumbnails of JPEGs that have them
+    if (arguments.read("--thumbnails"))
+    {
+        readOptions->setValue(vsgsandbox::ReaderWriter_jpeg::thumbnail, true);
+    }
+    // Decode only part of each JPEG
+    uint32_t regionX = 0, regionY = 0, regionWidth = 0, regionHeight = 0;
+    if (arguments.read("--region", regionX, regionY, regionWidth, regionHeight))
+    {
+        readOptions->setObject(vsgsandbox::ReaderWriter_jpeg::region,
+                               vsgsandbox::ImageRegion::create(regionX, regionY, regionWidth, regionHeight));
+    }
 
     if (arguments.errors()) return arguments.writeErrorMessages(std::cerr);
 
@@ -246,18 +299,26 @@ int main(int argc, char** argv)
     auto scenegraph = vsg::StateGroup::create();
     scenegraph->add(bindGraphicsPipeline);
 
-    // read texture images
+    // read texture images, decoding them in parallel
+    vsg::Paths imageFilenames;
+    for (int i = 1; i < argc; ++i)
+    {
+        imageFilenames.push_back(arguments[i]);
+    }
+    auto images = imageReader.readBatch(imageFilenames, readOptions);
     double imageOffset = 0.0;
-    for (int i = 1; i < argc; ++i, imageOffset += 1.1)
+    for (size_t i = 0; i < images.size(); ++i, imageOffset += 1.1)
     {
-        vsg::Path imageFilename = arguments[i];
-        vsg::ref_ptr<vsg::Data> textureData(dynamic_cast<vsg::Data*>(imageReader.read(imageFilename).get()));
+        const vsg::Path& imageFilename = imageFilenames[i];
+        vsg::ref_ptr<vsg::Data> textureData(dynamic_cast<vsg::Data*>(images[i].get()));
         if (!textureData)
         {
             std::cout << "Could not read texture file : " << imageFilename << std::endl;
             return 1;
         }
         auto exif = vsgsandbox::EXIF::get(textureData);
+        auto scale = vsgsandbox::ImageScale::get(textureData);
+        auto origin = vsgsandbox::ImageOrigin::get(textureData);
         textureData = ImageTranslator.translateToSupported(textureData);
         VkFormatProperties formatProperties;
         vkGetPhysicalDeviceFormatProperties(*window->getOrCreateDevice()->getPhysicalDevice(), textureData->getFormat(),
@@ -268,7 +329,7 @@ int main(int argc, char** argv)
             break;
         }
 
-        auto transform = createTextureGraph(textureData, exif, pipelineLayout, descriptorSetLayout);
+        auto transform = createTextureGraph(textureData, exif, scale, origin, pipelineLayout, descriptorSetLayout);
         vsg::dmat4 transformMat = transform->getMatrix();
         vsg::dmat4 translate = vsg::translate(imageOffset, 0.0, 0.0);
         transformMat = translate * transformMat;
@@ -0,0 +1,364 @@
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+#include "ColorProfile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COLOR_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace vsgsandbox;
+
+namespace
+{
+    std::uint32_t get32(const unsigned char* ptr)
+    {
+        return (static_cast<std::uint32_t>(ptr[0]) << 24) | (static_cast<std::uint32_t>(ptr[1]) << 16)
+            | (static_cast<std::uint32_t>(ptr[2]) << 8) | ptr[3];
+    }
+
+    unsigned int get16(const unsigned char* ptr)
+    {
+        return (static_cast<unsigned int>(ptr[0]) << 8) | ptr[1];
+    }
+
+    double s15Fixed16(const unsigned char* ptr)
+    {
+        return static_cast<std::int32_t>(get32(ptr)) / 65536.0;
+    }
+
+    const std::size_t HEADER_SIZE = 128;
+
+    // The data of a tag in the profile's tag table, or null
+    const unsigned char* findTag(const unsigned char* profile, std::size_t size, const char* signature,
+                                 std::size_t* tagSize)
+    {
+        if (size < HEADER_SIZE + 4)
+            return nullptr;
+        std::uint32_t count = get32(profile + HEADER_SIZE);
+        if (count > (size - HEADER_SIZE - 4) / 12)
+            return nullptr;
+        for (std::uint32_t i = 0; i < count; ++i)
+        {
+            const unsigned char* entry = profile + HEADER_SIZE + 4 + 12 * i;
+            if (std::memcmp(entry, signature, 4) != 0)
+                continue;
+            std::uint32_t offset = get32(entry + 4);
+            std::uint32_t length = get32(entry + 8);
+            if (offset > size || length > size - offset)
+                return nullptr;
+            *tagSize = length;
+            return profile + offset;
+        }
+        return nullptr;
+    }
+
+    bool readXYZ(const unsigned char* profile, std::size_t size, const char* signature, double xyz[3])
+    {
+        std::size_t tagSize = 0;
+        const unsigned char* tag = findTag(profile, size, signature, &tagSize);
+        if (!tag || tagSize < 20 || std::memcmp(tag, "XYZ ", 4) != 0)
+            return false;
+        for (int i = 0; i < 3; ++i)
+            xyz[i] = s15Fixed16(tag + 8 + 4 * i);
+        return true;
+    }
+
+    // A tone curve from a curv or para tag. Parametric curves are
+    // kept in the form of function type 4:
+    // Y = (aX + b)^g + e for X >= d, otherwise cX + f.
+    struct Curve
+    {
+        const unsigned char* table = nullptr;
+        std::uint32_t entries = 0;
+        double g = 1.0, a = 1.0, b = 0.0, c = 0.0, d = 0.0, e = 0.0, f = 0.0;
+    };
+
+    bool readCurve(const unsigned char* profile, std::size_t size, const char* signature, Curve* curve)
+    {
+        std::size_t tagSize = 0;
+        const unsigned char* tag = findTag(profile, size, signature, &tagSize);
+        if (!tag || tagSize < 12)
+            return false;
+        if (std::memcmp(tag, "curv", 4) == 0)
+        {
+            std::uint32_t entries = get32(tag + 8);
+            if (entries > (tagSize - 12) / 2)
+                return false;
+            if (entries == 1)
+                curve->g = get16(tag + 12) / 256.0;
+            else if (entries > 1)
+            {
+                curve->table = tag + 12;
+                curve->entries = entries;
+            }
+            return true;
+        }
+        if (std::memcmp(tag, "para", 4) != 0)
+            return false;
+        const unsigned int numParams[] = {1, 3, 4, 5, 7};
+        unsigned int type = get16(tag + 8);
+        if (type > 4 || tagSize < 12 + 4 * numParams[type])
+            return false;
+        double p[7] = {1.0, 1.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+        for (unsigned int i = 0; i < numParams[type]; ++i)
+            p[i] = s15Fixed16(tag + 12 + 4 * i);
+        curve->g = p[0];
+        if (type == 0)
+            return true;
+        curve->a = p[1];
+        curve->b = p[2];
+        if (curve->a == 0.0)
+            return false;
+        switch (type)
+        {
+        case 1:
+            curve->d = -curve->b / curve->a;
+            break;
+        case 2:
+            curve->d = -curve->b / curve->a;
+            curve->e = curve->f = p[3];
+            break;
+        case 3:
+            curve->c = p[3];
+            curve->d = p[4];
+            break;
+        default:
+            curve->c = p[3];
+            curve->d = p[4];
+            curve->e = p[5];
+            curve->f = p[6];
+            break;
+        }
+        return true;
+    }
+
+    double evaluate(const Curve& curve, double x)
+    {
+        double y;
+        if (curve.table)
+        {
+            double pos = x * (curve.entries - 1);
+            std::uint32_t i = std::min(static_cast<std::uint32_t>(pos), curve.entries - 2);
+            double t = pos - i;
+            double y0 = get16(curve.table + 2 * i);
+            double y1 = get16(curve.table + 2 * i + 2);
+            y = (y0 + (y1 - y0) * t) / 65535.0;
+        }
+        else if (x >= curve.d)
+        {
+            double base = curve.a * x + curve.b;
+            y = (base > 0.0 ? std::pow(base, curve.g) : 0.0) + curve.e;
+        }
+        else
+        {
+            y = curve.c * x + curve.f;
+        }
+        return std::min(std::max(y, 0.0), 1.0);
+    }
+
+    double linearToSRGB(double v)
+    {
+        return v <= 0.0031308 ? 12.92 * v : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+    }
+
+    // The sRGB primaries in the D50 profile connection space, as
+    // they are in the sRGB profile; the columns are red, green and
+    // blue.
+    const double sRGBToXYZ[9] = {0.4360747, 0.3850649, 0.1430804,
+                                 0.2225045, 0.7168786, 0.0606169,
+                                 0.0139322, 0.0971045, 0.7141733};
+
+    void invert3x3(const double m[9], double inv[9])
+    {
+        double c0 = m[4] * m[8] - m[5] * m[7];
+        double c1 = m[5] * m[6] - m[3] * m[8];
+        double c2 = m[3] * m[7] - m[4] * m[6];
+        double det = m[0] * c0 + m[1] * c1 + m[2] * c2;
+        inv[0] = c0 / det;
+        inv[1] = (m[2] * m[7] - m[1] * m[8]) / det;
+        inv[2] = (m[1] * m[5] - m[2] * m[4]) / det;
+        inv[3] = c1 / det;
+        inv[4] = (m[0] * m[8] - m[2] * m[6]) / det;
+        inv[5] = (m[2] * m[3] - m[0] * m[5]) / det;
+        inv[6] = c2 / det;
+        inv[7] = (m[1] * m[6] - m[0] * m[7]) / det;
+        inv[8] = (m[0] * m[4] - m[1] * m[3]) / det;
+    }
+
+    // Linear light is carried as 14 bit fixed point, and the matrix
+    // as 4.12 fixed point, so a row of the matrix is two 16 bit
+    // multiply-adds. Quantizing to 14 bits keeps the darkest step of
+    // the sRGB curve under a quarter of an output level.
+    const int LINEAR_BITS = 14;
+    const int LINEAR_MAX = (1 << LINEAR_BITS) - 1;
+    const int MATRIX_SHIFT = 12;
+    const int MATRIX_ROUND = 1 << (MATRIX_SHIFT - 1);
+    const double MATRIX_LIMIT = 32767.0 / (1 << MATRIX_SHIFT);
+
+    // 8 bit sRGB for every fixed point linear value
+    const std::uint8_t* encodeTable()
+    {
+        static const struct Table
+        {
+            Table()
+            {
+                for (int i = 0; i <= LINEAR_MAX; ++i)
+                    values[i] = static_cast<std::uint8_t>(std::lround(255.0 * linearToSRGB(i / double(LINEAR_MAX))));
+            }
+            std::uint8_t values[LINEAR_MAX + 1];
+        } table;
+        return table.values;
+    }
+
+    inline int clampLinear(int v)
+    {
+        return v < 0 ? 0 : (v > LINEAR_MAX ? LINEAR_MAX : v);
+    }
+}
+
+ColorTransform::Status ColorTransform::setProfile(const unsigned char* profile, std::size_t size)
+{
+    _status = Unsupported;
+    if (!profile || size < HEADER_SIZE + 4)
+        return _status;
+    size = std::min<std::size_t>(size, get32(profile));
+    std::size_t tagSize = 0;
+    if (std::memcmp(profile + 36, "acsp", 4) != 0 || std::memcmp(profile + 16, "RGB ", 4) != 0
+        || std::memcmp(profile + 20, "XYZ ", 4) != 0)
+    {
+        return _status;
+    }
+    // A profile with lookup tables means them to be used, even if
+    // it has colorants and curves too
+    if (findTag(profile, size, "A2B0", &tagSize))
+        return _status;
+
+    double primaries[3][3];
+    Curve curves[3];
+    if (!readXYZ(profile, size, "rXYZ", primaries[0]) || !readXYZ(profile, size, "gXYZ", primaries[1])
+        || !readXYZ(profile, size, "bXYZ", primaries[2]) || !readCurve(profile, size, "rTRC", &curves[0])
+        || !readCurve(profile, size, "gTRC", &curves[1]) || !readCurve(profile, size, "bTRC", &curves[2]))
+    {
+        return _status;
+    }
+
+    // Profile RGB to XYZ, then XYZ to linear sRGB
+    double toXYZ[9];
+    for (int row = 0; row < 3; ++row)
+        for (int col = 0; col < 3; ++col)
+            toXYZ[3 * row + col] = primaries[col][row];
+    double fromXYZ[9];
+    invert3x3(sRGBToXYZ, fromXYZ);
+    bool identity = true;
+    double matrix[9];
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int col = 0; col < 3; ++col)
+        {
+            double sum = 0.0;
+            for (int k = 0; k < 3; ++k)
+                sum += fromXYZ[3 * row + k] * toXYZ[3 * k + col];
+            matrix[3 * row + col] = sum;
+            identity = identity && std::fabs(sum - (row == col ? 1.0 : 0.0)) < 0.002;
+        }
+    }
+    for (int i = 0; i < 9; ++i)
+    {
+        // Out of gamut so far that it can't be held in fixed point
+        if (std::fabs(matrix[i]) >= MATRIX_LIMIT)
+            return _status;
+        _matrix[i] = static_cast<std::int16_t>(std::lround(matrix[i] * (1 << MATRIX_SHIFT)));
+    }
+    for (int ci = 0; ci < 3; ++ci)
+    {
+        for (int i = 0; i < 256; ++i)
+        {
+            double linear = evaluate(curves[ci], i / 255.0);
+            _toLinear[ci][i] = static_cast<std::int16_t>(std::lround(linear * LINEAR_MAX));
+            identity = identity && std::fabs(255.0 * linearToSRGB(linear) - i) < 0.5;
+        }
+    }
+    _status = identity ? Identity : Convert;
+    return _status;
+}
+
+void ColorTransform::convert(unsigned char* pixels, std::size_t width, int components, bool bgr) const
+{
+    const std::uint8_t* table = encodeTable();
+    const int r = bgr ? 2 : 0;
+    const int b = bgr ? 0 : 2;
+    const std::int16_t* m = _matrix;
+    std::size_t x = 0;
+#ifdef COLOR_SSE2
+    // Each row of the matrix as (red, green) and (blue, rounding)
+    // coefficient pairs, to multiply-add with (red, green) and
+    // (blue, 1) pairs of samples
+    __m128i redGreen[3], blueOne[3];
+    for (int row = 0; row < 3; ++row)
+    {
+        redGreen[row] = _mm_set1_epi32(static_cast<std::uint16_t>(m[3 * row])
+                                       | (static_cast<std::uint32_t>(static_cast<std::uint16_t>(m[3 * row + 1])) << 16));
+        blueOne[row] = _mm_set1_epi32(static_cast<std::uint16_t>(m[3 * row + 2])
+                                      | (static_cast<std::uint32_t>(MATRIX_ROUND) << 16));
+    }
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i linearMax = _mm_set1_epi16(LINEAR_MAX);
+    for (; x + 4 <= width; x += 4)
+    {
+        unsigned char* p = pixels + x * components;
+        const unsigned char* p1 = p + components;
+        const unsigned char* p2 = p1 + components;
+        const unsigned char* p3 = p2 + components;
+        __m128i rg = _mm_setr_epi16(_toLinear[0][p[r]], _toLinear[1][p[1]], _toLinear[0][p1[r]], _toLinear[1][p1[1]],
+                                    _toLinear[0][p2[r]], _toLinear[1][p2[1]], _toLinear[0][p3[r]], _toLinear[1][p3[1]]);
+        __m128i b1 = _mm_setr_epi16(_toLinear[2][p[b]], 1, _toLinear[2][p1[b]], 1,
+                                    _toLinear[2][p2[b]], 1, _toLinear[2][p3[b]], 1);
+        alignas(16) std::int16_t out[3][8];
+        for (int row = 0; row < 3; ++row)
+        {
+            __m128i v = _mm_add_epi32(_mm_madd_epi16(rg, redGreen[row]), _mm_madd_epi16(b1, blueOne[row]));
+            v = _mm_srai_epi32(v, MATRIX_SHIFT);
+            v = _mm_packs_epi32(v, v);
+            _mm_store_si128(reinterpret_cast<__m128i*>(out[row]), _mm_min_epi16(_mm_max_epi16(v, zero), linearMax));
+        }
+        for (int i = 0; i < 4; ++i)
+        {
+            p[i * components + r] = table[out[0][i]];
+            p[i * components + 1] = table[out[1][i]];
+            p[i * components + b] = table[out[2][i]];
+        }
+    }
+#endif
+    for (; x < width; ++x)
+    {
+        unsigned char* p = pixels + x * components;
+        int red = _toLinear[0][p[r]];
+        int green = _toLinear[1][p[1]];
+        int blue = _toLinear[2][p[b]];
+        int out[3];
+        for (int row = 0; row < 3; ++row)
+        {
+            int v = red * m[3 * row] + green * m[3 * row + 1] + blue * m[3 * row + 2] + MATRIX_ROUND;
+            out[row] = clampLinear(v >> MATRIX_SHIFT);
+        }
+        p[r] = table[out[0]];
+        p[1] = table[out[1]];
+        p[b] = table[out[2]];
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+// Conversion of 8 bit RGB pixels to sRGB from the color space of an
+// embedded ICC profile, for the common profiles that describe an RGB
+// space with three primaries and a tone curve per channel, such as
+// Display P3 and Adobe RGB. Each sample is mapped to linear light
+// through a 256 entry table built from its curve, the three channels
+// are taken to the linear sRGB primaries with one 3x3 matrix, and
+// the result is encoded with sRGB's curve by a table lookup, all in
+// fixed point. Four pixels are converted at a time with SSE2 where
+// available. Profiles built on lookup tables,
+// or for other color spaces, aren't handled.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vsgsandbox
+{
+    class ColorTransform
+    {
+    public:
+        enum Status
+        {
+            // The profile isn't a matrix/TRC RGB profile
+            Unsupported,
+            // The profile describes sRGB; the pixels need no change
+            Identity,
+            // convert() will take the pixels to sRGB
+            Convert
+        };
+        // Parse an ICC profile and build the tables that convert from
+        // it. The transform is only usable if Convert is returned.
+        Status setProfile(const unsigned char* profile, std::size_t size);
+        void reset() { _status = Unsupported; }
+        Status status() const { return _status; }
+        // Convert width pixels in place. components is 3 or 4, and a
+        // fourth component is left alone; bgr if the pixels are in
+        // BGR order.
+        void convert(unsigned char* pixels, std::size_t width, int components, bool bgr) const;
+
+    private:
+        Status _status = Unsupported;
+        std::int16_t _toLinear[3][256];
+        std::int16_t _matrix[9];
+    };
+}
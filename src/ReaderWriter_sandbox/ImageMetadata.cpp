@@ -0,0 +1,139 @@
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+#include "ImageMetadata.h"
+
+#include <string>
+
+using namespace vsgsandbox;
+
+const std::string exifKey("vsgsandbox/exif");
+
+vsg::ref_ptr<EXIF> EXIF::get(vsg::Object* obj)
+{
+    return vsg::ref_ptr<EXIF>(obj->getObject<EXIF>(exifKey));
+}
+
+void EXIF::set(vsg::Object* obj, EXIF* exif)
+{
+    obj->setObject(exifKey, exif);
+}
+
+const std::string imageScaleKey("vsgsandbox/imageScale");
+
+vsg::ref_ptr<ImageScale> ImageScale::get(vsg::Object* obj)
+{
+    return vsg::ref_ptr<ImageScale>(obj->getObject<ImageScale>(imageScaleKey));
+}
+
+void ImageScale::set(vsg::Object* obj, ImageScale* scale)
+{
+    obj->setObject(imageScaleKey, scale);
+}
+
+const std::string imagePlanesKey("vsgsandbox/imagePlanes");
+
+vsg::ref_ptr<ImagePlanes> ImagePlanes::get(vsg::Object* obj)
+{
+    return vsg::ref_ptr<ImagePlanes>(obj->getObject<ImagePlanes>(imagePlanesKey));
+}
+
+void ImagePlanes::set(vsg::Object* obj, ImagePlanes* planes)
+{
+    obj->setObject(imagePlanesKey, planes);
+}
+
+const std::string imageRegionKey("vsgsandbox/imageRegion");
+
+vsg::ref_ptr<ImageRegion> ImageRegion::get(vsg::Object* obj)
+{
+    return vsg::ref_ptr<ImageRegion>(obj->getObject<ImageRegion>(imageRegionKey));
+}
+
+void ImageRegion::set(vsg::Object* obj, ImageRegion* region)
+{
+    obj->setObject(imageRegionKey, region);
+}
+
+const std::string imageOriginKey("vsgsandbox/imageOrigin");
+
+vsg::ref_ptr<ImageOrigin> ImageOrigin::get(vsg::Object* obj)
+{
+    return vsg::ref_ptr<ImageOrigin>(obj->getObject<ImageOrigin>(imageOriginKey));
+}
+
+void ImageOrigin::set(vsg::Object* obj, ImageOrigin* origin)
+{
+    obj->setObject(imageOriginKey, origin);
+}
+
+const std::string iccProfileKey("vsgsandbox/iccProfile");
+
+vsg::ref_ptr<ICCProfile> ICCProfile::get(vsg::Object* obj)
+{
+    return vsg::ref_ptr<ICCProfile>(obj->getObject<ICCProfile>(iccProfileKey));
+}
+
+void ICCProfile::set(vsg::Object* obj, ICCProfile* profile)
+{
+    obj->setObject(iccProfileKey, profile);
+}
+
+const std::string imagePaletteKey("vsgsandbox/imagePalette");
+
+vsg::ref_ptr<ImagePalette> ImagePalette::get(vsg::Object* obj)
+{
+    return vsg::ref_ptr<ImagePalette>(obj->getObject<ImagePalette>(imagePaletteKey));
+}
+
+void ImagePalette::set(vsg::Object* obj, ImagePalette* palette)
+{
+    obj->setObject(imagePaletteKey, palette);
+}
+
+const std::string decodeQualityKey("vsgsandbox/decodeQuality");
+
+const char* DecodeQuality::name(Quality quality)
+{
+    switch (quality)
+    {
+    case Balanced:
+        return "balanced";
+    case Fast:
+        return "fast";
+    default:
+        return "exact";
+    }
+}
+
+bool DecodeQuality::fromName(const std::string& name, Quality* quality)
+{
+    for (Quality q : {Exact, Balanced, Fast})
+    {
+        if (name == DecodeQuality::name(q))
+        {
+            *quality = q;
+            return true;
+        }
+    }
+    return false;
+}
+
+vsg::ref_ptr<DecodeQuality> DecodeQuality::get(vsg::Object* obj)
+{
+    return vsg::ref_ptr<DecodeQuality>(obj->getObject<DecodeQuality>(decodeQualityKey));
+}
+
+void DecodeQuality::set(vsg::Object* obj, DecodeQuality* quality)
+{
+    obj->setObject(decodeQualityKey, quality);
+}
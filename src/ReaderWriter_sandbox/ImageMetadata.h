@@ -0,0 +1,260 @@
+#pragma once
+
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+#include <vsgsandbox/Export.h>
+#include <vsg/core/Array.h>
+#include <vsg/core/Object.h>
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vsgsandbox
+{
+    class VSGSANDBOX_DECLSPEC EXIF : public vsg::Inherit<vsg::Object, EXIF>
+    {
+    public:
+        // Positions of the "0th row and 0th column"" when the
+        // picture was taken. TopLeft is the normal orientation.
+        // Note that the jpeg reader actually writes out the bottom row first.
+        // Another view of the image's orientation from
+        // http://sylvana.net/jpegcrop/exif_orientation.html:
+        /*
+          Here is another description given by Adam M. Costello:
+
+          For convenience, here is what the letter F would look like if it were tagged correctly
+          and displayed by a program that ignores the orientation tag (thus showing the stored image): 
+          1        2       3      4         5            6           7          8
+
+          888888  888888      88  88      8888888888  88                  88  8888888888
+          88          88      88  88      88  88      88  88          88  88      88  88
+          8888      8888    8888  8888    88          8888888888  8888888888          88
+          88          88      88  88
+          88          88  888888  888888
+        */
+        enum Orientation
+        {
+            TopLeft = 1,
+            TopRight,
+            BottomRight,
+            BottomLeft,
+            LeftTop,
+            RightTop,
+            RightBottom,
+            LeftBottom
+        };
+        EXIF(Orientation orient = TopLeft)
+            : orientation(orient)
+        {
+        }
+        Orientation orientation;
+        // Getter / setter for use as VSG auxilliary data
+        static vsg::ref_ptr<EXIF> get(vsg::Object* obj);
+        static void set(vsg::Object* obj, EXIF* exif);
+    };
+
+    // The scale at which an image was decoded, for readers that can
+    // decode at reduced resolution. fullWidth and fullHeight are the
+    // dimensions of the image in the file; the image's aspect ratio
+    // should be taken from those, as the reduced dimensions are
+    // rounded up.
+    class VSGSANDBOX_DECLSPEC ImageScale : public vsg::Inherit<vsg::Object, ImageScale>
+    {
+    public:
+        ImageScale(unsigned int denom = 1, std::uint32_t width = 0, std::uint32_t height = 0)
+            : scaleDenominator(denom), fullWidth(width), fullHeight(height)
+        {
+        }
+        unsigned int scaleDenominator;
+        std::uint32_t fullWidth;
+        std::uint32_t fullHeight;
+        // Getter / setter for use as VSG auxilliary data
+        static vsg::ref_ptr<ImageScale> get(vsg::Object* obj);
+        static void set(vsg::Object* obj, ImageScale* scale);
+    };
+
+    // The layout of an image with a multi-planar format, such as
+    // VK_FORMAT_G8_B8_R8_3PLANE_420_UNORM. The planes are stored one
+    // after another in a single vsg::ubyteArray, in the order of the
+    // format's components, with no padding between rows; like other
+    // images from the readers, each plane's bottom row comes first.
+    class VSGSANDBOX_DECLSPEC ImagePlanes : public vsg::Inherit<vsg::Object, ImagePlanes>
+    {
+    public:
+        struct Plane
+        {
+            std::size_t offset = 0;     // in bytes from the start of the data
+            std::uint32_t width = 0;
+            std::uint32_t height = 0;
+        };
+        // Dimensions of the image, which are those of the first,
+        // full resolution plane.
+        std::uint32_t width = 0;
+        std::uint32_t height = 0;
+        std::vector<Plane> planes;
+        // Getter / setter for use as VSG auxilliary data
+        static vsg::ref_ptr<ImagePlanes> get(vsg::Object* obj);
+        static void set(vsg::Object* obj, ImagePlanes* planes);
+    };
+
+    // A rectangle of an image, in pixels of the full resolution
+    // image with the origin at its top left, as it is stored in the
+    // file. Passed to ReaderWriter_jpeg to decode only part of an
+    // image; the part that the result covers, which may be a little
+    // larger when decoding at reduced scale, is attached to it.
+    class VSGSANDBOX_DECLSPEC ImageRegion : public vsg::Inherit<vsg::Object, ImageRegion>
+    {
+    public:
+        ImageRegion(std::uint32_t in_x = 0, std::uint32_t in_y = 0,
+                    std::uint32_t in_width = 0, std::uint32_t in_height = 0)
+            : x(in_x), y(in_y), width(in_width), height(in_height)
+        {
+        }
+        std::uint32_t x;
+        std::uint32_t y;
+        std::uint32_t width;
+        std::uint32_t height;
+        // Getter / setter for use as VSG auxilliary data
+        static vsg::ref_ptr<ImageRegion> get(vsg::Object* obj);
+        static void set(vsg::Object* obj, ImageRegion* region);
+    };
+
+    // Which row of an image is stored first. The readers store the
+    // bottom row first unless they are asked for the top row first,
+    // in which case they attach an ImageOrigin of TopLeft; an image
+    // without one has its bottom row first. Vulkan puts texture
+    // coordinate v = 0 at the first row, so a top-down image is
+    // drawn upright by flipping v instead of reordering its rows.
+    class VSGSANDBOX_DECLSPEC ImageOrigin : public vsg::Inherit<vsg::Object, ImageOrigin>
+    {
+    public:
+        enum Origin
+        {
+            BottomLeft,
+            TopLeft
+        };
+        ImageOrigin(Origin in_origin = BottomLeft)
+            : origin(in_origin)
+        {
+        }
+        Origin origin;
+        // Getter / setter for use as VSG auxilliary data
+        static vsg::ref_ptr<ImageOrigin> get(vsg::Object* obj);
+        static void set(vsg::Object* obj, ImageOrigin* origin);
+    };
+
+    // The ICC profile embedded in an image file. The readers convert
+    // the pixels of images with common RGB profiles to sRGB as they
+    // decode them; when they can't, or are asked not to, the profile
+    // is attached to the image as it was in the file, and the pixels
+    // are left in its color space.
+    class VSGSANDBOX_DECLSPEC ICCProfile : public vsg::Inherit<vsg::Object, ICCProfile>
+    {
+    public:
+        ICCProfile(const unsigned char* in_data = nullptr, std::size_t size = 0)
+            : data(in_data, in_data + size)
+        {
+        }
+        std::vector<std::uint8_t> data;
+        // Getter / setter for use as VSG auxilliary data
+        static vsg::ref_ptr<ICCProfile> get(vsg::Object* obj);
+        static void set(vsg::Object* obj, ICCProfile* profile);
+    };
+
+    // The colors of an image whose pixels are indices into a
+    // palette, such as a palette PNG read with
+    // ReaderWriter_png::keepPalette. There are always 256 of them,
+    // so that any index can be looked up, for instance in a 256x1
+    // texture in the fragment shader; indices past the end of the
+    // file's palette are opaque black, as they are when the reader
+    // expands the palette itself. The colors are in the format
+    // VK_FORMAT_R8G8B8A8_SRGB, and have been through the same
+    // corrections as expanded pixels would.
+    class VSGSANDBOX_DECLSPEC ImagePalette : public vsg::Inherit<vsg::Object, ImagePalette>
+    {
+    public:
+        ImagePalette(vsg::ref_ptr<vsg::ubvec4Array> in_colors = {})
+            : colors(in_colors)
+        {
+        }
+        vsg::ref_ptr<vsg::ubvec4Array> colors;
+        // Getter / setter for use as VSG auxilliary data
+        static vsg::ref_ptr<ImagePalette> get(vsg::Object* obj);
+        static void set(vsg::Object* obj, ImagePalette* palette);
+    };
+
+    // How much accuracy a reader gives up for speed. The readers take
+    // the name of one of these from their decodeQuality option, and
+    // attach the one they decoded an image with.
+    class VSGSANDBOX_DECLSPEC DecodeQuality : public vsg::Inherit<vsg::Object, DecodeQuality>
+    {
+    public:
+        enum Quality
+        {
+            // The decoder's most accurate settings, which give the
+            // same pixels as the reference decoder; for export and
+            // processing
+            Exact,
+            // Faster settings that change the pixels by an amount
+            // that isn't visible, and skip integrity checks
+            Balanced,
+            // The fastest settings, which may visibly soften or
+            // misrender some images; for interactive browsing
+            Fast
+        };
+        DecodeQuality(Quality in_quality = Exact)
+            : quality(in_quality)
+        {
+        }
+        Quality quality;
+        // "exact", "balanced" or "fast"
+        static const char* name(Quality quality);
+        // Returns false, and leaves quality alone, if name isn't one
+        // of the above.
+        static bool fromName(const std::string& name, Quality* quality);
+        // Getter / setter for use as VSG auxilliary data
+        static vsg::ref_ptr<DecodeQuality> get(vsg::Object* obj);
+        static void set(vsg::Object* obj, DecodeQuality* quality);
+    };
+
+    // What a reader knows about an image from its headers alone,
+    // without decoding any pixels. The dimensions and format are
+    // those of the vsg::Data that read() would return with the same
+    // options.
+    class VSGSANDBOX_DECLSPEC ImageInfo : public vsg::Inherit<vsg::Object, ImageInfo>
+    {
+    public:
+        std::uint32_t width = 0;
+        std::uint32_t height = 0;
+        unsigned int components = 0;
+        unsigned int bitDepth = 0;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        vsg::ref_ptr<EXIF> exif;
+        // Set by readers that can decode at reduced resolution
+        vsg::ref_ptr<ImageScale> scale;
+        // Set if only part of the image would be decoded
+        vsg::ref_ptr<ImageRegion> region;
+        // Set if the image would be stored top row first
+        vsg::ref_ptr<ImageOrigin> origin;
+        // Set if the profile would be attached to the image
+        vsg::ref_ptr<ICCProfile> iccProfile;
+        // Set if the pixels would be indices into this palette
+        vsg::ref_ptr<ImagePalette> palette;
+        // The quality the image would be decoded with
+        vsg::ref_ptr<DecodeQuality> quality;
+    };
+}
@@ -11,9 +11,12 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 </editor-fold> */
 
 #include "ImageTranslator.h"
+#include "ImageMetadata.h"
 
 #include <vsg/core/Array2D.h>
 
+#include <algorithm>
+
 using namespace vsgsandbox;
 
 ImageTranslator::ImageTranslator(vsg::Device* device)
@@ -21,24 +24,132 @@ ImageTranslator::ImageTranslator(vsg::Device* device)
 {
 }
 
+namespace
+{
+    // The chroma subsampling of the multi-planar formats that the
+    // JPEG reader returns
+    bool chromaSubsampling(VkFormat format, std::uint32_t* hs, std::uint32_t* vs)
+    {
+        switch (format)
+        {
+        case VK_FORMAT_G8_B8_R8_3PLANE_420_UNORM:
+            *hs = 2;
+            *vs = 2;
+            return true;
+        case VK_FORMAT_G8_B8_R8_3PLANE_422_UNORM:
+            *hs = 2;
+            *vs = 1;
+            return true;
+        case VK_FORMAT_G8_B8_R8_3PLANE_444_UNORM:
+            *hs = 1;
+            *vs = 1;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Convert full-range YCbCr planes, as stored in JPEG files, to
+    // RGBA. Chroma samples are replicated rather than interpolated.
+    // The arithmetic is libjpeg's: 16 bit fixed point, with the
+    // chroma terms looked up in tables.
+    vsg::ref_ptr<vsg::Data> planesToRGBA(vsg::Data* texData, ImagePlanes* imagePlanes)
+    {
+        std::uint32_t hs = 1, vs = 1;
+        if (imagePlanes->planes.size() != 3 || !chromaSubsampling(texData->getFormat(), &hs, &vs))
+            return {};
+        const auto& yPlane = imagePlanes->planes[0];
+        const auto& cbPlane = imagePlanes->planes[1];
+        const auto& crPlane = imagePlanes->planes[2];
+        const std::uint32_t width = imagePlanes->width;
+        const std::uint32_t height = imagePlanes->height;
+        const std::uint32_t chromaWidth = (width + hs - 1) / hs;
+        const std::uint32_t chromaHeight = (height + vs - 1) / vs;
+        auto fits = [texData](const ImagePlanes::Plane& plane, std::uint32_t w, std::uint32_t h)
+        {
+            const std::size_t size = static_cast<std::size_t>(plane.width) * plane.height;
+            return plane.width >= w && plane.height >= h && plane.offset <= texData->dataSize()
+                && size <= texData->dataSize() - plane.offset;
+        };
+        if (!fits(yPlane, width, height) || !fits(cbPlane, chromaWidth, chromaHeight)
+            || !fits(crPlane, chromaWidth, chromaHeight))
+        {
+            return {};
+        }
+
+        const int SCALEBITS = 16;
+        const int ONE_HALF = 1 << (SCALEBITS - 1);
+        auto fix = [](double x) { return static_cast<int>(x * 65536.0 + 0.5); };
+        int crR[256], cbB[256], crG[256], cbG[256];
+        for (int i = 0; i < 256; ++i)
+        {
+            const int x = i - 128;
+            crR[i] = (fix(1.40200) * x + ONE_HALF) >> SCALEBITS;
+            cbB[i] = (fix(1.77200) * x + ONE_HALF) >> SCALEBITS;
+            crG[i] = -fix(0.71414) * x;
+            cbG[i] = -fix(0.34414) * x + ONE_HALF;
+        }
+        auto clamp = [](int val)
+        {
+            return static_cast<std::uint8_t>(std::min(std::max(val, 0), 255));
+        };
+
+        const auto* data = static_cast<const std::uint8_t*>(texData->dataPointer());
+        auto array4 = vsg::ubvec4Array2D::create(width, height);
+        array4->setFormat(VK_FORMAT_R8G8B8A8_SRGB);
+        auto* out = static_cast<std::uint8_t*>(array4->dataPointer());
+        for (uint32_t j = 0; j < height; ++j)
+        {
+            const std::uint8_t* yRow = data + yPlane.offset + static_cast<std::size_t>(j) * yPlane.width;
+            const std::uint8_t* cbRow = data + cbPlane.offset + static_cast<std::size_t>(j / vs) * cbPlane.width;
+            const std::uint8_t* crRow = data + crPlane.offset + static_cast<std::size_t>(j / vs) * crPlane.width;
+            for (uint32_t i = 0; i < width; ++i, out += 4)
+            {
+                const int y = yRow[i];
+                const int cb = cbRow[i / hs];
+                const int cr = crRow[i / hs];
+                out[0] = clamp(y + crR[cr]);
+                out[1] = clamp(y + ((cbG[cb] + crG[cr]) >> SCALEBITS));
+                out[2] = clamp(y + cbB[cb]);
+                out[3] = 255;
+            }
+        }
+        return array4;
+    }
+}
+
 vsg::ref_ptr<vsg::Data>
 ImageTranslator::translateToSupported(vsg::Data* texData)
 {
     vsg::ref_ptr<vsg::Data> result;
     auto format = texData->getFormat();
+    auto imagePlanes = ImagePlanes::get(texData);
     if (_device)
     {
+        // A multi-planar image is sampled through a sampler YCbCr
+        // conversion, which the VSG doesn't create, so it is up to
+        // the application. JPEG's chroma samples lie midway between
+        // the luma samples.
+        VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+        if (imagePlanes)
+            required |= VK_FORMAT_FEATURE_MIDPOINT_CHROMA_SAMPLES_BIT;
         VkFormatProperties formatProperties;
         vkGetPhysicalDeviceFormatProperties(*_device->getPhysicalDevice(), texData->getFormat(),
                                             &formatProperties);
-        if ((formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0)
+        if ((formatProperties.optimalTilingFeatures & required) == required)
         {
             result = texData;
             return result;
         }
     }
+    if (imagePlanes)
+    {
+        return planesToRGBA(texData, imagePlanes);
+    }
 
-    if (format == VK_FORMAT_R8G8B8A8_SRGB)
+    // Palette indices are looked up by the shader that samples them.
+    // Every device can sample R8_UINT, with a nearest filter.
+    if (format == VK_FORMAT_R8G8B8A8_SRGB || (format == VK_FORMAT_R8_UINT && ImagePalette::get(texData)))
     {
         result = texData;
         return result;
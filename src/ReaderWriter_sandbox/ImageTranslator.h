@@ -22,6 +22,12 @@ namespace vsgsandbox
     {
     public:
         ImageTranslator(vsg::Device* device = nullptr);
+        // Return texData if the device can sample its format, and
+        // otherwise a copy converted to RGBA. Without a device, only
+        // RGBA and palette images are returned as they are. A
+        // multi-planar image, such as the YCbCr planes of a JPEG, is
+        // kept only if the device can sample it with a sampler YCbCr
+        // conversion, which the application must then create.
         vsg::ref_ptr<vsg::Data> translateToSupported(vsg::Data* texData);
     protected:
         vsg::ref_ptr<vsg::Device> _device;
@@ -0,0 +1,107 @@
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+#include "MappedFile.h"
+
+#include <vsgsandbox/Debug.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace vsgsandbox;
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile(const vsg::Path& filename)
+{
+    HANDLE file = CreateFileW(filename.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+    LARGE_INTEGER fileSize;
+    if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return;
+    }
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+    {
+        CloseHandle(file);
+        return;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return;
+    }
+    _fileHandle = file;
+    _mappingHandle = mapping;
+    _data = static_cast<const unsigned char*>(view);
+    _size = static_cast<std::size_t>(fileSize.QuadPart);
+}
+
+MappedFile::~MappedFile()
+{
+    if (_data)
+        UnmapViewOfFile(_data);
+    if (_mappingHandle)
+        CloseHandle(_mappingHandle);
+    if (_fileHandle)
+        CloseHandle(_fileHandle);
+}
+
+#else
+
+MappedFile::MappedFile(const vsg::Path& filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat sb;
+    // Only regular files can be mapped; pipes and devices go through a stream.
+    if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode) || sb.st_size == 0)
+    {
+        close(fd);
+        return;
+    }
+    void* addr = mmap(nullptr, static_cast<std::size_t>(sb.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the descriptor is closed.
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        VSGSB_DEBUG << "mmap failed for " << filename << std::endl;
+        return;
+    }
+#if defined(MADV_SEQUENTIAL)
+    madvise(addr, static_cast<std::size_t>(sb.st_size), MADV_SEQUENTIAL);
+#endif
+    _data = static_cast<const unsigned char*>(addr);
+    _size = static_cast<std::size_t>(sb.st_size);
+}
+
+MappedFile::~MappedFile()
+{
+    if (_data)
+        munmap(const_cast<unsigned char*>(_data), _size);
+}
+
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+#include <vsgsandbox/Export.h>
+#include <vsg/io/FileSystem.h>
+
+#include <cstddef>
+
+namespace vsgsandbox
+{
+    // A read-only memory mapping of a whole file. The readers use
+    // this to hand the entire file to the decoder as one buffer
+    // instead of pulling it through a std::istream. If the file
+    // can't be mapped (it doesn't exist, is empty, or is a pipe),
+    // valid() returns false and the caller should fall back to a
+    // stream.
+    class VSGSANDBOX_DECLSPEC MappedFile
+    {
+    public:
+        explicit MappedFile(const vsg::Path& filename);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool valid() const { return _data != nullptr; }
+        const unsigned char* data() const { return _data; }
+        std::size_t size() const { return _size; }
+    protected:
+        const unsigned char* _data = nullptr;
+        std::size_t _size = 0;
+#if defined(_WIN32)
+        void* _fileHandle = nullptr;
+        void* _mappingHandle = nullptr;
+#endif
+    };
+}
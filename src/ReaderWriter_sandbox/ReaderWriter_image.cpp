@@ -11,13 +11,90 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 </editor-fold> */
 
 #include "ReaderWriter_image.h"
-#include "jpeg/ReaderWriter_jpeg.h"
-#include <png/ReaderWriter_png.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 using namespace vsgsandbox;
 
 ReaderWriter_image::ReaderWriter_image()
 {
-    add(ReaderWriter_jpeg::create());
-    add(ReaderWriter_png::create());
+    _jpeg = ReaderWriter_jpeg::create();
+    _png = ReaderWriter_png::create();
+    add(_jpeg);
+    add(_png);
+}
+
+vsg::ref_ptr<ImageInfo> ReaderWriter_image::probe(const vsg::Path& filename,
+                                                  vsg::ref_ptr<const vsg::Options> options) const
+{
+    if (auto info = _jpeg->probe(filename, options)) return info;
+    return _png->probe(filename, options);
+}
+
+vsg::ref_ptr<ImageInfo> ReaderWriter_image::probe(std::istream& fin,
+                                                  vsg::ref_ptr<const vsg::Options> options) const
+{
+    // The first byte of the signature tells the formats apart.
+    // Peeking at it, rather than trying one reader and seeking back,
+    // works on streams that can't seek, such as pipes.
+    switch (fin.peek())
+    {
+    case 0xFF:
+        return _jpeg->probe(fin, options);
+    case 0x89:
+        return _png->probe(fin, options);
+    default:
+        return {};
+    }
+}
+
+ReaderWriter_image::Objects ReaderWriter_image::readBatch(const vsg::Paths& filenames,
+                                                          vsg::ref_ptr<const vsg::Options> options,
+                                                          unsigned int numThreads) const
+{
+    Objects results(filenames.size());
+    if (numThreads == 0)
+    {
+        numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    numThreads = std::min(numThreads, static_cast<unsigned int>(filenames.size()));
+    // The batch is already spread over the cores; don't let the JPEG
+    // reader split single images as well, unless asked to.
+    unsigned int jpegThreads = 0;
+    if (numThreads > 1 && !(options && options->getValue(ReaderWriter_jpeg::numThreads, jpegThreads)))
+    {
+        auto batchOptions = options ? vsg::Options::create(*options) : vsg::Options::create();
+        batchOptions->setValue(ReaderWriter_jpeg::numThreads, 1u);
+        options = batchOptions;
+    }
+    // Each worker takes the next unread file. The readers share no
+    // decoding state between threads: the JPEG reader's decompressors
+    // come from a pool that each thread keeps, so they can run
+    // concurrently.
+    std::atomic<std::size_t> next(0);
+    auto worker = [&]()
+    {
+        for (std::size_t i = next++; i < filenames.size(); i = next++)
+        {
+            results[i] = read(filenames[i], options);
+        }
+    };
+    if (numThreads <= 1)
+    {
+        worker();
+        return results;
+    }
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < numThreads; ++i)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    return results;
 }
@@ -15,11 +15,31 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 #include <vsg/io/ReaderWriter.h>
 #include <vsgsandbox/Export.h>
 
+#include "jpeg/ReaderWriter_jpeg.h"
+#include "png/ReaderWriter_png.h"
+
+#include <vector>
+
 namespace vsgsandbox
 {
     class VSGSANDBOX_DECLSPEC ReaderWriter_image : public vsg::Inherit<vsg::CompositeReaderWriter, ReaderWriter_image>
     {
     public:
+        using Objects = std::vector<vsg::ref_ptr<vsg::Object>>;
+
         ReaderWriter_image();
+        // Describe an image from its headers, without decoding it;
+        // null if no reader recognizes the file.
+        vsg::ref_ptr<ImageInfo> probe(const vsg::Path& filename, vsg::ref_ptr<const vsg::Options> options = {}) const;
+        vsg::ref_ptr<ImageInfo> probe(std::istream& fin, vsg::ref_ptr<const vsg::Options> options = {}) const;
+        // Read a list of files on a pool of worker threads. The
+        // results are in the same order as filenames; an entry is
+        // null if its file couldn't be read. numThreads == 0 uses
+        // one thread per hardware core.
+        Objects readBatch(const vsg::Paths& filenames, vsg::ref_ptr<const vsg::Options> options = {},
+                          unsigned int numThreads = 0) const;
+    protected:
+        vsg::ref_ptr<ReaderWriter_jpeg> _jpeg;
+        vsg::ref_ptr<ReaderWriter_png> _png;
     };
 }
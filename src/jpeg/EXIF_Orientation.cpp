@@ -20,7 +20,7 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 
 #define EXIF_IDENT_STRING  "Exif\000\000"
 
-static unsigned short de_get16(void *ptr, bool byteSwap)
+static unsigned short de_get16(const void *ptr, bool byteSwap)
 {
     unsigned short val;
 
@@ -35,7 +35,7 @@ static unsigned short de_get16(void *ptr, bool byteSwap)
     return val;
 }
 
-static unsigned int de_get32(void *ptr, bool byteSwap)
+static unsigned int de_get32(const void *ptr, bool byteSwap)
 {
     unsigned int val;
 
@@ -81,14 +81,15 @@ int EXIF_Orientation (j_decompress_ptr cinfo)
 
     VSGSB_DEBUG<<"exif_marker found "<<exif_marker<<std::endl;
 
-    /* Do we have enough data? */
-    if (exif_marker->data_length < 32)
-    {
-        VSGSB_DEBUG<<"exif_marker too short : "<<exif_marker->data_length<<std::endl;
-        return 0;
-    }
-
+    return EXIF_Orientation(exif_marker->data, exif_marker->data_length);
+}
 
+/* Find the TIFF header at the start of an EXIF block, and whether its
+ * values need byte swapping. All offsets in the IFDs are relative to
+ * the header.
+ */
+static bool findTIFFHeader (const JOCTET* data, unsigned int data_length, unsigned int* tiff_ret, bool* swap_ret)
+{
     bool tiffHeaderBigEndian = false;
 
     const char leth[]  = {0x49, 0x49, 0x2a, 0x00};  // Little endian TIFF header
@@ -103,25 +104,26 @@ int EXIF_Orientation (j_decompress_ptr cinfo)
                     - This is what we look for, to determine endianess.
             0x000E: 0th IFD offset pointer - 4 bytes
 
-            exif_marker->data points to the first data after the APP1 marker
+            data points to the first data after the APP1 marker
             and length entries, which is the exif identification string.
             The TIFF header should thus normally be found at i=6, below,
-            and the pointer to IFD0 will be at 6+4 = 10.
+            and the pointer to IFD0 will be at 6+4 = 10. A PNG eXIf
+            chunk has no identification string, so there it is at i=0.
     */
 
 
     /* Check for TIFF header and catch endianess */
     unsigned int i = 0;
-    for(i=0; i < 16; ++i)
+    for(i=0; i < 16 && i + 4 <= data_length; ++i)
     {
         /* Little endian TIFF header */
-        if (memcmp (&exif_marker->data[i], leth, 4) == 0)
+        if (memcmp (&data[i], leth, 4) == 0)
         {
             tiffHeaderBigEndian = false;
             break;
         }
         /* Big endian TIFF header */
-        else if (memcmp (&exif_marker->data[i], beth, 4) == 0)
+        else if (memcmp (&data[i], beth, 4) == 0)
         {
             tiffHeaderBigEndian = true;
             break;
@@ -129,30 +131,54 @@ int EXIF_Orientation (j_decompress_ptr cinfo)
     }
 
     /* So did we find a TIFF header or did we just hit end of buffer? */
-    if (i >= 16)
+    if (i >= 16 || i + 4 > data_length)
     {
         VSGSB_DEBUG<<"Could not find TIFF header"<<std::endl;
-        return 0;
+        return false;
+    }
+
+    /* Do we have enough data for the header, the IFD0 offset, a tag
+        count and one tag? */
+    if (data_length < i + 8 + 2 + 12)
+    {
+        VSGSB_DEBUG<<"exif data too short : "<<data_length<<std::endl;
+        return false;
     }
 
     VSGSB_DEBUG<<"Found TIFF header = "<<i<<" endian = "<<(tiffHeaderBigEndian?"BigEndian":"LittleEndian")<< std::endl;
 
     bool swapBytes = vsgsandbox::isHostBigEndian()!=tiffHeaderBigEndian;
     VSGSB_DEBUG<<"swapBytes = "<<swapBytes<< std::endl;
+    *swap_ret = swapBytes;
+    *tiff_ret = i;
+    return true;
+}
+
+/* Find the orientation tag in IFD0 of an EXIF block. Returns the
+ * offset of its 12-byte entry, or 0 if there isn't a well-formed one.
+ */
+static unsigned int findOrientationEntry (const JOCTET* data, unsigned int data_length, bool* swap_ret)
+{
+    unsigned int i = 0;
+    bool swapBytes = false;
+    if (!findTIFFHeader(data, data_length, &i, &swapBytes))
+        return 0;
+    *swap_ret = swapBytes;
 
     /* Read out the offset pointer to IFD0 */
-    unsigned int offset  = de_get32(&exif_marker->data[i] + 4, swapBytes);
-    i += offset;
+    unsigned int offset  = de_get32(&data[i] + 4, swapBytes);
 
     VSGSB_DEBUG<<"offset = "<<offset<<std::endl;
 
-    /* Check that we still are within the buffer and can read the tag count */
-    if ((i + 2) > exif_marker->data_length)
+    /* Check that we still are within the buffer and can read the tag
+    count, without letting a large offset wrap around */
+    if (offset >= data_length || offset > data_length - i - 2)
         return 0;
+    i += offset;
 
     /* Find out how many tags we have in IFD0. As per the TIFF spec, the first
     two bytes of the IFD contain a count of the number of tags. */
-    unsigned int tags    = de_get16(&exif_marker->data[i], swapBytes);
+    unsigned int tags    = de_get16(&data[i], swapBytes);
     i += 2;
 
     VSGSB_DEBUG<<"tags = "<<tags<<std::endl;
@@ -160,7 +186,7 @@ int EXIF_Orientation (j_decompress_ptr cinfo)
     /* Check that we still have enough data for all tags to check. The tags
     are listed in consecutive 12-byte blocks. The tag ID, type, size, and
     a pointer to the actual value, are packed into these 12 byte entries. */
-    if ((i + tags * 12) > exif_marker->data_length)
+    if (tags > (data_length - i) / 12)
     {
         VSGSB_DEBUG<<"Not enough length for requied tags"<<std::endl;
         return 0;
@@ -172,9 +198,9 @@ int EXIF_Orientation (j_decompress_ptr cinfo)
     /* Check through IFD0 for tags of interest */
     while (tags--)
     {
-        unsigned int tag = de_get16(&exif_marker->data[i], swapBytes);
-        unsigned int type   = de_get16(&exif_marker->data[i + 2], swapBytes);
-        unsigned int count  = de_get32(&exif_marker->data[i + 4], swapBytes);
+        unsigned int tag = de_get16(&data[i], swapBytes);
+        unsigned int type   = de_get16(&data[i + 2], swapBytes);
+        unsigned int count  = de_get32(&data[i + 4], swapBytes);
 
         VSGSB_DEBUG<<"  tag=0x"<<std::hex<<tag<<std::dec<<", type="<<type<<", count="<<count<<std::endl;
 
@@ -185,13 +211,7 @@ int EXIF_Orientation (j_decompress_ptr cinfo)
                 will consist of a single (count=1) 2-byte integer (type=3). */
             if (type != 3 || count != 1) return 0;
 
-
-            /* Return the orientation value. Within the 12-byte block, the
-                pointer to the actual data is at offset 8. */
-            unsigned int ret =  de_get16(&exif_marker->data[i + 8], swapBytes);
-
-            VSGSB_DEBUG<<"Found orientationTag, ret = "<<ret<<std::endl;
-            return ret <= 8 ? ret : 0;
+            return i;
         }
         /* move the pointer to the next 12-byte tag field. */
         i = i + 12;
@@ -202,3 +222,151 @@ int EXIF_Orientation (j_decompress_ptr cinfo)
     return 0; /* No EXIF Orientation tag found */
 }
 
+int EXIF_Orientation (const JOCTET* data, unsigned int data_length)
+{
+    bool swapBytes = false;
+    unsigned int i = findOrientationEntry(data, data_length, &swapBytes);
+    if (i == 0)
+        return 0;
+
+    /* Return the orientation value. Within the 12-byte block, the
+        pointer to the actual data is at offset 8. */
+    unsigned int ret =  de_get16(&data[i + 8], swapBytes);
+
+    VSGSB_DEBUG<<"Found orientationTag, ret = "<<ret<<std::endl;
+    return ret <= 8 ? ret : 0;
+}
+
+bool EXIF_SetOrientation (JOCTET* data, unsigned int data_length, int orientation)
+{
+    bool swapBytes = false;
+    unsigned int i = findOrientationEntry(data, data_length, &swapBytes);
+    if (i == 0)
+        return false;
+
+    unsigned short val = static_cast<unsigned short>(orientation);
+    if (swapBytes)
+        vsgsandbox::swapBytes(val, &val);
+    memcpy(&data[i + 8], &val, sizeof(val));
+    return true;
+}
+
+/* The value of a SHORT or LONG tag with a count of 1, which is stored
+ * in the entry itself.
+ */
+static bool tagValue (const JOCTET* entry, bool swapBytes, unsigned int* value_ret)
+{
+    unsigned int type   = de_get16(&entry[2], swapBytes);
+    unsigned int count  = de_get32(&entry[4], swapBytes);
+    if (count != 1) return false;
+    if (type == 3)
+        *value_ret = de_get16(&entry[8], swapBytes);
+    else if (type == 4)
+        *value_ret = de_get32(&entry[8], swapBytes);
+    else
+        return false;
+    return true;
+}
+
+bool EXIF_Thumbnail (const JOCTET* data, unsigned int data_length,
+                     unsigned int* offset_ret, unsigned int* length_ret)
+{
+    unsigned int tiff = 0;
+    bool swapBytes = false;
+    if (!findTIFFHeader(data, data_length, &tiff, &swapBytes))
+        return false;
+
+    /* Skip over IFD0 to the offset of IFD1, which follows its tags */
+    unsigned int offset = de_get32(&data[tiff] + 4, swapBytes);
+    if (offset >= data_length || tiff + offset + 2 > data_length)
+        return false;
+    unsigned int i = tiff + offset;
+    unsigned int tags = de_get16(&data[i], swapBytes);
+    i += 2;
+    if ((i + tags * 12 + 4) > data_length)
+        return false;
+    offset = de_get32(&data[i + tags * 12], swapBytes);
+    if (offset == 0)
+    {
+        VSGSB_DEBUG<<"No IFD1"<<std::endl;
+        return false;
+    }
+    if (offset >= data_length || tiff + offset + 2 > data_length)
+        return false;
+    i = tiff + offset;
+    tags = de_get16(&data[i], swapBytes);
+    i += 2;
+    if ((i + tags * 12) > data_length)
+        return false;
+
+    /* A JPEG thumbnail is given by the JPEGInterchangeFormat and
+       JPEGInterchangeFormatLength tags. */
+    unsigned int thumbOffset = 0;
+    unsigned int thumbLength = 0;
+    while (tags--)
+    {
+        unsigned int tag = de_get16(&data[i], swapBytes);
+        if (tag == 0x201)
+            tagValue(&data[i], swapBytes, &thumbOffset);
+        else if (tag == 0x202)
+            tagValue(&data[i], swapBytes, &thumbLength);
+        i = i + 12;
+    }
+    VSGSB_DEBUG<<"thumbnail offset = "<<thumbOffset<<", length = "<<thumbLength<<std::endl;
+    if (thumbOffset == 0 || thumbLength == 0
+        || thumbOffset >= data_length - tiff || thumbLength > data_length - tiff - thumbOffset)
+        return false;
+    *offset_ret = tiff + thumbOffset;
+    *length_ret = thumbLength;
+    return true;
+}
+
+#define ICC_IDENT_STRING  "ICC_PROFILE"
+#define ICC_OVERHEAD_LEN  14    /* identifier, sequence number and count */
+#define ICC_MAX_MARKERS   255
+
+bool ICC_Profile (j_decompress_ptr cinfo, std::vector<JOCTET>* profile)
+{
+    profile->clear();
+
+    /* Each APP2 marker has the identifier, its sequence number from
+       1 and the number of markers, then its piece of the profile. */
+    jpeg_saved_marker_ptr pieces[ICC_MAX_MARKERS + 1] = {};
+    unsigned int count = 0;
+    for (jpeg_saved_marker_ptr marker = cinfo->marker_list; marker; marker = marker->next)
+    {
+        if (marker->marker != ICC_JPEG_MARKER || marker->data_length < ICC_OVERHEAD_LEN
+            || memcmp(marker->data, ICC_IDENT_STRING, 12) != 0)
+            continue;
+        unsigned int seq = marker->data[12];
+        unsigned int num = marker->data[13];
+        if (count == 0)
+            count = num;
+        if (num != count || seq == 0 || seq > count || pieces[seq])
+        {
+            VSGSB_DEBUG<<"inconsistent ICC markers"<<std::endl;
+            return false;
+        }
+        pieces[seq] = marker;
+    }
+    if (count == 0)
+        return false;
+
+    size_t size = 0;
+    for (unsigned int seq = 1; seq <= count; ++seq)
+    {
+        if (!pieces[seq])
+        {
+            VSGSB_DEBUG<<"ICC marker "<<seq<<" missing"<<std::endl;
+            return false;
+        }
+        size += pieces[seq]->data_length - ICC_OVERHEAD_LEN;
+    }
+    profile->reserve(size);
+    for (unsigned int seq = 1; seq <= count; ++seq)
+    {
+        profile->insert(profile->end(), pieces[seq]->data + ICC_OVERHEAD_LEN,
+                        pieces[seq]->data + pieces[seq]->data_length);
+    }
+    return true;
+}
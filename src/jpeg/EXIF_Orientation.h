@@ -13,16 +13,28 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 
 </editor-fold> */
 
-#include <stdio.h>
+#include "JPEG_Lib.h"
 
-extern "C"                      // OMG...
-{
-    #include <jpeglib.h>
-    #include "jerror.h"
-}
+#include <vector>
 
 #define EXIF_JPEG_MARKER   JPEG_APP0+1
+#define ICC_JPEG_MARKER    JPEG_APP0+2
 
 extern int EXIF_Orientation (j_decompress_ptr cinfo);
+// Orientation from the contents of an EXIF block: the "Exif\0\0"
+// identifier followed by the TIFF header and IFDs.
+extern int EXIF_Orientation (const JOCTET* data, unsigned int data_length);
+// Overwrite the orientation tag of an EXIF block in place. Returns
+// false if the block has no orientation tag.
+extern bool EXIF_SetOrientation (JOCTET* data, unsigned int data_length, int orientation);
+// Locate the JPEG thumbnail in IFD1 of an EXIF block. The offset
+// returned is from the start of data. Returns false if there is no
+// JPEG thumbnail, or it isn't all within the block.
+extern bool EXIF_Thumbnail (const JOCTET* data, unsigned int data_length,
+                            unsigned int* offset_ret, unsigned int* length_ret);
+// Reassemble the ICC profile that is split across APP2 markers, which
+// must have been saved with jpeg_save_markers(). Returns false, with
+// profile empty, if there is no complete profile.
+extern bool ICC_Profile (j_decompress_ptr cinfo, std::vector<JOCTET>* profile);
 
 #endif
@@ -0,0 +1,63 @@
+#pragma once
+
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+// Decoders that ReaderWriter_jpeg can use instead of its own libjpeg
+// scanline decoder. A backend decodes a whole JPEG held in memory to
+// interleaved pixels, in the layout that the scanline decoder would
+// produce. The reader works out that layout from the header first,
+// so a backend only has to fill it in. Regions, planar output and
+// progressive refinement need control of libjpeg that a backend
+// doesn't have, so they are always done by the scanline decoder.
+
+#include "JPEG_Lib.h"
+#include "ReaderWriter_sandbox/ImageMetadata.h"
+
+#include <cstddef>
+#include <string>
+
+namespace vsgsandbox
+{
+    struct JPEGBackendParams
+    {
+        const unsigned char* data = nullptr;
+        std::size_t size = 0;
+        // The image to produce
+        JDIMENSION width = 0;
+        JDIMENSION height = 0;
+        int components = 0;             // 1, or 3 or 4 for color
+        J_COLOR_SPACE colorSpace = JCS_RGB; // the order of color components
+        unsigned int scaleDenom = 1;    // 1, 2, 4 or 8
+        bool topDown = false;           // the first row is the top one
+        DecodeQuality::Quality quality = DecodeQuality::Exact;
+    };
+
+    class JPEGDecodeBackend
+    {
+    public:
+        virtual ~JPEGDecodeBackend() = default;
+        virtual const char* name() const = 0;
+        // Whether the image described by params can be decoded, and
+        // if not, why.
+        virtual bool supports(const JPEGBackendParams& params, std::string* message) const = 0;
+        // Decode the image into a buffer allocated with new[], which
+        // belongs to the caller. Returns null, with the reason in
+        // message if that isn't null, if that fails.
+        virtual unsigned char* decode(const JPEGBackendParams& params, std::string* message) const = 0;
+    };
+
+    // The backends that the library was built with; null if not
+    // available.
+    const JPEGDecodeBackend* turboJPEGBackend();
+    const JPEGDecodeBackend* stbImageBackend();
+}
@@ -0,0 +1,135 @@
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+#include "JPEG_CMYK.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CMYK_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace vsgsandbox;
+
+namespace
+{
+    struct OutputLayout
+    {
+        int components;
+        bool bgr;
+    };
+
+    OutputLayout outputLayout(J_COLOR_SPACE colorSpace)
+    {
+        switch (colorSpace)
+        {
+#ifdef JCS_ALPHA_EXTENSIONS
+        case JCS_EXT_RGBA:
+            return {4, false};
+        case JCS_EXT_BGRA:
+            return {4, true};
+#endif
+#ifdef JCS_EXTENSIONS
+        case JCS_EXT_BGR:
+            return {3, true};
+#endif
+        default:
+            return {3, false};
+        }
+    }
+
+    // x * y / 255, rounded, for x and y from 0 to 255
+    inline unsigned int mul255(unsigned int x, unsigned int y)
+    {
+        unsigned int t = x * y + 128;
+        return (t + (t >> 8)) >> 8;
+    }
+
+    void convertScalar(const JSAMPLE* cmyk, JSAMPLE* out, JDIMENSION width, OutputLayout layout, bool inverted)
+    {
+        // Uninverted samples are the amount of ink
+        const unsigned int flip = inverted ? 0 : 255;
+        for (JDIMENSION x = 0; x < width; ++x, cmyk += 4, out += layout.components)
+        {
+            unsigned int k = cmyk[3] ^ flip;
+            unsigned int r = mul255(cmyk[0] ^ flip, k);
+            unsigned int g = mul255(cmyk[1] ^ flip, k);
+            unsigned int b = mul255(cmyk[2] ^ flip, k);
+            out[0] = static_cast<JSAMPLE>(layout.bgr ? b : r);
+            out[1] = static_cast<JSAMPLE>(g);
+            out[2] = static_cast<JSAMPLE>(layout.bgr ? r : b);
+            if (layout.components == 4)
+                out[3] = 255;
+        }
+    }
+
+#ifdef CMYK_SSE2
+    // Multiply the C, M and Y of two pixels, as 16 bit lanes, by
+    // their K, with the same rounding as mul255()
+    inline __m128i mulK(__m128i pixels)
+    {
+        __m128i k = _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)),
+                                        _MM_SHUFFLE(3, 3, 3, 3));
+        __m128i t = _mm_add_epi16(_mm_mullo_epi16(pixels, k), _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    }
+
+    inline __m128i swapRB(__m128i pixels)
+    {
+        return _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+    }
+
+    // Convert 4 CMYK pixels to 4 RGBA or BGRA pixels
+    inline __m128i convert4(__m128i cmyk, __m128i flip, bool bgr)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        cmyk = _mm_xor_si128(cmyk, flip);
+        __m128i lo = mulK(_mm_unpacklo_epi8(cmyk, zero));
+        __m128i hi = mulK(_mm_unpackhi_epi8(cmyk, zero));
+        if (bgr)
+        {
+            lo = swapRB(lo);
+            hi = swapRB(hi);
+        }
+        const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+        return _mm_or_si128(_mm_packus_epi16(lo, hi), alpha);
+    }
+#endif
+}
+
+void vsgsandbox::convertCMYKRow(const JSAMPLE* cmyk, JSAMPLE* out, JDIMENSION width, J_COLOR_SPACE colorSpace,
+                                bool inverted)
+{
+    const OutputLayout layout = outputLayout(colorSpace);
+    JDIMENSION x = 0;
+#ifdef CMYK_SSE2
+    const __m128i flip = _mm_set1_epi8(inverted ? 0 : static_cast<char>(0xFF));
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128i pixels = convert4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(cmyk + 4 * x)), flip, layout.bgr);
+        if (layout.components == 4)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4 * x), pixels);
+            continue;
+        }
+        alignas(16) JSAMPLE rgba[16];
+        _mm_store_si128(reinterpret_cast<__m128i*>(rgba), pixels);
+        JSAMPLE* to = out + 3 * x;
+        for (int i = 0; i < 4; ++i)
+        {
+            to[3 * i] = rgba[4 * i];
+            to[3 * i + 1] = rgba[4 * i + 1];
+            to[3 * i + 2] = rgba[4 * i + 2];
+        }
+    }
+#endif
+    convertScalar(cmyk + 4 * x, out + layout.components * x, width - x, layout, inverted);
+}
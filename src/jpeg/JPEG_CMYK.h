@@ -0,0 +1,34 @@
+#pragma once
+
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+// Conversion to RGB of the CMYK pixels that libjpeg decodes from CMYK
+// and YCCK JPEGs; for YCCK, libjpeg converts the YCC part to CMY
+// itself. There is no color profile to go by, so the conversion is
+// the naive one that most viewers use, R = (1 - C)(1 - K) and so on.
+// Adobe applications store CMYK inverted, with 0 for full ink, and
+// mark the file with an APP14 segment, which libjpeg records in
+// saw_Adobe_marker; files without one are taken to be uninverted.
+// A row is converted as it is copied into the image, 4 pixels at a
+// time with SSE2 where available.
+
+#include "JPEG_Lib.h"
+
+namespace vsgsandbox
+{
+    // Convert width CMYK pixels to the layout of colorSpace: JCS_RGB,
+    // JCS_EXT_BGR, JCS_EXT_RGBA or JCS_EXT_BGRA, with an opaque
+    // alpha. If inverted, the samples are Adobe's inverted CMYK.
+    void convertCMYKRow(const JSAMPLE* cmyk, JSAMPLE* out, JDIMENSION width, J_COLOR_SPACE colorSpace,
+                        bool inverted);
+}
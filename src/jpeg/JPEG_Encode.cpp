@@ -0,0 +1,244 @@
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+#include "JPEG_Encode.h"
+#include "JPEG_Error.h"
+#include "JPEG_Source.h"
+
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+using namespace vsgsandbox;
+
+namespace
+{
+    const unsigned int JPEG_SOF0 = 0xC0;
+    const unsigned int JPEG_SOF2 = 0xC2;
+    const unsigned int JPEG_SOS = 0xDA;
+
+    // Images smaller than this aren't worth splitting between threads
+    const JDIMENSION MIN_STRIP_PIXELS = 1024 * 1024;
+    // Rows passed to each jpeg_write_scanlines() call
+    const JDIMENSION ROWS_PER_CALL = 16;
+
+    unsigned int get16(const unsigned char* ptr)
+    {
+        return (static_cast<unsigned int>(ptr[0]) << 8) | ptr[1];
+    }
+
+    // Encode rows [firstRow, firstRow + numRows) of the image, counted
+    // from the top, as a JPEG of their own. The output goes to stream
+    // if it isn't null, otherwise to vec. If restartRows, there is a
+    // restart marker after every MCU row. No C++ objects live in this
+    // frame, as libjpeg errors longjmp back to it.
+    bool compressRows(const JPEGEncodeParams& params, JDIMENSION firstRow, JDIMENSION numRows, bool restartRows,
+                      std::ostream* stream, std::vector<unsigned char>* vec, char* message)
+    {
+        struct jpeg_compress_struct cinfo;
+        struct my_error_mgr jerr;
+        JSAMPROW rows[ROWS_PER_CALL];
+
+        cinfo.err = my_std_error(jerr);
+        if (setjmp(jerr.setjmp_buffer))
+        {
+            std::memcpy(message, jerr.message, JMSG_LENGTH_MAX);
+            jpeg_destroy_compress(&cinfo);
+            return false;
+        }
+        jpeg_create_compress(&cinfo);
+        if (stream)
+            jpeg_stream_dest(&cinfo, stream);
+        else
+            jpeg_vector_dest(&cinfo, vec);
+
+        cinfo.image_width = params.width;
+        cinfo.image_height = numRows;
+        cinfo.input_components = params.components;
+        cinfo.in_color_space = params.colorSpace;
+        jpeg_set_defaults(&cinfo);
+        jpeg_set_quality(&cinfo, params.quality, TRUE /* limit to baseline-JPEG values */);
+        /* The standard Huffman tables, so that strips of the same
+         * image are all coded the same way.
+         */
+        cinfo.optimize_coding = FALSE;
+        if (restartRows)
+            cinfo.restart_in_rows = 1;
+        jpeg_start_compress(&cinfo, TRUE);
+
+        while (cinfo.next_scanline < cinfo.image_height)
+        {
+            JDIMENSION count = std::min(ROWS_PER_CALL, cinfo.image_height - cinfo.next_scanline);
+            for (JDIMENSION i = 0; i < count; ++i)
+            {
+                JDIMENSION y = firstRow + cinfo.next_scanline + i;
+                if (params.bottomUp)
+                    y = params.height - 1 - y;
+                rows[i] = const_cast<JSAMPROW>(params.pixels + y * params.rowStride);
+            }
+            (void) jpeg_write_scanlines(&cinfo, rows, count);
+        }
+
+        jpeg_finish_compress(&cinfo);
+        jpeg_destroy_compress(&cinfo);
+        return true;
+    }
+
+    // The height of an MCU in the images that compressRows() writes:
+    // jpeg_set_defaults() codes color images as YCbCr with 2x2 chroma
+    // subsampling.
+    JDIMENSION mcuHeight(const JPEGEncodeParams& params)
+    {
+        return params.colorSpace == JCS_GRAYSCALE ? DCTSIZE : 2 * DCTSIZE;
+    }
+
+    // Find the SOF segment and the start of the entropy-coded data in
+    // a single-scan JPEG written by libjpeg.
+    bool findScan(const std::vector<unsigned char>& stream, std::size_t* sofOffset, std::size_t* dataStart)
+    {
+        const std::size_t size = stream.size();
+        std::size_t pos = 2;
+        while (pos + 4 <= size)
+        {
+            if (stream[pos] != 0xFF)
+                return false;
+            unsigned int marker = stream[pos + 1];
+            std::size_t length = get16(&stream[pos + 2]);
+            if (marker >= JPEG_SOF0 && marker <= JPEG_SOF2)
+                *sofOffset = pos;
+            if (marker == JPEG_SOS)
+            {
+                *dataStart = pos + 2 + length;
+                return *dataStart + 2 <= size;
+            }
+            pos += 2 + length;
+        }
+        return false;
+    }
+
+    struct Strip
+    {
+        JDIMENSION firstRow;
+        JDIMENSION numRows;
+        std::vector<unsigned char> stream;
+        char message[JMSG_LENGTH_MAX];
+        bool encoded;
+    };
+}
+
+bool vsgsandbox::encodeJPEG(const JPEGEncodeParams& params, std::ostream& out, std::string* message)
+{
+    char buffer[JMSG_LENGTH_MAX] = "";
+    if (compressRows(params, 0, params.height, false, &out, nullptr, buffer))
+        return true;
+    if (message)
+        *message = buffer;
+    return false;
+}
+
+StripResult vsgsandbox::encodeJPEGStrips(const JPEGEncodeParams& params, unsigned int numThreads,
+                                         std::ostream& out, std::string* message)
+{
+    // Strips are made of groups of 8 MCU rows, so that the restart
+    // markers in each strip are numbered from RST0 where the group
+    // starts, just as they are in the whole image.
+    const JDIMENSION groupHeight = 8 * mcuHeight(params);
+    const JDIMENSION numGroups = (params.height + groupHeight - 1) / groupHeight;
+    if (numThreads < 2 || numGroups < 2 || params.height > JPEG_MAX_DIMENSION
+        || static_cast<std::size_t>(params.width) * params.height < MIN_STRIP_PIXELS)
+    {
+        return StripResult::TooSmall;
+    }
+    const JDIMENSION numStrips = std::min(static_cast<JDIMENSION>(numThreads), numGroups);
+    const JDIMENSION groupsPerStrip = (numGroups + numStrips - 1) / numStrips;
+    const JDIMENSION stripHeight = groupsPerStrip * groupHeight;
+
+    std::vector<Strip> strips;
+    for (JDIMENSION firstRow = 0; firstRow < params.height; firstRow += stripHeight)
+    {
+        strips.emplace_back();
+        strips.back().firstRow = firstRow;
+        strips.back().numRows = std::min(stripHeight, params.height - firstRow);
+        strips.back().message[0] = '\0';
+        strips.back().encoded = false;
+    }
+    if (strips.size() < 2)
+        return StripResult::TooSmall;
+
+    auto encodeStrip = [&params](Strip& strip)
+    {
+        strip.encoded = compressRows(params, strip.firstRow, strip.numRows, true, nullptr, &strip.stream,
+                                     strip.message);
+    };
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < strips.size(); ++i)
+    {
+        threads.emplace_back([&, i]() { encodeStrip(strips[i]); });
+    }
+    encodeStrip(strips[0]);
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    // Find the pieces of each strip before writing any of them
+    std::vector<std::size_t> dataStart(strips.size());
+    std::size_t sofOffset = 0;
+    for (std::size_t i = 0; i < strips.size(); ++i)
+    {
+        Strip& strip = strips[i];
+        if (!strip.encoded)
+        {
+            if (message)
+                *message = strip.message;
+            return StripResult::Failed;
+        }
+        std::size_t stripSOF = 0;
+        if (!findScan(strip.stream, &stripSOF, &dataStart[i]))
+        {
+            if (message)
+                *message = "unexpected markers in strip";
+            return StripResult::Failed;
+        }
+        if (i == 0)
+            sofOffset = stripSOF;
+    }
+
+    // The header of the first strip, with the height of the image
+    std::vector<unsigned char>& first = strips[0].stream;
+    first[sofOffset + 5] = static_cast<unsigned char>(params.height >> 8);
+    first[sofOffset + 6] = static_cast<unsigned char>(params.height & 0xFF);
+    out.write(reinterpret_cast<const char*>(first.data()), dataStart[0]);
+    for (std::size_t i = 0; i < strips.size(); ++i)
+    {
+        // The entropy-coded data, without the EOI marker
+        const std::vector<unsigned char>& stream = strips[i].stream;
+        out.write(reinterpret_cast<const char*>(stream.data() + dataStart[i]), stream.size() - 2 - dataStart[i]);
+        if (i + 1 < strips.size())
+        {
+            const char rst7[2] = {static_cast<char>(0xFF), static_cast<char>(JPEG_RST0 + 7)};
+            out.write(rst7, 2);
+        }
+    }
+    const char eoi[2] = {static_cast<char>(0xFF), static_cast<char>(JPEG_EOI)};
+    out.write(eoi, 2);
+    out.flush();
+    if (!out)
+    {
+        if (message)
+            *message = "error writing the stream";
+        return StripResult::Failed;
+    }
+    return StripResult::Written;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+// JPEG encoding, serially or in strips on several threads. A strip
+// is a whole number of groups of 8 MCU rows, encoded as a JPEG of its
+// own with a restart marker after every MCU row. The restart markers
+// inside each strip are then numbered as they would be in the whole
+// image, so the strips are joined by keeping the header of the first
+// one, with the full image height, and putting an RST7 marker between
+// their entropy-coded data. The result is the same file that a
+// serial encode with the same restart interval would produce, and
+// the multithreaded decoder in JPEG_Restart can split it again.
+
+#include "JPEG_Lib.h"
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+
+namespace vsgsandbox
+{
+    struct JPEGEncodeParams
+    {
+        const unsigned char* pixels = nullptr;
+        JDIMENSION width = 0;
+        JDIMENSION height = 0;
+        std::size_t rowStride = 0;      // in bytes
+        bool bottomUp = true;           // the first row in pixels is the bottom one
+        int components = 0;             // per pixel in pixels
+        J_COLOR_SPACE colorSpace = JCS_UNKNOWN; // of pixels
+        int quality = 100;
+    };
+
+    // Encode the image to out. Returns false, with libjpeg's message
+    // in message if that isn't null, if encoding failed.
+    bool encodeJPEG(const JPEGEncodeParams& params, std::ostream& out, std::string* message = nullptr);
+
+    enum class StripResult
+    {
+        Written,
+        TooSmall,       // nothing was written; encode serially instead
+        Failed
+    };
+
+    // Encode the image to out in strips on up to numThreads threads.
+    // The strips are all encoded before anything is written, so a
+    // libjpeg error leaves out untouched.
+    StripResult encodeJPEGStrips(const JPEGEncodeParams& params, unsigned int numThreads, std::ostream& out,
+                                 std::string* message = nullptr);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+// libjpeg error handling shared by the jpeg module. A fatal libjpeg
+// error longjmps back to the setjmp point of whoever owns the
+// my_error_mgr. Nothing with a destructor should be created between
+// the setjmp and the libjpeg calls.
+
+#include "JPEG_Lib.h"
+
+#include <setjmp.h>
+
+namespace vsgsandbox
+{
+    /* All of the error state for one decode lives here, in the
+     * DecompressContext that the decode has to itself, so that any
+     * number of threads can decode at once.
+     */
+    struct my_error_mgr
+    {
+        struct jpeg_error_mgr pub;   /* "public" fields */
+
+        jmp_buf setjmp_buffer;       /* for return to caller */
+        char message[JMSG_LENGTH_MAX]; /* libjpeg's message for the fatal error */
+        unsigned char* buffer;       /* output image, freed on error */
+    };
+
+    typedef struct my_error_mgr * my_error_ptr;
+
+    inline void
+    my_error_exit (j_common_ptr cinfo)
+    {
+        /* cinfo->err really points to a my_error_mgr struct, so coerce pointer */
+        my_error_ptr myerr = (my_error_ptr) cinfo->err;
+
+        /* Always display the message. */
+        /* We could postpone this until after returning, if we chose. */
+        /*(*cinfo->err->output_message) (cinfo);*/
+
+        (*cinfo->err->format_message) (cinfo, myerr->message);
+
+        /* Return control to the setjmp point */
+        longjmp(myerr->setjmp_buffer, 1);
+    }
+
+    inline void
+    my_output_message (j_common_ptr cinfo)
+    {
+        char buffer[JMSG_LENGTH_MAX];
+
+        /* Create the message */
+        (*cinfo->err->format_message) (cinfo, buffer);
+
+        // OSG_WARN<<buffer<<std::endl;
+    }
+
+    // Set up jerr as cinfo's error manager. The caller must still
+    // call setjmp(jerr.setjmp_buffer).
+    inline struct jpeg_error_mgr*
+    my_std_error (struct my_error_mgr& jerr)
+    {
+        jpeg_std_error(&jerr.pub);
+        jerr.pub.error_exit = my_error_exit;
+        jerr.pub.output_message = my_output_message;
+        jerr.message[0] = '\0';
+        jerr.buffer = NULL;
+        return &jerr.pub;
+    }
+}
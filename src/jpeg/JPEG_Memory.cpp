@@ -0,0 +1,215 @@
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+#include "JPEG_Memory.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+using namespace vsgsandbox;
+
+namespace
+{
+    // libjpeg-turbo aligns its allocations and pads sample rows to
+    // 32 bytes or more for its SIMD code, which may read and write
+    // whole vectors past the end of a row. A cache line covers that.
+    const std::size_t ARENA_ALIGN = 64;
+    // The smallest block; decoding a small image fits in one
+    const std::size_t MIN_BLOCK_SIZE = 64 * 1024;
+    // reset() doesn't keep more than this, so that a decompressor
+    // that once decoded a huge image doesn't hold on to its memory
+    const std::size_t MAX_RETAINED_SIZE = 16 * 1024 * 1024;
+    // The limit that jmemmgr.c puts on a single allocation
+    const std::size_t MAX_ALLOCATION = 1000000000;
+
+    std::size_t alignUp(std::size_t size)
+    {
+        return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    }
+}
+
+struct JPEGArena::Block
+{
+    Block* next;
+    unsigned char* data;        // aligned start of the usable space
+    std::size_t size;           // usable bytes
+
+    static Block* create(std::size_t size)
+    {
+        void* memory = std::malloc(sizeof(Block) + ARENA_ALIGN + size);
+        if (!memory)
+            return nullptr;
+        Block* block = static_cast<Block*>(memory);
+        std::uintptr_t start = reinterpret_cast<std::uintptr_t>(block + 1);
+        block->next = nullptr;
+        block->data = reinterpret_cast<unsigned char*>(alignUp(start));
+        block->size = size;
+        return block;
+    }
+};
+
+JPEGArena::~JPEGArena()
+{
+    release();
+}
+
+void JPEGArena::release()
+{
+    while (_first)
+    {
+        Block* next = _first->next;
+        std::free(_first);
+        _first = next;
+    }
+    _current = nullptr;
+    _used = 0;
+}
+
+void* JPEGArena::allocate(std::size_t size)
+{
+    size = alignUp(size);
+    while (_current && _used + size > _current->size)
+    {
+        _current = _current->next;
+        _used = 0;
+    }
+    if (!_current)
+    {
+        /* Grow geometrically, so that a large image needs few blocks */
+        std::size_t blockSize = capacity();
+        if (blockSize < MIN_BLOCK_SIZE)
+            blockSize = MIN_BLOCK_SIZE;
+        if (blockSize < size)
+            blockSize = size;
+        Block* block = Block::create(blockSize);
+        if (!block)
+            return nullptr;
+        if (_first)
+        {
+            Block* last = _first;
+            while (last->next)
+                last = last->next;
+            last->next = block;
+        }
+        else
+        {
+            _first = block;
+        }
+        _current = block;
+        _used = 0;
+    }
+    void* result = _current->data + _used;
+    _used += size;
+    return result;
+}
+
+void JPEGArena::reset()
+{
+    std::size_t total = capacity();
+    if (total > MAX_RETAINED_SIZE)
+    {
+        release();
+    }
+    else if (_first && _first->next)
+    {
+        /* One block that holds everything the last image needed */
+        release();
+        _first = Block::create(total);
+    }
+    _current = _first;
+    _used = 0;
+}
+
+std::size_t JPEGArena::capacity() const
+{
+    std::size_t total = 0;
+    for (Block* block = _first; block; block = block->next)
+        total += block->size;
+    return total;
+}
+
+namespace
+{
+/* The memory manager methods that replace those of jmemmgr.c. Errors
+ * are reported with ERREXIT, like libjpeg's own.
+ */
+
+JPEGArena* poolArena(j_common_ptr cinfo, int pool_id)
+{
+    JPEGMemory* memory = static_cast<JPEGMemory*>(cinfo->client_data);
+    if (pool_id == JPOOL_IMAGE)
+        return &memory->image;
+    if (pool_id != JPOOL_PERMANENT)
+        ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id);
+    return &memory->permanent;
+}
+
+void* arena_alloc(j_common_ptr cinfo, int pool_id, size_t sizeofobject)
+{
+    JPEGArena* arena = poolArena(cinfo, pool_id);
+    if (sizeofobject > MAX_ALLOCATION)
+        ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 1);
+    void* result = arena->allocate(sizeofobject);
+    if (!result)
+        ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 2);
+    return result;
+}
+
+/* A 2-D sample array, with its rows in one piece of the arena. The
+ * rows are padded as jmemmgr.c pads them.
+ */
+JSAMPARRAY arena_alloc_sarray(j_common_ptr cinfo, int pool_id, JDIMENSION samplesperrow, JDIMENSION numrows)
+{
+    std::size_t rowSize = alignUp(static_cast<std::size_t>(samplesperrow) * sizeof(JSAMPLE));
+    if (numrows > 0 && rowSize > MAX_ALLOCATION / numrows)
+        ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 3);
+    JSAMPARRAY result = static_cast<JSAMPARRAY>(arena_alloc(cinfo, pool_id, numrows * sizeof(JSAMPROW)));
+    JSAMPROW rows = static_cast<JSAMPROW>(arena_alloc(cinfo, pool_id, numrows * rowSize));
+    for (JDIMENSION i = 0; i < numrows; ++i)
+        result[i] = rows + i * rowSize;
+    return result;
+}
+
+JBLOCKARRAY arena_alloc_barray(j_common_ptr cinfo, int pool_id, JDIMENSION blocksperrow, JDIMENSION numrows)
+{
+    std::size_t rowSize = static_cast<std::size_t>(blocksperrow) * sizeof(JBLOCK);
+    if (numrows > 0 && rowSize > MAX_ALLOCATION / numrows)
+        ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 4);
+    JBLOCKARRAY result = static_cast<JBLOCKARRAY>(arena_alloc(cinfo, pool_id, numrows * sizeof(JBLOCKROW)));
+    JBLOCKROW rows = static_cast<JBLOCKROW>(arena_alloc(cinfo, pool_id, numrows * rowSize));
+    for (JDIMENSION i = 0; i < numrows; ++i)
+        result[i] = rows + i * blocksperrow;
+    return result;
+}
+
+void arena_free_pool(j_common_ptr cinfo, int pool_id)
+{
+    JPEGMemory* memory = static_cast<JPEGMemory*>(cinfo->client_data);
+    memory->free_pool(cinfo, pool_id);
+    /* The permanent pool is only freed by jpeg_destroy(), which doesn't
+     * come through here; its arena goes with the JPEGMemory.
+     */
+    if (pool_id == JPOOL_IMAGE)
+        memory->image.reset();
+}
+}
+
+void vsgsandbox::jpeg_arena_memory(j_common_ptr cinfo, JPEGMemory* memory)
+{
+    cinfo->client_data = memory;
+    memory->free_pool = cinfo->mem->free_pool;
+    cinfo->mem->alloc_small = arena_alloc;
+    cinfo->mem->alloc_large = arena_alloc;
+    cinfo->mem->alloc_sarray = arena_alloc_sarray;
+    cinfo->mem->alloc_barray = arena_alloc_barray;
+    cinfo->mem->free_pool = arena_free_pool;
+}
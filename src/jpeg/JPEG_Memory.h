@@ -0,0 +1,72 @@
+#pragma once
+
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+// Arena allocation for libjpeg. libjpeg's own memory manager gets the
+// working memory of every image from malloc() and gives it back at the
+// end: a few large blocks for the small objects, and one block for
+// each row buffer. With a decompressor that is reused from image to
+// image, those allocations can come from an arena instead, which is
+// reset when the image's pool is freed and keeps its memory for the
+// next image.
+
+#include "JPEG_Lib.h"
+
+#include <cstddef>
+
+namespace vsgsandbox
+{
+    // Memory handed out by moving a pointer through a few large
+    // blocks. reset() frees all of it at once and keeps the blocks,
+    // merged into one if there were several, so that another image
+    // of the same size allocates nothing.
+    class JPEGArena
+    {
+    public:
+        JPEGArena() = default;
+        ~JPEGArena();
+        JPEGArena(const JPEGArena&) = delete;
+        JPEGArena& operator=(const JPEGArena&) = delete;
+
+        // size bytes, aligned for libjpeg's SIMD code, or null if out
+        // of memory.
+        void* allocate(std::size_t size);
+        void reset();
+        // The size of the blocks that are held
+        std::size_t capacity() const;
+
+    private:
+        struct Block;
+        void release();
+        Block* _first = nullptr;
+        Block* _current = nullptr;
+        std::size_t _used = 0;      // bytes used in _current
+    };
+
+    // The arenas of one libjpeg object, for its JPOOL_IMAGE and
+    // JPOOL_PERMANENT allocations.
+    struct JPEGMemory
+    {
+        JPEGArena image;
+        JPEGArena permanent;
+        // libjpeg's own free_pool, which still frees the virtual
+        // arrays and whatever was allocated before the arenas were
+        // installed.
+        void (*free_pool)(j_common_ptr cinfo, int pool_id) = nullptr;
+    };
+
+    // Make the memory manager of a created libjpeg object allocate
+    // from memory, which must outlive it. cinfo->client_data is used
+    // to find memory.
+    void jpeg_arena_memory(j_common_ptr cinfo, JPEGMemory* memory);
+}
@@ -0,0 +1,136 @@
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+#include "JPEG_Pool.h"
+#include "JPEG_Source.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+using namespace vsgsandbox;
+
+namespace
+{
+    std::atomic<unsigned int> poolSize(4);
+
+    // Set when this thread's pool has been destroyed. It has no
+    // destructor of its own, so it can still be read afterwards, such
+    // as by a static object that is destroyed after main() returns.
+    thread_local bool poolDestroyed = false;
+
+    // The idle decompressors of a thread, destroyed when it exits
+    struct ThreadPool
+    {
+        ~ThreadPool()
+        {
+            poolDestroyed = true;
+        }
+        std::vector<std::unique_ptr<DecompressContext>> contexts;
+    };
+
+    std::vector<std::unique_ptr<DecompressContext>>& threadPool()
+    {
+        static thread_local ThreadPool pool;
+        return pool.contexts;
+    }
+}
+
+DecompressContext::DecompressContext()
+{
+    cinfo.err = my_std_error(jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_arena_memory((j_common_ptr) &cinfo, &_memory);
+}
+
+DecompressContext::~DecompressContext()
+{
+    jpeg_destroy_decompress(&cinfo);
+}
+
+void DecompressContext::resetError()
+{
+    cinfo.err = my_std_error(jerr);
+}
+
+void DecompressContext::istreamSource(std::istream* infile)
+{
+    cinfo.src = _streamSource;
+    jpeg_istream_src(&cinfo, infile);
+    _streamSource = cinfo.src;
+}
+
+void DecompressContext::memorySource(const unsigned char* data, std::size_t size)
+{
+    cinfo.src = _memorySource;
+    jpeg_memory_src(&cinfo, data, size);
+    _memorySource = cinfo.src;
+}
+
+void DecompressContext::suspendingSource(SuspendingInput* input)
+{
+    cinfo.src = _suspendingSource;
+    jpeg_suspending_src(&cinfo, input);
+    _suspendingSource = cinfo.src;
+}
+
+JSAMPARRAY DecompressContext::rowBuffer(std::size_t samples)
+{
+    if (_rows.size() < samples)
+        _rows.resize(samples);
+    _rowPointer = _rows.data();
+    return &_rowPointer;
+}
+
+PooledDecompressor::PooledDecompressor()
+    : _thread(std::this_thread::get_id())
+{
+    auto& pool = threadPool();
+    if (pool.empty())
+    {
+        _context = new DecompressContext;
+    }
+    else
+    {
+        _context = pool.back().release();
+        pool.pop_back();
+    }
+    _context->resetError();
+}
+
+PooledDecompressor::~PooledDecompressor()
+{
+    // Another thread's pool can't be reached from here, and this
+    // thread's may already have gone.
+    if (_thread == std::this_thread::get_id() && !poolDestroyed)
+    {
+        auto& pool = threadPool();
+        if (pool.size() < poolSize)
+        {
+            jpeg_abort_decompress(&_context->cinfo);
+            _context->jerr.buffer = nullptr;
+            pool.emplace_back(_context);
+            return;
+        }
+    }
+    delete _context;
+}
+
+void PooledDecompressor::setPoolSize(unsigned int size)
+{
+    poolSize = size;
+}
+
+unsigned int PooledDecompressor::getPoolSize()
+{
+    return poolSize;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+// Reusable libjpeg decompressors. Creating and destroying a
+// decompressor for every image costs a round of allocations and
+// setup that shows up when many small images are read, so each
+// thread keeps a few idle ones. A decompressor is reset with
+// jpeg_abort_decompress() between images, which keeps everything in
+// its permanent pool: the marker reader, the source managers and the
+// stream input buffer. The memory for each image comes from the
+// decompressor's own arena, so once it has decoded an image of a
+// given size, decoding another one doesn't call malloc() at all.
+
+#include "JPEG_Error.h"
+#include "JPEG_Memory.h"
+#include "JPEG_Source.h"
+#include "ReaderWriter_sandbox/ColorProfile.h"
+
+#include <cstddef>
+#include <iosfwd>
+#include <thread>
+#include <vector>
+
+namespace vsgsandbox
+{
+    struct DecompressContext
+    {
+        DecompressContext();
+        ~DecompressContext();
+        DecompressContext(const DecompressContext&) = delete;
+        DecompressContext& operator=(const DecompressContext&) = delete;
+
+        // Reset the error manager before a decode; the caller must
+        // still call setjmp(jerr.setjmp_buffer).
+        void resetError();
+        // Make cinfo read from a stream or from a block of memory.
+        // Each kind of source manager is only allocated once, so a
+        // context can switch between them.
+        void istreamSource(std::istream* infile);
+        void memorySource(const unsigned char* data, std::size_t size);
+        void suspendingSource(SuspendingInput* input);
+        // A row buffer of at least samples samples, which is kept
+        // for the next image.
+        JSAMPARRAY rowBuffer(std::size_t samples);
+
+        struct jpeg_decompress_struct cinfo;
+        struct my_error_mgr jerr;
+        // The ICC profile of the image being decoded, if it has one,
+        // and its conversion to sRGB
+        std::vector<JOCTET> iccProfile;
+        ColorTransform colorTransform;
+
+    private:
+        JPEGMemory _memory;
+        struct jpeg_source_mgr* _streamSource = nullptr;
+        struct jpeg_source_mgr* _memorySource = nullptr;
+        struct jpeg_source_mgr* _suspendingSource = nullptr;
+        std::vector<JSAMPLE> _rows;
+        JSAMPROW _rowPointer = nullptr;
+    };
+
+    // Takes a decompressor from this thread's pool, or creates one,
+    // and puts it back, reset, when it goes out of scope. If it is
+    // destroyed on another thread, or after its thread's pool, the
+    // decompressor is deleted instead.
+    class PooledDecompressor
+    {
+    public:
+        PooledDecompressor();
+        ~PooledDecompressor();
+        PooledDecompressor(const PooledDecompressor&) = delete;
+        PooledDecompressor& operator=(const PooledDecompressor&) = delete;
+
+        DecompressContext* get() const { return _context; }
+        DecompressContext* operator->() const { return _context; }
+
+        // The number of idle decompressors each thread keeps. 0
+        // destroys every decompressor after use.
+        static void setPoolSize(unsigned int size);
+        static unsigned int getPoolSize();
+
+    private:
+        DecompressContext* _context;
+        std::thread::id _thread;
+    };
+}
@@ -0,0 +1,359 @@
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+#include "JPEG_Restart.h"
+#include "JPEG_Error.h"
+#include "JPEG_Source.h"
+
+#include <vsgsandbox/Debug.h>
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+using namespace vsgsandbox;
+
+namespace
+{
+    const unsigned int JPEG_SOI = 0xD8;
+
+    unsigned int get16(const unsigned char* ptr)
+    {
+        return (static_cast<unsigned int>(ptr[0]) << 8) | ptr[1];
+    }
+
+    // One band of MCU rows. Rows [firstRow, endRow) are written to
+    // the output; rows [decodeStart, decodeEnd) are decoded, so that
+    // the chroma upsampling at the edges of the band sees the same
+    // neighbours as it would in a full decode.
+    struct Band
+    {
+        unsigned int firstRow;
+        unsigned int endRow;
+        unsigned int decodeStart;
+        unsigned int decodeEnd;
+    };
+
+    struct BandOutput
+    {
+        const unsigned char* stream;
+        std::size_t streamSize;
+        JSAMPROW* rows;            // row pointers for every decoded row
+        JDIMENSION numRows;
+    };
+
+    // The setjmp lives here, in a function without any C++ objects.
+    bool decodeBand(const BandOutput& out, j_decompress_ptr header)
+    {
+        struct jpeg_decompress_struct cinfo;
+        struct my_error_mgr jerr;
+
+        cinfo.err = my_std_error(jerr);
+        if (setjmp(jerr.setjmp_buffer))
+        {
+            VSGSB_DEBUG << "JPEG band decoder: " << jerr.message << std::endl;
+            jpeg_destroy_decompress(&cinfo);
+            return false;
+        }
+        jpeg_create_decompress(&cinfo);
+        jpeg_memory_src(&cinfo, out.stream, out.streamSize);
+        (void) jpeg_read_header(&cinfo, TRUE);
+        // Everything that affects the output pixels must match the
+        // whole image decode.
+        cinfo.out_color_space = header->out_color_space;
+        cinfo.scale_num = header->scale_num;
+        cinfo.scale_denom = header->scale_denom;
+        cinfo.dct_method = header->dct_method;
+        cinfo.do_fancy_upsampling = header->do_fancy_upsampling;
+        cinfo.do_block_smoothing = header->do_block_smoothing;
+        (void) jpeg_start_decompress(&cinfo);
+        if (cinfo.output_width != header->output_width
+            || cinfo.output_components != header->output_components
+            || cinfo.output_height != out.numRows)
+        {
+            jpeg_destroy_decompress(&cinfo);
+            return false;
+        }
+        while (cinfo.output_scanline < cinfo.output_height)
+        {
+            (void) jpeg_read_scanlines(&cinfo, out.rows + cinfo.output_scanline,
+                                       cinfo.output_height - cinfo.output_scanline);
+        }
+        (void) jpeg_finish_decompress(&cinfo);
+        bool result = jerr.pub.num_warnings == 0;
+        jpeg_destroy_decompress(&cinfo);
+        return result;
+    }
+}
+
+bool vsgsandbox::scanRestartMarkers(const unsigned char* data, std::size_t size, RestartLayout& layout)
+{
+    if (size < 4 || data[0] != 0xFF || data[1] != JPEG_SOI)
+        return false;
+    std::size_t pos = 2;
+    unsigned int width = 0;
+    unsigned int numComponents = 0;
+    unsigned int hmax = 1, vmax = 1;
+    bool haveSOF = false;
+    for (;;)
+    {
+        // Skip fill bytes
+        while (pos + 1 < size && data[pos] == 0xFF && data[pos + 1] == 0xFF)
+            ++pos;
+        if (pos + 4 > size || data[pos] != 0xFF)
+            return false;
+        unsigned int marker = data[pos + 1];
+        if (marker == JPEG_EOI)
+            return false;
+        // The length counts itself
+        const unsigned int length = get16(&data[pos + 2]);
+        std::size_t segmentEnd = pos + 2 + length;
+        if (length < 2 || segmentEnd > size)
+            return false;
+        switch (marker)
+        {
+        case 0xC0:              // SOF0 baseline
+        case 0xC1:              // SOF1 extended sequential
+        {
+            if (segmentEnd - pos < 10 || data[pos + 4] != 8)
+                return false;
+            layout.imageHeight = get16(&data[pos + 5]);
+            width = get16(&data[pos + 7]);
+            numComponents = data[pos + 9];
+            if (layout.imageHeight == 0 || width == 0 || segmentEnd - pos < 10 + 3 * numComponents)
+                return false;
+            for (unsigned int c = 0; c < numComponents; ++c)
+            {
+                unsigned int sampling = data[pos + 10 + 3 * c + 1];
+                hmax = std::max(hmax, sampling >> 4);
+                vmax = std::max(vmax, sampling & 0xF);
+            }
+            layout.sofOffset = pos;
+            layout.tables.emplace_back(pos, segmentEnd - pos);
+            haveSOF = true;
+            break;
+        }
+        case 0xC4:              // DHT
+        case 0xDB:              // DQT
+        case JPEG_APP0:         // JFIF, for the color space
+        case JPEG_APP0 + 14:    // Adobe, ditto
+            layout.tables.emplace_back(pos, segmentEnd - pos);
+            break;
+        case 0xDD:              // DRI
+            if (segmentEnd - pos < 6)
+                return false;
+            layout.restartInterval = get16(&data[pos + 4]);
+            layout.tables.emplace_back(pos, segmentEnd - pos);
+            break;
+        case 0xDA:              // SOS
+            // The scan must contain all the components.
+            if (!haveSOF || segmentEnd - pos < 5 || data[pos + 4] != numComponents)
+                return false;
+            layout.sosOffset = pos;
+            break;
+        default:
+            // Other SOFn are progressive, lossless, hierarchical or
+            // arithmetic coded; none of those are handled.
+            if (marker >= 0xC2 && marker <= 0xCF)
+                return false;
+            break;
+        }
+        pos = segmentEnd;
+        if (marker == 0xDA)
+            break;
+    }
+    if (layout.restartInterval == 0)
+        return false;
+    if (numComponents == 1)
+    {
+        // A non-interleaved scan; each MCU is one block.
+        hmax = vmax = 1;
+    }
+    layout.mcusPerRow = (width + 8 * hmax - 1) / (8 * hmax);
+    layout.mcuHeight = 8 * vmax;
+    layout.mcuRows = (layout.imageHeight + layout.mcuHeight - 1) / layout.mcuHeight;
+
+    // Find the restart markers.
+    layout.segmentStart.clear();
+    layout.segmentStart.push_back(pos);
+    for (;;)
+    {
+        const void* found = memchr(&data[pos], 0xFF, size - pos);
+        if (!found)
+            return false;       // truncated
+        pos = static_cast<const unsigned char*>(found) - data;
+        if (pos + 1 >= size)
+            return false;
+        unsigned int next = data[pos + 1];
+        if (next == 0x00 || next == 0xFF)
+        {
+            // stuffed zero, or a fill byte before a marker
+            pos += 1;
+        }
+        else if (next >= JPEG_RST0 && next <= JPEG_RST0 + 7)
+        {
+            pos += 2;
+            layout.segmentStart.push_back(pos);
+        }
+        else
+        {
+            break;
+        }
+    }
+    layout.scanEnd = pos;
+    // Anything other than EOI here means more scans.
+    if (data[pos + 1] != JPEG_EOI)
+        return false;
+    std::size_t totalMCUs = static_cast<std::size_t>(layout.mcusPerRow) * layout.mcuRows;
+    std::size_t expectedSegments = (totalMCUs + layout.restartInterval - 1) / layout.restartInterval;
+    return layout.segmentStart.size() == expectedSegments;
+}
+
+bool vsgsandbox::decodeRestartBands(const unsigned char* data, const RestartLayout& layout,
+                                    j_decompress_ptr header, unsigned int numThreads,
+                                    unsigned char* buffer, std::size_t row_stride, bool bottomUp)
+{
+    const unsigned int mcuRows = layout.mcuRows;
+    // The output rows of a band must start on a whole row.
+    if ((layout.mcuHeight * header->scale_num) % header->scale_denom != 0)
+        return false;
+    const unsigned int outputMCUHeight = layout.mcuHeight * header->scale_num / header->scale_denom;
+
+    // A band can only start at an MCU row that is also the start of a
+    // restart interval.
+    auto aligned = [&layout](unsigned int row)
+    {
+        return (static_cast<std::size_t>(row) * layout.mcusPerRow) % layout.restartInterval == 0;
+    };
+    auto segmentIndex = [&layout](unsigned int row)
+    {
+        return static_cast<std::size_t>(row) * layout.mcusPerRow / layout.restartInterval;
+    };
+    numThreads = std::min(numThreads, mcuRows);
+    std::vector<unsigned int> boundaries{0};
+    for (unsigned int b = 1; b < numThreads; ++b)
+    {
+        unsigned int ideal = static_cast<unsigned int>(static_cast<std::size_t>(b) * mcuRows / numThreads);
+        // nearest aligned row after the previous boundary
+        unsigned int below = ideal;
+        while (below > boundaries.back() && !aligned(below))
+            --below;
+        unsigned int above = ideal;
+        while (above < mcuRows && !aligned(above))
+            ++above;
+        unsigned int row = below > boundaries.back() && (above >= mcuRows || ideal - below <= above - ideal) ? below : above;
+        if (row > boundaries.back() && row < mcuRows)
+            boundaries.push_back(row);
+    }
+    if (boundaries.size() < 2)
+        return false;
+    boundaries.push_back(mcuRows);
+
+    std::vector<Band> bands;
+    for (std::size_t i = 0; i + 1 < boundaries.size(); ++i)
+    {
+        Band band{boundaries[i], boundaries[i + 1], 0, mcuRows};
+        if (band.firstRow > 0)
+        {
+            band.decodeStart = band.firstRow - 1;
+            while (!aligned(band.decodeStart))
+                --band.decodeStart;
+        }
+        if (band.endRow < mcuRows)
+        {
+            band.decodeEnd = band.endRow + 1;
+            while (band.decodeEnd < mcuRows && !aligned(band.decodeEnd))
+                ++band.decodeEnd;
+        }
+        bands.push_back(band);
+    }
+
+    // Build a complete JPEG stream for each band: the tables, a SOF
+    // with the band's height, the SOS and the band's entropy-coded
+    // data with its restart markers renumbered from 0.
+    const JDIMENSION outputHeight = header->output_height;
+    std::vector<std::vector<unsigned char>> streams(bands.size());
+    std::vector<std::vector<JSAMPROW>> rows(bands.size());
+    std::vector<std::vector<JSAMPLE>> scratchRows(bands.size(), std::vector<JSAMPLE>(row_stride));
+    std::vector<BandOutput> outputs(bands.size());
+    for (std::size_t i = 0; i < bands.size(); ++i)
+    {
+        const Band& band = bands[i];
+        std::vector<unsigned char>& stream = streams[i];
+        std::size_t firstSegment = segmentIndex(band.decodeStart);
+        std::size_t endSegment = band.decodeEnd < mcuRows ? segmentIndex(band.decodeEnd) : layout.segmentStart.size();
+        std::size_t entropyStart = layout.segmentStart[firstSegment];
+        // Stop before the restart marker of the next band
+        std::size_t entropyEnd = endSegment < layout.segmentStart.size() ? layout.segmentStart[endSegment] - 2 : layout.scanEnd;
+
+        stream.push_back(0xFF);
+        stream.push_back(JPEG_SOI);
+        for (auto& table : layout.tables)
+        {
+            std::size_t offset = stream.size();
+            stream.insert(stream.end(), data + table.first, data + table.first + table.second);
+            if (table.first == layout.sofOffset)
+            {
+                unsigned int bandHeight = band.decodeEnd < mcuRows
+                    ? (band.decodeEnd - band.decodeStart) * layout.mcuHeight
+                    : layout.imageHeight - band.decodeStart * layout.mcuHeight;
+                stream[offset + 5] = static_cast<unsigned char>(bandHeight >> 8);
+                stream[offset + 6] = static_cast<unsigned char>(bandHeight & 0xFF);
+            }
+        }
+        stream.insert(stream.end(), data + layout.sosOffset, data + layout.segmentStart[0]);
+        std::size_t entropyOffset = stream.size();
+        stream.insert(stream.end(), data + entropyStart, data + entropyEnd);
+        for (std::size_t seg = firstSegment + 1; seg < endSegment; ++seg)
+        {
+            std::size_t markerPos = entropyOffset + (layout.segmentStart[seg] - 1 - entropyStart);
+            stream[markerPos] = static_cast<unsigned char>(JPEG_RST0 + ((seg - firstSegment - 1) & 7));
+        }
+        stream.push_back(0xFF);
+        stream.push_back(JPEG_EOI);
+
+        // Output rows; rows outside the band go to a scratch row.
+        JDIMENSION rowOffset = band.decodeStart * outputMCUHeight;
+        JDIMENSION numRows = band.decodeEnd < mcuRows ? (band.decodeEnd - band.decodeStart) * outputMCUHeight
+                                                      : outputHeight - rowOffset;
+        JDIMENSION keepStart = band.firstRow * outputMCUHeight;
+        JDIMENSION keepEnd = band.endRow < mcuRows ? band.endRow * outputMCUHeight : outputHeight;
+        rows[i].resize(numRows);
+        for (JDIMENSION r = 0; r < numRows; ++r)
+        {
+            JDIMENSION y = rowOffset + r;
+            if (y >= keepStart && y < keepEnd)
+            {
+                JDIMENSION outRow = bottomUp ? outputHeight - 1 - y : y;
+                rows[i][r] = buffer + outRow * row_stride;
+            }
+            else
+            {
+                rows[i][r] = scratchRows[i].data();
+            }
+        }
+        outputs[i] = BandOutput{stream.data(), stream.size(), rows[i].data(), numRows};
+    }
+
+    std::vector<char> results(bands.size(), 0);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < bands.size(); ++i)
+    {
+        threads.emplace_back([&, i]() { results[i] = decodeBand(outputs[i], header); });
+    }
+    results[0] = decodeBand(outputs[0], header);
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    return std::all_of(results.begin(), results.end(), [](char result) { return result != 0; });
+}
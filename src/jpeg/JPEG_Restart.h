@@ -0,0 +1,64 @@
+#pragma once
+
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+// Parallel decoding of a single baseline JPEG that has restart
+// markers. The entropy-coded data is split at restart markers that
+// fall on MCU row boundaries, and each band of MCU rows is decoded by
+// its own libjpeg object on its own thread, straight into the output
+// image.
+
+#include "JPEG_Lib.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace vsgsandbox
+{
+    // Where the pieces of a single-scan JPEG are, found by scanning
+    // its markers.
+    struct RestartLayout
+    {
+        // Header segments that the band decoders need (DQT, DHT, DRI,
+        // SOF, APP0, APP14), as offset / length pairs.
+        std::vector<std::pair<std::size_t, std::size_t>> tables;
+        std::size_t sofOffset = 0;      // offset of the SOF segment
+        std::size_t sosOffset = 0;      // offset of the SOS segment
+        std::size_t scanEnd = 0;        // offset of the marker that ends the scan
+        // Start of the entropy-coded data of each restart interval
+        std::vector<std::size_t> segmentStart;
+        unsigned int restartInterval = 0; // in MCUs
+        unsigned int mcusPerRow = 0;
+        unsigned int mcuRows = 0;
+        unsigned int mcuHeight = 0;     // in full resolution pixels
+        unsigned int imageHeight = 0;
+    };
+
+    // Find the restart layout of a baseline or extended sequential
+    // JPEG with a single interleaved scan. Returns false if the image
+    // doesn't have one: no restart interval, progressive, multiple
+    // scans, or a marker count that doesn't match the image size.
+    bool scanRestartMarkers(const unsigned char* data, std::size_t size, RestartLayout& layout);
+
+    // Decode the image described by layout on up to numThreads
+    // threads. header is a libjpeg object that has read the header
+    // and has its decompression parameters set; its output
+    // dimensions must have been calculated. The image is written
+    // into buffer, whose rows are row_stride bytes apart. If
+    // bottomUp, the last row of the image is written first. Returns
+    // false if decoding failed, or if the restart markers don't allow
+    // more than one band.
+    bool decodeRestartBands(const unsigned char* data, const RestartLayout& layout,
+                            j_decompress_ptr header, unsigned int numThreads,
+                            unsigned char* buffer, std::size_t row_stride, bool bottomUp);
+}
@@ -0,0 +1,116 @@
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+#include "JPEG_Backend.h"
+
+#include <climits>
+#include <cstring>
+
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_JPEG
+#define STBI_NO_STDIO
+#define STBI_NO_LINEAR
+#define STBI_NO_HDR
+#include "stb_image.h"
+
+using namespace vsgsandbox;
+
+namespace
+{
+    // stb_image decodes the whole image at full resolution, top row
+    // first, with its own IDCT and chroma upsampling, so its pixels
+    // are close to libjpeg's but not the same. It needs nothing but
+    // the C library.
+    class STBImageBackend : public JPEGDecodeBackend
+    {
+    public:
+        const char* name() const override { return "stb_image"; }
+
+        bool supports(const JPEGBackendParams& params, std::string* message) const override
+        {
+            if (params.scaleDenom != 1)
+            {
+                if (message)
+                    *message = "stb_image can't decode at reduced scale";
+                return false;
+            }
+            if (params.size > static_cast<std::size_t>(INT_MAX))
+            {
+                if (message)
+                    *message = "the file is too large for stb_image";
+                return false;
+            }
+            return true;
+        }
+
+        unsigned char* decode(const JPEGBackendParams& params, std::string* message) const override
+        {
+            int width = 0;
+            int height = 0;
+            int fileComponents = 0;
+            const int components = params.components;
+            stbi_uc* pixels = stbi_load_from_memory(params.data, static_cast<int>(params.size), &width, &height,
+                                                    &fileComponents, components);
+            if (!pixels)
+            {
+                if (message)
+                    *message = "stb_image could not decode the image";
+                return nullptr;
+            }
+            if (static_cast<JDIMENSION>(width) != params.width || static_cast<JDIMENSION>(height) != params.height)
+            {
+                stbi_image_free(pixels);
+                if (message)
+                    *message = "stb_image decoded an image of a different size";
+                return nullptr;
+            }
+            // Copy the pixels into memory that vsg::Data can own,
+            // putting the rows and the components in order on the way
+            const std::size_t rowStride = static_cast<std::size_t>(width) * components;
+            unsigned char* buffer = new unsigned char[rowStride * height];
+            bool bgr = false;
+#ifdef JCS_EXTENSIONS
+            bgr = params.colorSpace == JCS_EXT_BGR;
+#endif
+#ifdef JCS_ALPHA_EXTENSIONS
+            bgr = bgr || params.colorSpace == JCS_EXT_BGRA;
+#endif
+            for (int y = 0; y < height; ++y)
+            {
+                const unsigned char* from = pixels + static_cast<std::size_t>(y) * rowStride;
+                unsigned char* to = buffer + static_cast<std::size_t>(params.topDown ? y : height - 1 - y) * rowStride;
+                if (!bgr)
+                {
+                    std::memcpy(to, from, rowStride);
+                    continue;
+                }
+                for (std::size_t x = 0; x < rowStride; x += components)
+                {
+                    to[x] = from[x + 2];
+                    to[x + 1] = from[x + 1];
+                    to[x + 2] = from[x];
+                    if (components == 4)
+                        to[x + 3] = from[x + 3];
+                }
+            }
+            stbi_image_free(pixels);
+            return buffer;
+        }
+    };
+}
+
+const JPEGDecodeBackend* vsgsandbox::stbImageBackend()
+{
+    static const STBImageBackend backend;
+    return &backend;
+}
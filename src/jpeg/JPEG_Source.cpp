@@ -0,0 +1,576 @@
+/* Source and destination managers for libjpeg, taken from the simage
+ * code in ReaderWriterJPEG.cpp; see that file for the original
+ * authors and their notice.
+ */
+
+#include "JPEG_Source.h"
+
+#include <istream>
+#include <ostream>
+
+namespace vsgsandbox
+{
+
+/* Some versions of jmorecfg.h define boolean, some don't...
+   Those that do also define HAVE_BOOLEAN, so we can guard using that. */
+#ifndef HAVE_BOOLEAN
+  typedef int boolean;
+  #define FALSE 0
+  #define TRUE 1
+#endif
+
+/* CODE FOR READING/WRITING JPEG FROM STREAMS
+ *  This code was taken directly from jdatasrc.c and jdatadst.c (libjpeg source)
+ *  and modified to use a std::istream/ostream* instead of a FILE*
+ */
+
+/* Expanded data source object for stdio input */
+
+typedef struct {
+    struct jpeg_source_mgr pub;    /* public fields */
+    std::istream * infile;        /* source stream */
+    JOCTET * buffer;              /* start of buffer */
+    boolean start_of_file;        /* have we gotten any data yet? */
+} stream_source_mgr;
+
+typedef stream_source_mgr * stream_src_ptr;
+
+/* The stream source is only used for pipes and other non-mappable
+ * input, so use large reads to keep the number of istream calls down.
+ */
+#define INPUT_BUF_SIZE  (64 * 1024)
+
+/*
+ * Initialize source --- called by jpeg_read_header
+ * before any data is actually read.
+ */
+
+static void init_source (j_decompress_ptr cinfo)
+{
+  stream_src_ptr src = (stream_src_ptr) cinfo->src;
+
+  /* We reset the empty-input-file flag for each image,
+   * but we don't clear the input buffer.
+   * This is correct behavior for reading a series of images from one source.
+   */
+  src->start_of_file = TRUE;
+}
+
+
+/*
+ * Fill the input buffer --- called whenever buffer is emptied.
+ *
+ * In typical applications, this should read fresh data into the buffer
+ * (ignoring the current state of next_input_byte & bytes_in_buffer),
+ * reset the pointer & count to the start of the buffer, and return TRUE
+ * indicating that the buffer has been reloaded.  It is not necessary to
+ * fill the buffer entirely, only to obtain at least one more byte.
+ *
+ * There is no such thing as an EOF return.  If the end of the file has been
+ * reached, the routine has a choice of ERREXIT() or inserting fake data into
+ * the buffer.  In most cases, generating a warning message and inserting a
+ * fake EOI marker is the best course of action --- this will allow the
+ * decompressor to output however much of the image is there.  However,
+ * the resulting error message is misleading if the real problem is an empty
+ * input file, so we handle that case specially.
+ *
+ * In applications that need to be able to suspend compression due to input
+ * not being available yet, a FALSE return indicates that no more data can be
+ * obtained right now, but more may be forthcoming later.  In this situation,
+ * the decompressor will return to its caller (with an indication of the
+ * number of scanlines it has read, if any).  The application should resume
+ * decompression after it has loaded more data into the input buffer.  Note
+ * that there are substantial restrictions on the use of suspension --- see
+ * the documentation.
+ *
+ * When suspending, the decompressor will back up to a convenient restart point
+ * (typically the start of the current MCU). next_input_byte & bytes_in_buffer
+ * indicate where the restart point will be if the current call returns FALSE.
+ * Data beyond this point must be rescanned after resumption, so move it to
+ * the front of the buffer rather than discarding it.
+ */
+
+static boolean fill_input_buffer (j_decompress_ptr cinfo)
+{
+  stream_src_ptr src = (stream_src_ptr) cinfo->src;
+  size_t nbytes;
+
+  src->infile->read((char*)src->buffer,INPUT_BUF_SIZE);
+  nbytes = src->infile->gcount();
+
+  if (nbytes <= 0) {
+    if (src->start_of_file)    /* Treat empty input file as fatal error */
+      ERREXIT(cinfo, JERR_INPUT_EMPTY);
+    WARNMS(cinfo, JWRN_JPEG_EOF);
+    /* Insert a fake EOI marker */
+    src->buffer[0] = (JOCTET) 0xFF;
+    src->buffer[1] = (JOCTET) JPEG_EOI;
+    nbytes = 2;
+  }
+
+  src->pub.next_input_byte = src->buffer;
+  src->pub.bytes_in_buffer = nbytes;
+  src->start_of_file = FALSE;
+
+  return TRUE;
+}
+
+
+/*
+ * Skip data --- used to skip over a potentially large amount of
+ * uninteresting data (such as an APPn marker).
+ *
+ * Writers of suspendable-input applications must note that skip_input_data
+ * is not granted the right to give a suspension return.  If the skip extends
+ * beyond the data currently in the buffer, the buffer can be marked empty so
+ * that the next read will cause a fill_input_buffer call that can suspend.
+ * Arranging for additional bytes to be discarded before reloading the input
+ * buffer is the application writer's problem.
+ */
+
+static void skip_input_data (j_decompress_ptr cinfo, long num_bytes)
+{
+  stream_src_ptr src = (stream_src_ptr) cinfo->src;
+
+  /* Skip what is left in the buffer, then let the stream discard the
+   * rest directly instead of refilling the buffer over and over.
+   * istream::ignore() works on pipes, unlike seekg().
+   */
+  if (num_bytes > 0) {
+    if (num_bytes > (long) src->pub.bytes_in_buffer) {
+      num_bytes -= (long) src->pub.bytes_in_buffer;
+      src->pub.bytes_in_buffer = 0;
+      src->infile->ignore(num_bytes);
+      /* The next read will call fill_input_buffer. */
+      return;
+    }
+    src->pub.next_input_byte += (size_t) num_bytes;
+    src->pub.bytes_in_buffer -= (size_t) num_bytes;
+  }
+}
+
+
+/*
+ * An additional method that can be provided by data source modules is the
+ * resync_to_restart method for error recovery in the presence of RST markers.
+ * For the moment, this source module just uses the default resync method
+ * provided by the JPEG library.  That method assumes that no backtracking
+ * is possible.
+ */
+
+
+/*
+ * Terminate source --- called by jpeg_finish_decompress
+ * after all data has been read.  Often a no-op.
+ *
+ * NB: *not* called by jpeg_abort or jpeg_destroy; surrounding
+ * application must deal with any cleanup that should happen even
+ * for error exit.
+ */
+static void term_source (j_decompress_ptr /*cinfo*/)
+{
+  /* no work necessary here */
+}
+
+void jpeg_istream_src(j_decompress_ptr cinfo, std::istream *infile)
+{
+    stream_src_ptr src;
+
+    /* The source object and input buffer are made permanent so that a series
+     * of JPEG images can be read from the same file by calling jpeg_stdio_src
+     * only before the first one.  (If we discarded the buffer at the end of
+     * one image, we'd likely lose the start of the next one.)
+     * This makes it unsafe to use this manager and a different source
+     * manager serially with the same JPEG object.  Caveat programmer.
+     */
+    if (cinfo->src == NULL) {    /* first time for this JPEG object? */
+        cinfo->src = (struct jpeg_source_mgr *)
+            (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT,sizeof(stream_source_mgr));
+        src = (stream_src_ptr) cinfo->src;
+        src->buffer = (JOCTET *)
+            (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT,INPUT_BUF_SIZE * sizeof(JOCTET));
+    }
+
+    src = (stream_src_ptr) cinfo->src;
+    src->pub.init_source = init_source;
+    src->pub.fill_input_buffer = fill_input_buffer;
+    src->pub.skip_input_data = skip_input_data;
+    src->pub.resync_to_restart = jpeg_resync_to_restart; /* use default method */
+    src->pub.term_source = term_source;
+    src->infile = infile;
+    src->pub.bytes_in_buffer = 0; /* forces fill_input_buffer on first read */
+    src->pub.next_input_byte = NULL; /* until buffer loaded */
+}
+
+/* Data source object for a block of memory, e.g. a memory-mapped
+ * file. The whole block is handed to libjpeg as one buffer, so there
+ * are no copies and skips are just pointer moves.
+ */
+
+typedef struct {
+    struct jpeg_source_mgr pub;    /* public fields */
+    const JOCTET * data;          /* start of the block */
+    size_t size;                  /* and its length */
+} memory_source_mgr;
+
+typedef memory_source_mgr * memory_src_ptr;
+
+static const JOCTET fake_eoi[2] = { (JOCTET) 0xFF, (JOCTET) JPEG_EOI };
+
+static void init_memory_source (j_decompress_ptr cinfo)
+{
+  memory_src_ptr src = (memory_src_ptr) cinfo->src;
+
+  src->pub.next_input_byte = src->data;
+  src->pub.bytes_in_buffer = src->size;
+}
+
+/*
+ * The only way to get here is to run off the end of the block, so the
+ * data is truncated. As with the stream source, insert a fake EOI
+ * marker so that whatever there is of the image is output.
+ */
+
+static boolean fill_memory_input_buffer (j_decompress_ptr cinfo)
+{
+  memory_src_ptr src = (memory_src_ptr) cinfo->src;
+
+  WARNMS(cinfo, JWRN_JPEG_EOF);
+  src->pub.next_input_byte = fake_eoi;
+  src->pub.bytes_in_buffer = 2;
+
+  return TRUE;
+}
+
+static void skip_memory_input_data (j_decompress_ptr cinfo, long num_bytes)
+{
+  memory_src_ptr src = (memory_src_ptr) cinfo->src;
+
+  if (num_bytes > 0) {
+    if (num_bytes > (long) src->pub.bytes_in_buffer) {
+      /* Skipping past the end; the next read will hit the fake EOI. */
+      src->pub.next_input_byte += src->pub.bytes_in_buffer;
+      src->pub.bytes_in_buffer = 0;
+      return;
+    }
+    src->pub.next_input_byte += (size_t) num_bytes;
+    src->pub.bytes_in_buffer -= (size_t) num_bytes;
+  }
+}
+
+void jpeg_memory_src(j_decompress_ptr cinfo, const unsigned char* data, size_t size)
+{
+    memory_src_ptr src;
+
+    if (cinfo->src == NULL) {    /* first time for this JPEG object? */
+        cinfo->src = (struct jpeg_source_mgr *)
+            (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT,sizeof(memory_source_mgr));
+    }
+
+    src = (memory_src_ptr) cinfo->src;
+    src->pub.init_source = init_memory_source;
+    src->pub.fill_input_buffer = fill_memory_input_buffer;
+    src->pub.skip_input_data = skip_memory_input_data;
+    src->pub.resync_to_restart = jpeg_resync_to_restart; /* use default method */
+    src->pub.term_source = term_source;
+    src->data = data;
+    src->size = size;
+    src->pub.bytes_in_buffer = size;
+    src->pub.next_input_byte = data;
+}
+
+/* Data source object for input that arrives in pieces. The bytes from
+ * libjpeg's restart point on are kept in the SuspendingInput's buffer,
+ * and new data is appended to them; fill_input_buffer returns FALSE
+ * when there are no more, which makes the decoder suspend, as
+ * described above fill_input_buffer().
+ */
+
+typedef struct {
+    struct jpeg_source_mgr pub;    /* public fields */
+    SuspendingInput * input;      /* the data and its state */
+} suspending_source_mgr;
+
+typedef suspending_source_mgr * suspending_src_ptr;
+
+static void init_suspending_source (j_decompress_ptr /*cinfo*/)
+{
+  /* The buffer already holds whatever has been appended */
+}
+
+static boolean fill_suspending_input_buffer (j_decompress_ptr cinfo)
+{
+  suspending_src_ptr src = (suspending_src_ptr) cinfo->src;
+
+  if (!src->input->finished)
+    return FALSE;              /* suspend until more data is appended */
+
+  if (src->input->received == 0)  /* Treat empty input file as fatal error */
+    ERREXIT(cinfo, JERR_INPUT_EMPTY);
+  WARNMS(cinfo, JWRN_JPEG_EOF);
+  /* Insert a fake EOI marker */
+  src->pub.next_input_byte = fake_eoi;
+  src->pub.bytes_in_buffer = 2;
+
+  return TRUE;
+}
+
+/*
+ * skip_input_data can't suspend, so a skip past the end of the buffer
+ * is finished by jpeg_suspending_append() as the data arrives.
+ */
+
+static void skip_suspending_input_data (j_decompress_ptr cinfo, long num_bytes)
+{
+  suspending_src_ptr src = (suspending_src_ptr) cinfo->src;
+
+  if (num_bytes > 0) {
+    if (num_bytes > (long) src->pub.bytes_in_buffer) {
+      src->input->skip += (size_t) num_bytes - src->pub.bytes_in_buffer;
+      src->pub.next_input_byte += src->pub.bytes_in_buffer;
+      src->pub.bytes_in_buffer = 0;
+      return;
+    }
+    src->pub.next_input_byte += (size_t) num_bytes;
+    src->pub.bytes_in_buffer -= (size_t) num_bytes;
+  }
+}
+
+void jpeg_suspending_src(j_decompress_ptr cinfo, SuspendingInput* input)
+{
+    suspending_src_ptr src;
+
+    if (cinfo->src == NULL) {    /* first time for this JPEG object? */
+        cinfo->src = (struct jpeg_source_mgr *)
+            (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT,sizeof(suspending_source_mgr));
+    }
+
+    src = (suspending_src_ptr) cinfo->src;
+    src->pub.init_source = init_suspending_source;
+    src->pub.fill_input_buffer = fill_suspending_input_buffer;
+    src->pub.skip_input_data = skip_suspending_input_data;
+    src->pub.resync_to_restart = jpeg_resync_to_restart; /* use default method */
+    src->pub.term_source = term_source;
+    src->input = input;
+    src->pub.next_input_byte = input->buffer.data();
+    src->pub.bytes_in_buffer = input->buffer.size();
+}
+
+void jpeg_suspending_append(j_decompress_ptr cinfo, const unsigned char* data, size_t size)
+{
+    suspending_src_ptr src = (suspending_src_ptr) cinfo->src;
+    SuspendingInput* input = src->input;
+    std::vector<unsigned char>& buffer = input->buffer;
+
+    input->received += size;
+    /* The unused bytes always run to the end of the buffer; drop the
+     * ones before them, which libjpeg won't read again.
+     */
+    buffer.erase(buffer.begin(), buffer.end() - src->pub.bytes_in_buffer);
+    if (input->skip > 0) {
+        size_t skipped = input->skip < size ? input->skip : size;
+        data += skipped;
+        size -= skipped;
+        input->skip -= skipped;
+    }
+    buffer.insert(buffer.end(), data, data + size);
+    src->pub.next_input_byte = buffer.data();
+    src->pub.bytes_in_buffer = buffer.size();
+}
+
+/* Expanded data destination object for stdio output */
+
+typedef struct {
+  struct jpeg_destination_mgr pub; /* public fields */
+
+  std::ostream * outfile;    /* target stream */
+  JOCTET * buffer;          /* start of buffer */
+} stream_destination_mgr;
+
+typedef stream_destination_mgr * stream_dest_ptr;
+
+/* Large blocks, so that a big image isn't written to the stream in
+ * thousands of small pieces.
+ */
+#define OUTPUT_BUF_SIZE  (64 * 1024)
+
+
+/*
+ * Initialize destination --- called by jpeg_start_compress
+ * before any data is actually written.
+ */
+
+static void init_destination (j_compress_ptr cinfo)
+{
+  stream_dest_ptr dest = (stream_dest_ptr) cinfo->dest;
+
+  /* Allocate the output buffer --- it will be released when done with image */
+  dest->buffer = (JOCTET *)
+      (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE, OUTPUT_BUF_SIZE * sizeof(JOCTET));
+
+  dest->pub.next_output_byte = dest->buffer;
+  dest->pub.free_in_buffer = OUTPUT_BUF_SIZE;
+}
+
+
+/*
+ * Empty the output buffer --- called whenever buffer fills up.
+ *
+ * In typical applications, this should write the entire output buffer
+ * (ignoring the current state of next_output_byte & free_in_buffer),
+ * reset the pointer & count to the start of the buffer, and return TRUE
+ * indicating that the buffer has been dumped.
+ *
+ * In applications that need to be able to suspend compression due to output
+ * overrun, a FALSE return indicates that the buffer cannot be emptied now.
+ * In this situation, the compressor will return to its caller (possibly with
+ * an indication that it has not accepted all the supplied scanlines).  The
+ * application should resume compression after it has made more room in the
+ * output buffer.  Note that there are substantial restrictions on the use of
+ * suspension --- see the documentation.
+ *
+ * When suspending, the compressor will back up to a convenient restart point
+ * (typically the start of the current MCU). next_output_byte & free_in_buffer
+ * indicate where the restart point will be if the current call returns FALSE.
+ * Data beyond this point will be regenerated after resumption, so do not
+ * write it out when emptying the buffer externally.
+ */
+
+static boolean empty_output_buffer (j_compress_ptr cinfo)
+{
+  stream_dest_ptr dest = (stream_dest_ptr) cinfo->dest;
+
+  dest->outfile->write((const char*)dest->buffer,OUTPUT_BUF_SIZE);
+  if (dest->outfile->bad())
+    ERREXIT(cinfo, JERR_FILE_WRITE);
+
+  dest->pub.next_output_byte = dest->buffer;
+  dest->pub.free_in_buffer = OUTPUT_BUF_SIZE;
+
+  return TRUE;
+}
+
+
+/*
+ * Terminate destination --- called by jpeg_finish_compress
+ * after all data has been written.  Usually needs to flush buffer.
+ *
+ * NB: *not* called by jpeg_abort or jpeg_destroy; surrounding
+ * application must deal with any cleanup that should happen even
+ * for error exit.
+ */
+
+static void term_destination (j_compress_ptr cinfo)
+{
+  stream_dest_ptr dest = (stream_dest_ptr) cinfo->dest;
+  size_t datacount = OUTPUT_BUF_SIZE - dest->pub.free_in_buffer;
+
+  /* Write any data remaining in the buffer */
+  if (datacount > 0) {
+    dest->outfile->write((const char*)dest->buffer,datacount);
+    if (dest->outfile->bad())
+      ERREXIT(cinfo, JERR_FILE_WRITE);
+  }
+  dest->outfile->flush();
+  /* Make sure we wrote the output file OK */
+  if (dest->outfile->bad())
+    ERREXIT(cinfo, JERR_FILE_WRITE);
+}
+
+
+/*
+ * Prepare for output to a stdio stream.
+ * The caller must have already opened the stream, and is responsible
+ * for closing it after finishing compression.
+ */
+
+void jpeg_stream_dest (j_compress_ptr cinfo, std::ostream * outfile)
+{
+    stream_dest_ptr dest;
+
+    /* The destination object is made permanent so that multiple JPEG images
+     * can be written to the same file without re-executing jpeg_stdio_dest.
+     * This makes it dangerous to use this manager and a different destination
+     * manager serially with the same JPEG object, because their private object
+     * sizes may be different.  Caveat programmer.
+     */
+    if (cinfo->dest == NULL) {    /* first time for this JPEG object? */
+        cinfo->dest = (struct jpeg_destination_mgr *)
+            (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT, sizeof(stream_destination_mgr));
+    }
+
+    dest = (stream_dest_ptr) cinfo->dest;
+    dest->pub.init_destination = init_destination;
+    dest->pub.empty_output_buffer = empty_output_buffer;
+    dest->pub.term_destination = term_destination;
+    dest->outfile = outfile;
+}
+
+/* Expanded data destination object for output to a std::vector. The
+ * compressor writes straight into the vector's storage, which is
+ * doubled in size whenever it fills up and trimmed to the data written
+ * at the end.
+ */
+
+typedef struct {
+    struct jpeg_destination_mgr pub; /* public fields */
+    std::vector<unsigned char> * outvec; /* target vector */
+} vector_destination_mgr;
+
+typedef vector_destination_mgr * vector_dest_ptr;
+
+#define VECTOR_INITIAL_SIZE  (64 * 1024)
+
+static void init_vector_destination (j_compress_ptr cinfo)
+{
+  vector_dest_ptr dest = (vector_dest_ptr) cinfo->dest;
+
+  if (dest->outvec->size() < VECTOR_INITIAL_SIZE)
+    dest->outvec->resize(VECTOR_INITIAL_SIZE);
+  dest->pub.next_output_byte = dest->outvec->data();
+  dest->pub.free_in_buffer = dest->outvec->size();
+}
+
+static boolean empty_vector_output_buffer (j_compress_ptr cinfo)
+{
+  vector_dest_ptr dest = (vector_dest_ptr) cinfo->dest;
+  size_t used = dest->outvec->size();
+
+  /* Called only when the buffer is full */
+  dest->outvec->resize(used * 2);
+  dest->pub.next_output_byte = dest->outvec->data() + used;
+  dest->pub.free_in_buffer = dest->outvec->size() - used;
+
+  return TRUE;
+}
+
+static void term_vector_destination (j_compress_ptr cinfo)
+{
+  vector_dest_ptr dest = (vector_dest_ptr) cinfo->dest;
+
+  dest->outvec->resize(dest->outvec->size() - dest->pub.free_in_buffer);
+}
+
+void jpeg_vector_dest (j_compress_ptr cinfo, std::vector<unsigned char> * outvec)
+{
+    vector_dest_ptr dest;
+
+    /* Same caveat as for jpeg_stream_dest: the object is permanent, so
+     * don't mix the two managers on one JPEG object.
+     */
+    if (cinfo->dest == NULL) {
+        cinfo->dest = (struct jpeg_destination_mgr *)
+            (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT, sizeof(vector_destination_mgr));
+    }
+
+    dest = (vector_dest_ptr) cinfo->dest;
+    dest->pub.init_destination = init_vector_destination;
+    dest->pub.empty_output_buffer = empty_vector_output_buffer;
+    dest->pub.term_destination = term_vector_destination;
+    dest->outvec = outvec;
+    outvec->clear();
+}
+
+/* END OF READ/WRITE STREAM CODE */
+
+} // namespace vsgsandbox
@@ -0,0 +1,56 @@
+#pragma once
+
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+// libjpeg source and destination managers used by the jpeg module.
+
+#include "JPEG_Lib.h"
+
+#include <cstddef>
+#include <iosfwd>
+#include <vector>
+
+namespace vsgsandbox
+{
+    // Read from a stream, in large blocks.
+    void jpeg_istream_src(j_decompress_ptr cinfo, std::istream* infile);
+    // Read from a block of memory, e.g. a memory-mapped file. The
+    // block is used in place and must outlive the decode.
+    void jpeg_memory_src(j_decompress_ptr cinfo, const unsigned char* data, std::size_t size);
+
+    // The input of a decoder whose data arrives in pieces. buffer
+    // holds the bytes that libjpeg hasn't used yet.
+    struct SuspendingInput
+    {
+        std::vector<unsigned char> buffer;
+        // Bytes that skip_input_data() still has to discard
+        std::size_t skip = 0;
+        // Bytes appended in all
+        std::size_t received = 0;
+        // Set when no more data will come
+        bool finished = false;
+    };
+    // Read from input, suspending the decoder when it runs out of
+    // data instead of blocking. The libjpeg calls then return early,
+    // and are called again after jpeg_suspending_append(). Once
+    // input->finished is set, running out of data is treated as the
+    // end of the file.
+    void jpeg_suspending_src(j_decompress_ptr cinfo, SuspendingInput* input);
+    // Add data to the input of a suspending source.
+    void jpeg_suspending_append(j_decompress_ptr cinfo, const unsigned char* data, std::size_t size);
+    // Write to a stream.
+    void jpeg_stream_dest(j_compress_ptr cinfo, std::ostream* outfile);
+    // Write to a vector, which is resized to hold exactly the
+    // compressed data.
+    void jpeg_vector_dest(j_compress_ptr cinfo, std::vector<unsigned char>* outvec);
+}
@@ -0,0 +1,375 @@
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+#include "JPEG_Transform.h"
+#include "EXIF_Orientation.h"
+#include "JPEG_Error.h"
+#include "JPEG_Source.h"
+
+#include <vsgsandbox/Debug.h>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace vsgsandbox;
+
+namespace
+{
+    JDIMENSION divRoundUp(JDIMENSION a, JDIMENSION b)
+    {
+        return (a + b - 1) / b;
+    }
+
+    // The number of blocks of a component in one direction of a
+    // coefficient array that covers size pixels, padded to whole
+    // iMCUs. The compressor reads the array a whole iMCU row of
+    // samp rows at a time.
+    JDIMENSION arrayBlocks(JDIMENSION size, int mcuSize, int samp, int maxSamp)
+    {
+        JDIMENSION blocks = divRoundUp(size, mcuSize) * mcuSize * samp / (maxSamp * DCTSIZE);
+        return divRoundUp(blocks, samp) * samp;
+    }
+
+    // Where each coefficient of a transformed block comes from: the
+    // natural order index of the source coefficient, and its sign.
+    // Mirroring a block negates the coefficients of the odd
+    // frequencies in that direction; transposing it transposes the
+    // coefficients.
+    struct CoefMap
+    {
+        int index[DCTSIZE2];
+        JCOEF sign[DCTSIZE2];
+    };
+
+    void makeCoefMap(const OrientationTransform& transform, CoefMap& map)
+    {
+        for (int v = 0; v < DCTSIZE; ++v)
+        {
+            for (int u = 0; u < DCTSIZE; ++u)
+            {
+                int k = v * DCTSIZE + u;
+                map.index[k] = transform.transpose ? u * DCTSIZE + v : k;
+                bool negate = (transform.flipX && (u & 1)) != (transform.flipY && (v & 1));
+                map.sign[k] = negate ? -1 : 1;
+            }
+        }
+    }
+
+    // The size of an iMCU, the unit that can be moved about
+    // losslessly. A single component image is coded one block at a
+    // time, whatever its sampling factors say.
+    void iMCUSize(j_decompress_ptr cinfo, int* width, int* height)
+    {
+        if (cinfo->num_components == 1)
+        {
+            *width = *height = DCTSIZE;
+        }
+        else
+        {
+            *width = cinfo->max_h_samp_factor * DCTSIZE;
+            *height = cinfo->max_v_samp_factor * DCTSIZE;
+        }
+    }
+
+    // The size of the transformed image. A partial iMCU at the right
+    // or bottom of the source can't be mirrored to the other side,
+    // so it is dropped in any direction that is mirrored.
+    void transformedSize(j_decompress_ptr cinfo, const OrientationTransform& transform,
+                         JDIMENSION* width, JDIMENSION* height)
+    {
+        int mcuWidth, mcuHeight;
+        iMCUSize(cinfo, &mcuWidth, &mcuHeight);
+        bool mirrorX = transform.transpose ? transform.flipY : transform.flipX;
+        bool mirrorY = transform.transpose ? transform.flipX : transform.flipY;
+        JDIMENSION w = cinfo->image_width;
+        JDIMENSION h = cinfo->image_height;
+        if (mirrorX)
+            w -= w % mcuWidth;
+        if (mirrorY)
+            h -= h % mcuHeight;
+        *width = transform.transpose ? h : w;
+        *height = transform.transpose ? w : h;
+    }
+
+    // Fill the destination coefficient arrays, which cover
+    // dstWidth x dstHeight pixels, from the source arrays.
+    void transformBlocks(j_decompress_ptr srcinfo, jvirt_barray_ptr* src_coefs, jvirt_barray_ptr* dst_coefs,
+                         const OrientationTransform& transform, JDIMENSION dstWidth, JDIMENSION dstHeight)
+    {
+        CoefMap map;
+        makeCoefMap(transform, map);
+        int mcuWidth, mcuHeight;
+        iMCUSize(srcinfo, &mcuWidth, &mcuHeight);
+        int maxH = transform.transpose ? srcinfo->max_v_samp_factor : srcinfo->max_h_samp_factor;
+        int maxV = transform.transpose ? srcinfo->max_h_samp_factor : srcinfo->max_v_samp_factor;
+        if (transform.transpose)
+            std::swap(mcuWidth, mcuHeight);
+        for (int ci = 0; ci < srcinfo->num_components; ++ci)
+        {
+            jpeg_component_info* comp = &srcinfo->comp_info[ci];
+            int h = transform.transpose ? comp->v_samp_factor : comp->h_samp_factor;
+            int v = transform.transpose ? comp->h_samp_factor : comp->v_samp_factor;
+            // Blocks covering the image, which are whole iMCUs in the
+            // mirrored directions
+            JDIMENSION imageBlocksX = divRoundUp(dstWidth * h, maxH * DCTSIZE);
+            JDIMENSION imageBlocksY = divRoundUp(dstHeight * v, maxV * DCTSIZE);
+            // Blocks in the destination array, padded to whole iMCUs
+            JDIMENSION arrayBlocksX = arrayBlocks(dstWidth, mcuWidth, h, maxH);
+            JDIMENSION arrayBlocksY = arrayBlocks(dstHeight, mcuHeight, v, maxV);
+            // The source blocks that have been decoded
+            JDIMENSION srcBlocksX = comp->width_in_blocks;
+            JDIMENSION srcBlocksY = comp->height_in_blocks;
+            for (JDIMENSION by = 0; by < arrayBlocksY; ++by)
+            {
+                JBLOCKROW dstRow = (*srcinfo->mem->access_virt_barray)((j_common_ptr)srcinfo, dst_coefs[ci],
+                                                                       by, 1, TRUE)[0];
+                JDIMENSION y = transform.flipY ? imageBlocksY - 1 - by : by;
+                JBLOCKROW srcRow = NULL;
+                if (!transform.transpose && y < srcBlocksY)
+                {
+                    srcRow = (*srcinfo->mem->access_virt_barray)((j_common_ptr)srcinfo, src_coefs[ci],
+                                                                 y, 1, FALSE)[0];
+                }
+                for (JDIMENSION bx = 0; bx < arrayBlocksX; ++bx)
+                {
+                    JCOEF* dst = dstRow[bx];
+                    JDIMENSION x = transform.flipX ? imageBlocksX - 1 - bx : bx;
+                    /* Padding outside the image is left empty */
+                    if ((transform.flipY && by >= imageBlocksY) || (transform.flipX && bx >= imageBlocksX)
+                        || (transform.transpose ? (y >= srcBlocksX || x >= srcBlocksY) : (!srcRow || x >= srcBlocksX)))
+                    {
+                        memset(dst, 0, sizeof(JBLOCK));
+                        continue;
+                    }
+                    if (transform.transpose)
+                    {
+                        const JCOEF* src = (*srcinfo->mem->access_virt_barray)((j_common_ptr)srcinfo, src_coefs[ci],
+                                                                               x, 1, FALSE)[0][y];
+                        for (int k = 0; k < DCTSIZE2; ++k)
+                            dst[k] = map.sign[k] * src[map.index[k]];
+                    }
+                    else
+                    {
+                        const JCOEF* src = srcRow[x];
+                        for (int k = 0; k < DCTSIZE2; ++k)
+                            dst[k] = map.sign[k] * src[k];
+                    }
+                }
+            }
+        }
+    }
+
+    // Copy the saved markers to the output, apart from the ones that
+    // the compressor writes itself, and reset the EXIF orientation.
+    void copyMarkers(j_decompress_ptr srcinfo, j_compress_ptr dstinfo)
+    {
+        for (jpeg_saved_marker_ptr marker = srcinfo->marker_list; marker; marker = marker->next)
+        {
+            if (dstinfo->write_JFIF_header && marker->marker == JPEG_APP0
+                && marker->data_length >= 5 && memcmp(marker->data, "JFIF", 5) == 0)
+                continue;
+            if (dstinfo->write_Adobe_marker && marker->marker == JPEG_APP0 + 14
+                && marker->data_length >= 5 && memcmp(marker->data, "Adobe", 5) == 0)
+                continue;
+            if (marker->marker == EXIF_JPEG_MARKER
+                && marker->data_length >= 6 && memcmp(marker->data, "Exif\0\0", 6) == 0)
+                EXIF_SetOrientation(marker->data, marker->data_length, 1);
+            jpeg_write_marker(dstinfo, marker->marker, marker->data, marker->data_length);
+        }
+    }
+
+    /* All of the libjpeg work, kept in a function with no C++ objects
+     * in its frame so that an error can longjmp back to it.
+     */
+    OrientResult transformJPEG(const unsigned char* data, std::size_t size,
+                               std::vector<unsigned char>* out, bool keepProgressive, char* message)
+    {
+        struct jpeg_decompress_struct srcinfo;
+        struct jpeg_compress_struct dstinfo;
+        struct my_error_mgr jerr;
+        jvirt_barray_ptr dst_coefs[MAX_COMPONENTS];
+
+        /* jpeg_destroy does nothing to an object that was never created */
+        memset(&srcinfo, 0, sizeof(srcinfo));
+        memset(&dstinfo, 0, sizeof(dstinfo));
+        srcinfo.err = my_std_error(jerr);
+        dstinfo.err = &jerr.pub;
+        if (setjmp(jerr.setjmp_buffer))
+        {
+            strcpy(message, jerr.message);
+            jpeg_destroy_compress(&dstinfo);
+            jpeg_destroy_decompress(&srcinfo);
+            return OrientResult::Failed;
+        }
+        jpeg_create_decompress(&srcinfo);
+        jpeg_create_compress(&dstinfo);
+        jpeg_memory_src(&srcinfo, data, size);
+        jpeg_save_markers(&srcinfo, JPEG_COM, 0xffff);
+        for (int m = 0; m < 16; ++m)
+            jpeg_save_markers(&srcinfo, JPEG_APP0 + m, 0xffff);
+        (void) jpeg_read_header(&srcinfo, TRUE);
+
+        int orientation = EXIF_Orientation(&srcinfo);
+        if (orientation <= 1)
+        {
+            jpeg_destroy_compress(&dstinfo);
+            jpeg_destroy_decompress(&srcinfo);
+            return OrientResult::AlreadyNormal;
+        }
+        OrientationTransform transform = orientationTransform(orientation);
+        JDIMENSION dstWidth, dstHeight;
+        transformedSize(&srcinfo, transform, &dstWidth, &dstHeight);
+        if (dstWidth == 0 || dstHeight == 0)
+        {
+            strcpy(message, "Image is too small to transform");
+            jpeg_destroy_compress(&dstinfo);
+            jpeg_destroy_decompress(&srcinfo);
+            return OrientResult::Failed;
+        }
+
+        /* The destination arrays must be requested before
+         * jpeg_read_coefficients(), which realizes all the arrays.
+         */
+        int mcuWidth, mcuHeight;
+        iMCUSize(&srcinfo, &mcuWidth, &mcuHeight);
+        if (transform.transpose)
+            std::swap(mcuWidth, mcuHeight);
+        int maxH = transform.transpose ? srcinfo.max_v_samp_factor : srcinfo.max_h_samp_factor;
+        int maxV = transform.transpose ? srcinfo.max_h_samp_factor : srcinfo.max_v_samp_factor;
+        for (int ci = 0; ci < srcinfo.num_components; ++ci)
+        {
+            jpeg_component_info* comp = &srcinfo.comp_info[ci];
+            int h = transform.transpose ? comp->v_samp_factor : comp->h_samp_factor;
+            int v = transform.transpose ? comp->h_samp_factor : comp->v_samp_factor;
+            dst_coefs[ci] = (*srcinfo.mem->request_virt_barray)
+                ((j_common_ptr)&srcinfo, JPOOL_IMAGE, FALSE,
+                 arrayBlocks(dstWidth, mcuWidth, h, maxH),
+                 arrayBlocks(dstHeight, mcuHeight, v, maxV),
+                 v);
+        }
+        jvirt_barray_ptr* src_coefs = jpeg_read_coefficients(&srcinfo);
+
+        jpeg_vector_dest(&dstinfo, out);
+        jpeg_copy_critical_parameters(&srcinfo, &dstinfo);
+        dstinfo.image_width = dstWidth;
+        dstinfo.image_height = dstHeight;
+        if (transform.transpose)
+        {
+            for (int ci = 0; ci < dstinfo.num_components; ++ci)
+            {
+                jpeg_component_info* comp = &dstinfo.comp_info[ci];
+                std::swap(comp->h_samp_factor, comp->v_samp_factor);
+            }
+            /* The quantization tables are in natural order, so they
+             * are transposed along with the coefficients.
+             */
+            for (int ti = 0; ti < NUM_QUANT_TBLS; ++ti)
+            {
+                JQUANT_TBL* qtbl = dstinfo.quant_tbl_ptrs[ti];
+                if (!qtbl)
+                    continue;
+                for (int v = 0; v < DCTSIZE; ++v)
+                    for (int u = v + 1; u < DCTSIZE; ++u)
+                        std::swap(qtbl->quantval[v * DCTSIZE + u], qtbl->quantval[u * DCTSIZE + v]);
+            }
+        }
+        if (srcinfo.progressive_mode && keepProgressive)
+            jpeg_simple_progression(&dstinfo);
+        /* Keep a restart marker on every MCU row, so that a large image
+         * can still be decoded in parallel bands.
+         */
+        else if (srcinfo.restart_interval > 0)
+            dstinfo.restart_in_rows = 1;
+
+        transformBlocks(&srcinfo, src_coefs, dst_coefs, transform, dstWidth, dstHeight);
+
+        jpeg_write_coefficients(&dstinfo, dst_coefs);
+        copyMarkers(&srcinfo, &dstinfo);
+        jpeg_finish_compress(&dstinfo);
+        jpeg_destroy_compress(&dstinfo);
+        /* The destination arrays belong to srcinfo, so it goes last */
+        (void) jpeg_finish_decompress(&srcinfo);
+        jpeg_destroy_decompress(&srcinfo);
+        return OrientResult::Transformed;
+    }
+}
+
+OrientationTransform vsgsandbox::orientationTransform(int orientation)
+{
+    OrientationTransform result;
+    switch (orientation)
+    {
+    case 2:                     // TopRight: mirror horizontally
+        result.flipX = true;
+        break;
+    case 3:                     // BottomRight: rotate 180
+        result.flipX = result.flipY = true;
+        break;
+    case 4:                     // BottomLeft: mirror vertically
+        result.flipY = true;
+        break;
+    case 5:                     // LeftTop: transpose
+        result.transpose = true;
+        break;
+    case 6:                     // RightTop: rotate 90 clockwise
+        result.transpose = result.flipX = true;
+        break;
+    case 7:                     // RightBottom: transverse
+        result.transpose = result.flipX = result.flipY = true;
+        break;
+    case 8:                     // LeftBottom: rotate 270 clockwise
+        result.transpose = result.flipY = true;
+        break;
+    default:
+        break;
+    }
+    return result;
+}
+
+bool vsgsandbox::orientHeader(j_decompress_ptr cinfo, int orientation)
+{
+    if (orientation <= 1)
+        return false;
+    OrientationTransform transform = orientationTransform(orientation);
+    JDIMENSION width, height;
+    transformedSize(cinfo, transform, &width, &height);
+    if (width == 0 || height == 0)
+        return false;
+    cinfo->image_width = width;
+    cinfo->image_height = height;
+    if (transform.transpose)
+    {
+        std::swap(cinfo->max_h_samp_factor, cinfo->max_v_samp_factor);
+        for (int ci = 0; ci < cinfo->num_components; ++ci)
+        {
+            jpeg_component_info* comp = &cinfo->comp_info[ci];
+            std::swap(comp->h_samp_factor, comp->v_samp_factor);
+        }
+    }
+    return true;
+}
+
+OrientResult vsgsandbox::normalizeOrientation(const unsigned char* data, std::size_t size,
+                                              std::vector<unsigned char>& out, bool keepProgressive,
+                                              std::string* message)
+{
+    char buffer[JMSG_LENGTH_MAX] = "";
+    OrientResult result = transformJPEG(data, size, &out, keepProgressive, buffer);
+    if (result == OrientResult::Failed)
+    {
+        VSGSB_DEBUG << "JPEG transform: " << buffer << std::endl;
+        out.clear();
+        if (message)
+            *message = buffer;
+    }
+    return result;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+// Lossless rotation and flipping of JPEG images, done on the DCT
+// coefficients like jpegtran does. The entropy-coded data is decoded
+// to coefficients and coded again, but there is no IDCT, color
+// conversion or quantization, so the image data is unchanged and the
+// cost is a fraction of a decode.
+
+#include "JPEG_Lib.h"
+
+#include <vsgsandbox/Export.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace vsgsandbox
+{
+    // The transform that displays an image with an EXIF orientation
+    // the right way up, as an operation on output pixels: the output
+    // pixel (x, y) comes from the input pixel (x', y'), or (y', x')
+    // if transpose is set, where x' is x mirrored if flipX is set
+    // and y' is y mirrored if flipY is set.
+    struct OrientationTransform
+    {
+        bool transpose = false;
+        bool flipX = false;
+        bool flipY = false;
+    };
+
+    OrientationTransform orientationTransform(int orientation);
+
+    // Change the header of a decompressor that has read a JPEG with
+    // the given orientation so that it describes the image that
+    // normalizeOrientation() would produce: the dimensions are
+    // trimmed and swapped, and so are the sampling factors. Only
+    // good for calculating output dimensions; the object can't be
+    // used to decode the image. Returns false, leaving the header
+    // alone, if normalizeOrientation() wouldn't transform the image.
+    bool orientHeader(j_decompress_ptr cinfo, int orientation);
+
+    enum class OrientResult
+    {
+        Transformed,    // out holds the transformed JPEG
+        AlreadyNormal,  // no EXIF orientation, or it is TopLeft
+        Failed          // message says why
+    };
+
+    // Rotate and flip the JPEG in data so that it has the EXIF
+    // orientation TopLeft, and write the result to out. The EXIF
+    // orientation tag in the result is set to TopLeft; other
+    // markers are copied unchanged. A partial MCU at an edge that
+    // would become the top or left edge can't be moved losslessly,
+    // so it is trimmed off, as jpegtran -trim does; that is at most
+    // 15 pixels. A progressive JPEG stays progressive if
+    // keepProgressive is set; otherwise the result is baseline, which
+    // is much quicker to write and to decode.
+    VSGSANDBOX_DECLSPEC OrientResult normalizeOrientation(const unsigned char* data, std::size_t size,
+                                                          std::vector<unsigned char>& out,
+                                                          bool keepProgressive = true,
+                                                          std::string* message = nullptr);
+}
@@ -0,0 +1,141 @@
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+#include "JPEG_Backend.h"
+#include "Config.h"
+
+#ifdef VSGSANDBOX_HAVE_TURBOJPEG
+
+#include <turbojpeg.h>
+
+#include <climits>
+
+using namespace vsgsandbox;
+
+namespace
+{
+    // Each thread keeps a TurboJPEG decompressor, as creating one
+    // creates a libjpeg decompressor underneath.
+    struct TurboHandle
+    {
+        TurboHandle()
+            : handle(tjInitDecompress())
+        {
+        }
+        ~TurboHandle()
+        {
+            if (handle)
+                tjDestroy(handle);
+        }
+        TurboHandle(const TurboHandle&) = delete;
+        TurboHandle& operator=(const TurboHandle&) = delete;
+        tjhandle handle;
+    };
+
+    tjhandle threadHandle()
+    {
+        static thread_local TurboHandle turbo;
+        return turbo.handle;
+    }
+
+    int pixelFormat(const JPEGBackendParams& params)
+    {
+        if (params.components == 1)
+            return TJPF_GRAY;
+        switch (params.colorSpace)
+        {
+#ifdef JCS_ALPHA_EXTENSIONS
+        case JCS_EXT_RGBA:
+            return TJPF_RGBA;
+        case JCS_EXT_BGRA:
+            return TJPF_BGRA;
+#endif
+#ifdef JCS_EXTENSIONS
+        case JCS_EXT_BGR:
+            return TJPF_BGR;
+#endif
+        default:
+            return TJPF_RGB;
+        }
+    }
+
+    // The TurboJPEG API, which decodes the whole buffer in one call,
+    // writing the rows in either order, and scales in the IDCT like
+    // the scanline decoder. Its flags select the same IDCT and
+    // upsampling as the scanline decoder uses for each quality.
+    class TurboJPEGBackend : public JPEGDecodeBackend
+    {
+    public:
+        const char* name() const override { return "TurboJPEG"; }
+
+        bool supports(const JPEGBackendParams& params, std::string* message) const override
+        {
+            if (params.size > ULONG_MAX)
+            {
+                if (message)
+                    *message = "the file is too large for TurboJPEG";
+                return false;
+            }
+            return true;
+        }
+
+        unsigned char* decode(const JPEGBackendParams& params, std::string* message) const override
+        {
+            tjhandle handle = threadHandle();
+            if (!handle)
+            {
+                if (message)
+                    *message = "could not create a TurboJPEG decompressor";
+                return nullptr;
+            }
+            const std::size_t rowStride = static_cast<std::size_t>(params.width) * params.components;
+            unsigned char* buffer = new unsigned char[rowStride * params.height];
+            int flags = 0;
+            if (params.quality != DecodeQuality::Exact)
+                flags |= TJFLAG_FASTDCT;
+            if (params.quality == DecodeQuality::Fast)
+                flags |= TJFLAG_FASTUPSAMPLE;
+            if (!params.topDown)
+                flags |= TJFLAG_BOTTOMUP;
+            // Given the scaled dimensions, TurboJPEG chooses the same
+            // scale that the reader did. A warning, such as for a
+            // truncated file, still leaves a whole image, as it does
+            // in the scanline decoder.
+            if (tjDecompress2(handle, params.data, static_cast<unsigned long>(params.size), buffer,
+                              static_cast<int>(params.width), static_cast<int>(rowStride),
+                              static_cast<int>(params.height), pixelFormat(params), flags) != 0
+                && tjGetErrorCode(handle) != TJERR_WARNING)
+            {
+                if (message)
+                    *message = tjGetErrorStr2(handle);
+                delete [] buffer;
+                return nullptr;
+            }
+            return buffer;
+        }
+    };
+}
+
+const JPEGDecodeBackend* vsgsandbox::turboJPEGBackend()
+{
+    static const TurboJPEGBackend backend;
+    return &backend;
+}
+
+#else
+
+const vsgsandbox::JPEGDecodeBackend* vsgsandbox::turboJPEGBackend()
+{
+    return nullptr;
+}
+
+#endif
@@ -1,6 +1,8 @@
 #include "ReaderWriter_jpeg.h"
 
+#include <vsgsandbox/Debug.h>
 #include <vsgsandbox/Utils.h>
+#include <vsg/core/Array.h>
 
 /****************************************************************************
  *
@@ -37,9 +39,22 @@
  *
  */
 
+#include "Config.h"
 #include "EXIF_Orientation.h"
-
+#include "JPEG_Backend.h"
+#include "JPEG_CMYK.h"
+#include "JPEG_Encode.h"
+#include "JPEG_Error.h"
+#include "JPEG_Pool.h"
+#include "JPEG_Restart.h"
+#include "JPEG_Source.h"
+#include "JPEG_Transform.h"
+#include "ReaderWriter_sandbox/MappedFile.h"
+
+#include <algorithm>
+#include <iterator>
 #include <sstream>
+#include <thread>
 #include <iostream>
 #include <fstream>
 
@@ -57,426 +72,771 @@ namespace
 #define ERR_OPEN     1
 #define ERR_MEM      2
 #define ERR_JPEGLIB  3
+#define ERR_REGION   4
 
-static int jpegerror = ERR_NO_ERROR;
-
-/* Some versions of jmorecfg.h define boolean, some don't...
-   Those that do also define HAVE_BOOLEAN, so we can guard using that. */
-#ifndef HAVE_BOOLEAN
-  typedef int boolean;
-  #define FALSE 0
-  #define TRUE 1
-#endif
 
-/* CODE FOR READING/WRITING JPEG FROM STREAMS
- *  This code was taken directly from jdatasrc.c and jdatadst.c (libjpeg source)
- *  and modified to use a std::istream/ostream* instead of a FILE*
- */
+int
+simage_jpeg_error(int jpegerror, char * buffer, int buflen)
+{
+    switch (jpegerror)
+    {
+        case ERR_OPEN:
+            strncpy(buffer, "JPEG loader: Error opening file", buflen);
+            break;
+        case ERR_MEM:
+            strncpy(buffer, "JPEG loader: Out of memory error", buflen);
+            break;
+        case ERR_JPEGLIB:
+            strncpy(buffer, "JPEG loader: Illegal jpeg file", buflen);
+            break;
+        case ERR_REGION:
+            strncpy(buffer, "JPEG loader: Region is outside the image", buflen);
+            break;
+    }
+    return jpegerror;
+}
 
-/* Expanded data source object for stdio input */
 
-typedef struct {
-    struct jpeg_source_mgr pub;    /* public fields */
-    std::istream * infile;        /* source stream */
-    JOCTET * buffer;              /* start of buffer */
-    boolean start_of_file;        /* have we gotten any data yet? */
-} stream_source_mgr;
+int
+simage_jpeg_identify(const char *,
+const unsigned char *header,
+int headerlen)
+{
+    static unsigned char jpgcmp[] = {'J', 'F', 'I', 'F' };
+    if (headerlen < 4) return 0;
+    if (memcmp((const void*)&header[6],
+        (const void*)jpgcmp, 4) == 0) return 1;
+    return 0;
+}
 
-typedef stream_source_mgr * stream_src_ptr;
 
-#define INPUT_BUF_SIZE  4096    /* choose an efficiently fread'able size */
+// Where simage_jpeg_load() gets its data from: a block of memory
+// (normally a mapped file), or a stream if there is no block.
+struct JPEGInput
+{
+    JPEGInput(std::istream& fin)
+        : stream(&fin)
+    {
+    }
+    JPEGInput(const unsigned char* in_data, size_t in_size)
+        : data(in_data), size(in_size)
+    {
+    }
+    std::istream* stream = nullptr;
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+};
 
-/*
- * Initialize source --- called by jpeg_read_header
- * before any data is actually read.
+/* The number of threads to use when numThreads is 0. This is looked
+ * up once, as hardware_concurrency() reads /sys on Linux, which is a
+ * noticeable part of the time to decode a small image.
  */
-
-void init_source (j_decompress_ptr cinfo)
+unsigned int hardwareThreads()
 {
-  stream_src_ptr src = (stream_src_ptr) cinfo->src;
-
-  /* We reset the empty-input-file flag for each image,
-   * but we don't clear the input buffer.
-   * This is correct behavior for reading a series of images from one source.
-   */
-  src->start_of_file = TRUE;
+    static const unsigned int count = std::max(std::thread::hardware_concurrency(), 1u);
+    return count;
 }
 
+// Decoding parameters taken from the vsg::Options
+struct JPEGDecodeParams
+{
+    JPEGDecodeParams(const vsg::Options* options)
+    {
+        if (options)
+        {
+            options->getValue(ReaderWriter_jpeg::scaleDenominator, scaleDenom);
+            options->getValue(ReaderWriter_jpeg::targetSize, targetSize);
+            options->getValue(ReaderWriter_jpeg::numThreads, numThreads);
+            options->getValue(ReaderWriter_jpeg::maxScans, maxScans);
+            options->getValue(ReaderWriter_jpeg::ycbcrPlanes, ycbcrPlanes);
+            options->getValue(ReaderWriter_jpeg::outputFormat, outputFormat);
+            options->getValue(ReaderWriter_jpeg::applyOrientation, applyOrientation);
+            options->getValue(ReaderWriter_jpeg::topDown, topDown);
+            options->getValue(ReaderWriter_jpeg::convertToSRGB, convertToSRGB);
+            options->getValue(ReaderWriter_jpeg::decoder, decoder);
+            std::string qualityName;
+            if (options->getValue(ReaderWriter_jpeg::decodeQuality, qualityName)
+                && !DecodeQuality::fromName(qualityName, &quality))
+            {
+                VSGSB_DEBUG << "JPEG loader: unknown decode quality " << qualityName << std::endl;
+            }
+            progress = options->getObject<ProgressiveCallback>(ReaderWriter_jpeg::progressiveCallback);
+#ifdef VSGSANDBOX_HAVE_JPEG_CROP_SCANLINE
+            region = options->getObject<ImageRegion>(ReaderWriter_jpeg::region);
+#endif
+        }
+        if (numThreads == 0)
+        {
+            numThreads = hardwareThreads();
+        }
+    }
+    unsigned int scaleDenom = 1;
+    unsigned int targetSize = 0;
+    unsigned int numThreads = 0;
+    unsigned int maxScans = 0;
+    bool ycbcrPlanes = false;
+    unsigned int outputFormat = VK_FORMAT_UNDEFINED;
+    bool applyOrientation = false;
+    bool topDown = false;
+    bool convertToSRGB = true;
+    unsigned int decoder = static_cast<unsigned int>(JPEGDecoder::Auto);
+    DecodeQuality::Quality quality = DecodeQuality::Exact;
+    const ProgressiveCallback* progress = nullptr;
+    const ImageRegion* region = nullptr;
+};
 
-/*
- * Fill the input buffer --- called whenever buffer is emptied.
- *
- * In typical applications, this should read fresh data into the buffer
- * (ignoring the current state of next_input_byte & bytes_in_buffer),
- * reset the pointer & count to the start of the buffer, and return TRUE
- * indicating that the buffer has been reloaded.  It is not necessary to
- * fill the buffer entirely, only to obtain at least one more byte.
- *
- * There is no such thing as an EOF return.  If the end of the file has been
- * reached, the routine has a choice of ERREXIT() or inserting fake data into
- * the buffer.  In most cases, generating a warning message and inserting a
- * fake EOI marker is the best course of action --- this will allow the
- * decompressor to output however much of the image is there.  However,
- * the resulting error message is misleading if the real problem is an empty
- * input file, so we handle that case specially.
- *
- * In applications that need to be able to suspend compression due to input
- * not being available yet, a FALSE return indicates that no more data can be
- * obtained right now, but more may be forthcoming later.  In this situation,
- * the decompressor will return to its caller (with an indication of the
- * number of scanlines it has read, if any).  The application should resume
- * decompression after it has loaded more data into the input buffer.  Note
- * that there are substantial restrictions on the use of suspension --- see
- * the documentation.
- *
- * When suspending, the decompressor will back up to a convenient restart point
- * (typically the start of the current MCU). next_input_byte & bytes_in_buffer
- * indicate where the restart point will be if the current call returns FALSE.
- * Data beyond this point must be rescanned after resumption, so move it to
- * the front of the buffer rather than discarding it.
+/* The libjpeg color space that writes pixels in the requested output
+ * format, or JCS_RGB if libjpeg can't produce it.
  */
+J_COLOR_SPACE requestedColorSpace(const JPEGDecodeParams& params)
+{
+    switch (params.outputFormat)
+    {
+#ifdef JCS_ALPHA_EXTENSIONS
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        return JCS_EXT_RGBA;
+    case VK_FORMAT_B8G8R8A8_SRGB:
+        return JCS_EXT_BGRA;
+#endif
+#ifdef JCS_EXTENSIONS
+    case VK_FORMAT_B8G8R8_SRGB:
+        return JCS_EXT_BGR;
+#endif
+    default:
+        return JCS_RGB;
+    }
+}
 
-boolean fill_input_buffer (j_decompress_ptr cinfo)
+bool isBGR(J_COLOR_SPACE colorSpace)
 {
-  stream_src_ptr src = (stream_src_ptr) cinfo->src;
-  size_t nbytes;
+#ifdef JCS_ALPHA_EXTENSIONS
+    if (colorSpace == JCS_EXT_BGRA)
+        return true;
+#endif
+#ifdef JCS_EXTENSIONS
+    if (colorSpace == JCS_EXT_BGR)
+        return true;
+#endif
+    return false;
+}
 
-  src->infile->read((char*)src->buffer,INPUT_BUF_SIZE);
-  nbytes = src->infile->gcount();
+// Where the planes of an image decoded as raw YCbCr data go in the
+// output buffer. format is VK_FORMAT_UNDEFINED if the image is
+// decoded to interleaved pixels instead.
+struct PlaneLayout
+{
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    size_t offset[3] = {};
+    unsigned int width[3] = {};
+    unsigned int height[3] = {};
+    size_t size = 0;
+};
 
-  if (nbytes <= 0) {
-    if (src->start_of_file)    /* Treat empty input file as fatal error */
-      ERREXIT(cinfo, JERR_INPUT_EMPTY);
-    WARNMS(cinfo, JWRN_JPEG_EOF);
-    /* Insert a fake EOI marker */
-    src->buffer[0] = (JOCTET) 0xFF;
-    src->buffer[1] = (JOCTET) JPEG_EOI;
-    nbytes = 2;
-  }
+// The part of the output image that is returned, in output pixels from
+// the top left. It is the whole image unless a region was requested.
+struct OutputCrop
+{
+    JDIMENSION x = 0;
+    JDIMENSION y = 0;
+    JDIMENSION width = 0;
+    JDIMENSION height = 0;
+    bool cropped = false;
+    // Columns decoded to the left of x, which are dropped
+    JDIMENSION skip = 0;
+};
 
-  src->pub.next_input_byte = src->buffer;
-  src->pub.bytes_in_buffer = nbytes;
-  src->start_of_file = FALSE;
+/* Images smaller than this aren't worth splitting between threads. */
+#define MIN_PARALLEL_PIXELS  (1024 * 1024)
 
-  return TRUE;
+/* Decode a JPEG with restart markers in bands on several threads,
+ * straight into buffer. This is kept out of simage_jpeg_load() so
+ * that the restart layout isn't in the frame that longjmp returns to.
+ */
+bool decodeParallel(const JPEGInput& input, j_decompress_ptr cinfo, unsigned int numThreads,
+                    unsigned char* buffer, size_t row_stride, bool topDown)
+{
+    RestartLayout layout;
+    if (!scanRestartMarkers(input.data, input.size, layout))
+        return false;
+    return decodeRestartBands(input.data, layout, cinfo, numThreads, buffer, row_stride, !topDown);
 }
 
-
-/*
- * Skip data --- used to skip over a potentially large amount of
- * uninteresting data (such as an APPn marker).
- *
- * Writers of suspendable-input applications must note that skip_input_data
- * is not granted the right to give a suspension return.  If the skip extends
- * beyond the data currently in the buffer, the buffer can be marked empty so
- * that the next read will cause a fill_input_buffer call that can suspend.
- * Arranging for additional bytes to be discarded before reloading the input
- * buffer is the application writer's problem.
+/* Choose the libjpeg scale denominator. libjpeg can scale by any M/8,
+ * but only 1/2, 1/4 and 1/8 skip work in the IDCT; other factors would
+ * cost more than a full decode.
  */
-
-void skip_input_data (j_decompress_ptr cinfo, long num_bytes)
+unsigned int chooseScaleDenom(const JPEGDecodeParams& params,
+                              JDIMENSION image_width, JDIMENSION image_height)
 {
-  stream_src_ptr src = (stream_src_ptr) cinfo->src;
-
-  /* Just a dumb implementation for now.  Could use fseek() except
-   * it doesn't work on pipes.  Not clear that being smart is worth
-   * any trouble anyway --- large skips are infrequent.
-   */
-  if (num_bytes > 0) {
-    while (num_bytes > (long) src->pub.bytes_in_buffer) {
-      num_bytes -= (long) src->pub.bytes_in_buffer;
-      (void) fill_input_buffer(cinfo);
-      /* note we assume that fill_input_buffer will never return FALSE,
-       * so suspension need not be handled.
-       */
+    if (params.targetSize > 0)
+    {
+        JDIMENSION longSide = image_width > image_height ? image_width : image_height;
+        for (unsigned int denom = 8; denom > 1; denom /= 2)
+        {
+            /* libjpeg rounds the scaled size up */
+            if ((longSide + denom - 1) / denom >= params.targetSize)
+                return denom;
+        }
+        return 1;
+    }
+    switch (params.scaleDenom)
+    {
+    case 2:
+    case 4:
+    case 8:
+        return params.scaleDenom;
+    default:
+        return 1;
     }
-    src->pub.next_input_byte += (size_t) num_bytes;
-    src->pub.bytes_in_buffer -= (size_t) num_bytes;
-  }
 }
 
+int colorSpaceComponents(J_COLOR_SPACE colorSpace)
+{
+#ifdef JCS_ALPHA_EXTENSIONS
+    if (colorSpace == JCS_EXT_RGBA || colorSpace == JCS_EXT_BGRA)
+        return 4;
+#endif
+    return 3;
+}
 
-/*
- * An additional method that can be provided by data source modules is the
- * resync_to_restart method for error recovery in the presence of RST markers.
- * For the moment, this source module just uses the default resync method
- * provided by the JPEG library.  That method assumes that no backtracking
- * is possible.
+/* Work out the plane layout of a YCbCr image that will be decoded as
+ * raw data, once its output dimensions have been calculated. The
+ * format comes from the ratio of the planes' sizes, which isn't
+ * always the sampling in the file: when decoding at a reduced scale,
+ * libjpeg scales the chroma planes up in the IDCT where it can. The
+ * full resolution plane is rounded up to a whole number of chroma
+ * samples, as Vulkan requires; the JPEG's padding blocks supply the
+ * extra pixels.
  */
+void calcPlaneLayout(j_decompress_ptr cinfo, PlaneLayout* layout)
+{
+    jpeg_component_info* comp = cinfo->comp_info;
+    int lumaWidth = comp[0].h_samp_factor * comp[0].DCT_scaled_size;
+    int lumaHeight = comp[0].v_samp_factor * comp[0].DCT_scaled_size;
+    int chromaWidth = comp[1].h_samp_factor * comp[1].DCT_scaled_size;
+    int chromaHeight = comp[1].v_samp_factor * comp[1].DCT_scaled_size;
+
+    layout->format = VK_FORMAT_UNDEFINED;
+    if (comp[2].h_samp_factor * comp[2].DCT_scaled_size != chromaWidth
+        || comp[2].v_samp_factor * comp[2].DCT_scaled_size != chromaHeight
+        || lumaWidth % chromaWidth != 0 || lumaHeight % chromaHeight != 0)
+    {
+        return;
+    }
+    unsigned int hs = lumaWidth / chromaWidth;
+    unsigned int vs = lumaHeight / chromaHeight;
+    if (hs == 2 && vs == 2)
+        layout->format = VK_FORMAT_G8_B8_R8_3PLANE_420_UNORM;
+    else if (hs == 2 && vs == 1)
+        layout->format = VK_FORMAT_G8_B8_R8_3PLANE_422_UNORM;
+    else if (hs == 1 && vs == 1)
+        layout->format = VK_FORMAT_G8_B8_R8_3PLANE_444_UNORM;
+    else
+        return;
+    layout->width[0] = (cinfo->output_width + hs - 1) / hs * hs;
+    layout->height[0] = (cinfo->output_height + vs - 1) / vs * vs;
+    layout->width[1] = layout->width[2] = layout->width[0] / hs;
+    layout->height[1] = layout->height[2] = layout->height[0] / vs;
+    layout->size = 0;
+    for (int ci = 0; ci < 3; ++ci)
+    {
+        layout->offset[ci] = layout->size;
+        layout->size += (size_t)layout->width[ci] * layout->height[ci];
+    }
+}
 
-
-/*
- * Terminate source --- called by jpeg_finish_decompress
- * after all data has been read.  Often a no-op.
- *
- * NB: *not* called by jpeg_abort or jpeg_destroy; surrounding
- * application must deal with any cleanup that should happen even
- * for error exit.
+/* The libjpeg settings for a decode quality. jpeg_read_header()
+ * resets them to the exact ones for every image. Block smoothing only
+ * applies to the early scans of a progressive JPEG that are output
+ * before the rest arrive, or are missing.
  */
-void term_source (j_decompress_ptr /*cinfo*/)
+void setDecodeQuality(j_decompress_ptr cinfo, DecodeQuality::Quality quality)
 {
-  /* no work necessary here */
+    cinfo->dct_method = quality == DecodeQuality::Exact ? JDCT_ISLOW : JDCT_IFAST;
+    cinfo->do_fancy_upsampling = quality == DecodeQuality::Fast ? FALSE : TRUE;
+    cinfo->do_block_smoothing = quality == DecodeQuality::Fast ? FALSE : TRUE;
 }
 
-void jpeg_istream_src(j_decompress_ptr cinfo, std::istream *infile)
+/* Set the scale, quality and output color space of a decompressor
+ * that has read the header. Returns the number of output components.
+ * If the image will be decoded to YCbCr planes, their layout is
+ * returned in planes_ret.
+ */
+int setDecompressParams(j_decompress_ptr cinfo, const JPEGDecodeParams& params,
+                        unsigned int* scale_denom_ret, PlaneLayout* planes_ret)
 {
-    stream_src_ptr src;
-
-    /* The source object and input buffer are made permanent so that a series
-     * of JPEG images can be read from the same file by calling jpeg_stdio_src
-     * only before the first one.  (If we discarded the buffer at the end of
-     * one image, we'd likely lose the start of the next one.)
-     * This makes it unsafe to use this manager and a different source
-     * manager serially with the same JPEG object.  Caveat programmer.
-     */
-    if (cinfo->src == NULL) {    /* first time for this JPEG object? */
-        cinfo->src = (struct jpeg_source_mgr *)
-            (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT,sizeof(stream_source_mgr));
-        src = (stream_src_ptr) cinfo->src;
-        src->buffer = (JOCTET *)
-            (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT,INPUT_BUF_SIZE * sizeof(JOCTET));
+    setDecodeQuality(cinfo, params.quality);
+    *scale_denom_ret = chooseScaleDenom(params, cinfo->image_width, cinfo->image_height);
+    cinfo->scale_num = 1;
+    cinfo->scale_denom = *scale_denom_ret;
+    planes_ret->format = VK_FORMAT_UNDEFINED;
+    J_COLOR_SPACE colorSpace = requestedColorSpace(params);
+    int colorComponents = colorSpaceComponents(colorSpace);
+    if (cinfo->jpeg_color_space == JCS_GRAYSCALE)
+    {
+        /* libjpeg-turbo can expand gray to any RGB layout */
+        if (colorComponents == 4)
+        {
+            cinfo->out_color_space = colorSpace;
+            return 4;
+        }
+        cinfo->out_color_space = JCS_GRAYSCALE;
+        return 1;
     }
-
-    src = (stream_src_ptr) cinfo->src;
-    src->pub.init_source = init_source;
-    src->pub.fill_input_buffer = fill_input_buffer;
-    src->pub.skip_input_data = skip_input_data;
-    src->pub.resync_to_restart = jpeg_resync_to_restart; /* use default method */
-    src->pub.term_source = term_source;
-    src->infile = infile;
-    src->pub.bytes_in_buffer = 0; /* forces fill_input_buffer on first read */
-    src->pub.next_input_byte = NULL; /* until buffer loaded */
+    if (cinfo->jpeg_color_space == JCS_CMYK || cinfo->jpeg_color_space == JCS_YCCK)
+    {
+        /* Decoded to CMYK, which is converted as the rows are copied */
+        cinfo->out_color_space = JCS_CMYK;
+        return colorComponents;
+    }
+    if (params.ycbcrPlanes && !params.region && cinfo->jpeg_color_space == JCS_YCbCr && cinfo->num_components == 3)
+    {
+        cinfo->out_color_space = JCS_YCbCr;
+        cinfo->raw_data_out = TRUE;
+        jpeg_calc_output_dimensions(cinfo);
+        calcPlaneLayout(cinfo, planes_ret);
+        if (planes_ret->format != VK_FORMAT_UNDEFINED)
+            return 3;
+        cinfo->raw_data_out = FALSE;
+    }
+    /* use rgb */
+    cinfo->out_color_space = colorSpace;
+    return colorComponents;
 }
 
-/* Expanded data destination object for stdio output */
-
-typedef struct {
-  struct jpeg_destination_mgr pub; /* public fields */
-
-  std::ostream * outfile;    /* target stream */
-  JOCTET * buffer;          /* start of buffer */
-} stream_destination_mgr;
-
-typedef stream_destination_mgr * stream_dest_ptr;
-
-#define OUTPUT_BUF_SIZE  4096    /* choose an efficiently fwrite'able size */
-
-
-/*
- * Initialize destination --- called by jpeg_start_compress
- * before any data is actually written.
+/* Work out the output rectangle that covers the requested region,
+ * once the output dimensions have been calculated. Returns false if
+ * the region has no pixels in the image.
  */
-
-void init_destination (j_compress_ptr cinfo)
+bool requestedCrop(const JPEGDecodeParams& params, j_decompress_ptr cinfo, unsigned int scale_denom,
+                   OutputCrop* crop)
 {
-  stream_dest_ptr dest = (stream_dest_ptr) cinfo->dest;
-
-  /* Allocate the output buffer --- it will be released when done with image */
-  dest->buffer = (JOCTET *)
-      (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE, OUTPUT_BUF_SIZE * sizeof(JOCTET));
-
-  dest->pub.next_output_byte = dest->buffer;
-  dest->pub.free_in_buffer = OUTPUT_BUF_SIZE;
+    crop->x = crop->y = 0;
+    crop->width = cinfo->output_width;
+    crop->height = cinfo->output_height;
+    crop->cropped = false;
+    if (!params.region)
+        return true;
+    /* Clamp the region to the image, at full resolution */
+    const ImageRegion& region = *params.region;
+    JDIMENSION x0 = std::min<JDIMENSION>(region.x, cinfo->image_width);
+    JDIMENSION y0 = std::min<JDIMENSION>(region.y, cinfo->image_height);
+    JDIMENSION x1 = (JDIMENSION)std::min<unsigned long long>((unsigned long long)region.x + region.width,
+                                                             cinfo->image_width);
+    JDIMENSION y1 = (JDIMENSION)std::min<unsigned long long>((unsigned long long)region.y + region.height,
+                                                             cinfo->image_height);
+    if (x1 <= x0 || y1 <= y0)
+        return false;
+    crop->x = x0 / scale_denom;
+    crop->y = y0 / scale_denom;
+    crop->width = std::min((x1 + scale_denom - 1) / scale_denom, cinfo->output_width) - crop->x;
+    crop->height = std::min((y1 + scale_denom - 1) / scale_denom, cinfo->output_height) - crop->y;
+    crop->cropped = true;
+    return true;
 }
 
-
-/*
- * Empty the output buffer --- called whenever buffer fills up.
- *
- * In typical applications, this should write the entire output buffer
- * (ignoring the current state of next_output_byte & free_in_buffer),
- * reset the pointer & count to the start of the buffer, and return TRUE
- * indicating that the buffer has been dumped.
- *
- * In applications that need to be able to suspend compression due to output
- * overrun, a FALSE return indicates that the buffer cannot be emptied now.
- * In this situation, the compressor will return to its caller (possibly with
- * an indication that it has not accepted all the supplied scanlines).  The
- * application should resume compression after it has made more room in the
- * output buffer.  Note that there are substantial restrictions on the use of
- * suspension --- see the documentation.
- *
- * When suspending, the compressor will back up to a convenient restart point
- * (typically the start of the current MCU). next_output_byte & free_in_buffer
- * indicate where the restart point will be if the current call returns FALSE.
- * Data beyond this point will be regenerated after resumption, so do not
- * write it out when emptying the buffer externally.
+/* Restrict the coming output pass to the columns of crop, and skip
+ * the rows above it. Only the iMCU columns that cover the crop are
+ * decoded, and the skipped rows aren't run through the IDCT.
+ * jpeg_crop_scanline() moves the left edge to an iMCU boundary, and
+ * the first column it returns is upsampled without its left
+ * neighbour, so the crop starts at least one column early and the
+ * extra columns are dropped as the rows are copied. In
+ * buffered-image mode this is done for every pass; output_width
+ * has to be put back first, as jpeg_crop_scanline() changes it.
  */
-
-boolean empty_output_buffer (j_compress_ptr cinfo)
+void startCrop(j_decompress_ptr cinfo, JDIMENSION full_output_width, OutputCrop* crop)
 {
-  stream_dest_ptr dest = (stream_dest_ptr) cinfo->dest;
+    if (!crop->cropped)
+        return;
+#ifdef VSGSANDBOX_HAVE_JPEG_CROP_SCANLINE
+    cinfo->output_width = full_output_width;
+    JDIMENSION x = crop->x > 0 ? crop->x - 1 : 0;
+    JDIMENSION width = crop->x + crop->width - x;
+    jpeg_crop_scanline(cinfo, &x, &width);
+    crop->skip = crop->x - x;
+    if (crop->y > 0)
+        (void) jpeg_skip_scanlines(cinfo, crop->y);
+#else
+    (void) cinfo;
+    (void) full_output_width;
+#endif
+}
 
-  dest->outfile->write((const char*)dest->buffer,OUTPUT_BUF_SIZE);
-  if (dest->outfile->bad())
-    ERREXIT(cinfo, JERR_FILE_WRITE);
+VkFormat jpegFormat(const JPEGDecodeParams& params, int numComponents)
+{
+    if (numComponents > 1 && requestedColorSpace(params) != JCS_RGB)
+        return static_cast<VkFormat>(params.outputFormat);
+    switch (numComponents)
+    {
+    case 1:
+        return VK_FORMAT_R8_SRGB;
+    case 2:
+        return VK_FORMAT_R8G8_SRGB;
+    case 3:
+        return VK_FORMAT_R8G8B8_SRGB;
+    case 4:
+        return VK_FORMAT_R8G8B8A8_SRGB;
+    default:
+        return VK_FORMAT_UNDEFINED;
+    }
+}
 
-  dest->pub.next_output_byte = dest->buffer;
-  dest->pub.free_in_buffer = OUTPUT_BUF_SIZE;
+/* The part of the full resolution image that an output crop covers */
+vsg::ref_ptr<ImageRegion> cropRegion(const OutputCrop& crop, unsigned int scale_denom,
+                                     unsigned int full_width, unsigned int full_height)
+{
+    std::uint32_t x = crop.x * scale_denom;
+    std::uint32_t y = crop.y * scale_denom;
+    return ImageRegion::create(x, y,
+                               std::min(crop.width * scale_denom, full_width - x),
+                               std::min(crop.height * scale_denom, full_height - y));
+}
 
-  return TRUE;
+/* Wrap decoded image data in a vsg::Data, which takes ownership of
+ * it, and attach the image's metadata.
+ */
+vsg::ref_ptr<vsg::Data> makeImage(unsigned char* imageData, int width, int height, int numComponents,
+                                  VkFormat format, const PlaneLayout& planes,
+                                  unsigned int exif_orientation, unsigned int scale_denom,
+                                  unsigned int full_width, unsigned int full_height,
+                                  const OutputCrop& crop, bool topDown, DecodeQuality::Quality quality)
+{
+    vsg::ref_ptr<vsg::Data> result;
+    if (planes.format != VK_FORMAT_UNDEFINED)
+    {
+        result = vsg::ubyteArray::create(static_cast<std::uint32_t>(planes.size), imageData);
+        result->setFormat(planes.format);
+        auto imagePlanes = ImagePlanes::create();
+        imagePlanes->width = width;
+        imagePlanes->height = height;
+        for (int ci = 0; ci < 3; ++ci)
+        {
+            ImagePlanes::Plane plane;
+            plane.offset = planes.offset[ci];
+            plane.width = planes.width[ci];
+            plane.height = planes.height[ci];
+            imagePlanes->planes.push_back(plane);
+        }
+        ImagePlanes::set(result, imagePlanes);
+    }
+    else switch (numComponents)
+    {
+    case 1:
+        result = createArray<std::uint8_t>(width, height, imageData, format);
+        break;
+    case 2:
+        result = createArray<vsg::ubvec2>(width, height, imageData, format);
+        break;
+    case 3:
+        result = createArray<vsg::ubvec3>(width, height, imageData, format);
+        break;
+    case 4:
+        result = createArray<vsg::ubvec4>(width, height, imageData, format);
+        break;
+    default:
+        return {};
+    }
+    auto exif = EXIF::create(static_cast<EXIF::Orientation>(exif_orientation));
+    EXIF::set(result, exif);
+    ImageScale::set(result, ImageScale::create(scale_denom, full_width, full_height));
+    if (crop.cropped)
+        ImageRegion::set(result, cropRegion(crop, scale_denom, full_width, full_height));
+    if (topDown)
+        ImageOrigin::set(result, ImageOrigin::create(ImageOrigin::TopLeft));
+    DecodeQuality::set(result, DecodeQuality::create(quality));
+    return result;
 }
 
+/* Read the ICC profile saved with the header into the context, and
+ * set up its conversion to sRGB if the image will be decoded to RGB
+ * pixels. Returns the transform to apply to each row, or null.
+ */
+const ColorTransform* prepareColorTransform(DecompressContext* context, const JPEGDecodeParams& params,
+                                            int numComponents, const PlaneLayout& planes)
+{
+    context->colorTransform.reset();
+    if (!ICC_Profile(&context->cinfo, &context->iccProfile))
+        return nullptr;
+    if (!params.convertToSRGB || numComponents < 3 || planes.format != VK_FORMAT_UNDEFINED
+        || context->cinfo.out_color_space == JCS_CMYK)
+    {
+        return nullptr;
+    }
+    if (context->colorTransform.setProfile(context->iccProfile.data(), context->iccProfile.size())
+        != ColorTransform::Convert)
+    {
+        return nullptr;
+    }
+    return &context->colorTransform;
+}
 
-/*
- * Terminate destination --- called by jpeg_finish_compress
- * after all data has been written.  Usually needs to flush buffer.
- *
- * NB: *not* called by jpeg_abort or jpeg_destroy; surrounding
- * application must deal with any cleanup that should happen even
- * for error exit.
+/* The profile that goes with an image decoded by context: the one in
+ * the file, unless the pixels were converted from it or it is sRGB.
  */
+vsg::ref_ptr<ICCProfile> attachedProfile(const DecompressContext* context)
+{
+    if (context->iccProfile.empty() || context->colorTransform.status() != ColorTransform::Unsupported)
+        return {};
+    return ICCProfile::create(context->iccProfile.data(), context->iccProfile.size());
+}
 
-void term_destination (j_compress_ptr cinfo)
+void attachProfile(vsg::Data* image, const DecompressContext* context)
 {
-  stream_dest_ptr dest = (stream_dest_ptr) cinfo->dest;
-  size_t datacount = OUTPUT_BUF_SIZE - dest->pub.free_in_buffer;
+    if (auto profile = attachedProfile(context))
+        ICCProfile::set(image, profile);
+}
 
-  /* Write any data remaining in the buffer */
-  if (datacount > 0) {
-    dest->outfile->write((const char*)dest->buffer,datacount);
-    if (dest->outfile->bad())
-      ERREXIT(cinfo, JERR_FILE_WRITE);
-  }
-  dest->outfile->flush();
-  /* Make sure we wrote the output file OK */
-  if (dest->outfile->bad())
-    ERREXIT(cinfo, JERR_FILE_WRITE);
+/* Hand an intermediate image of a progressive JPEG to the callback.
+ * This is kept out of simage_jpeg_load() so that no vsg objects are
+ * alive in the frame that longjmp returns to.
+ */
+void deliverScan(const DecompressContext* context, const JPEGDecodeParams& params, unsigned char* imageData,
+                 int width, int height, int numComponents, const PlaneLayout& planes,
+                 unsigned int scan, unsigned int exif_orientation, unsigned int scale_denom,
+                 unsigned int full_width, unsigned int full_height, const OutputCrop& crop)
+{
+    auto image = makeImage(imageData, width, height, numComponents, jpegFormat(params, numComponents),
+                           planes, exif_orientation, scale_denom, full_width, full_height, crop, params.topDown,
+                           params.quality);
+    attachProfile(image, context);
+    if (params.progress->refined)
+        params.progress->refined(image, scan);
 }
 
+/* Rows passed to each jpeg_read_scanlines() call */
+#define SCANLINE_ROWS  16
 
-/*
- * Prepare for output to a stdio stream.
- * The caller must have already opened the stream, and is responsible
- * for closing it after finishing compression.
+/* Read the scanlines of crop from the current output pass into
+ * buffer, top row first if params.topDown, otherwise bottom row
+ * first. Unless columns to the left of the crop have to be dropped or
+ * the pixels converted from CMYK, libjpeg writes the rows straight
+ * into buffer, several at a time. If there is a transform, each row
+ * is converted to sRGB while it is still in the cache.
  */
-
-void jpeg_stream_dest (j_compress_ptr cinfo, std::ostream * outfile)
+void readScanlines(j_decompress_ptr cinfo, JSAMPARRAY rowbuffer, unsigned char* buffer, int row_stride,
+                   const OutputCrop& crop, const JPEGDecodeParams& params, const ColorTransform* transform)
 {
-    stream_dest_ptr dest;
+    const bool topDown = params.topDown;
+    const bool cmyk = cinfo->out_color_space == JCS_CMYK;
+    const bool bgr = isBGR(requestedColorSpace(params));
+    JDIMENSION height = crop.height;
+    JDIMENSION row = 0;
 
-    /* The destination object is made permanent so that multiple JPEG images
-     * can be written to the same file without re-executing jpeg_stdio_dest.
-     * This makes it dangerous to use this manager and a different destination
-     * manager serially with the same JPEG object, because their private object
-     * sizes may be different.  Caveat programmer.
-     */
-    if (cinfo->dest == NULL) {    /* first time for this JPEG object? */
-        cinfo->dest = (struct jpeg_destination_mgr *)
-            (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT, sizeof(stream_destination_mgr));
+    if (!cmyk && crop.skip == 0 && cinfo->output_width == crop.width)
+    {
+        JSAMPROW rows[SCANLINE_ROWS];
+        while (row < height)
+        {
+            JDIMENSION count = std::min<JDIMENSION>(SCANLINE_ROWS, height - row);
+            for (JDIMENSION i = 0; i < count; ++i)
+            {
+                JDIMENSION y = topDown ? row + i : height - 1 - (row + i);
+                rows[i] = buffer + (size_t)y * row_stride;
+            }
+            JDIMENSION read = jpeg_read_scanlines(cinfo, rows, count);
+            if (transform)
+            {
+                for (JDIMENSION i = 0; i < read; ++i)
+                    transform->convert(rows[i], crop.width, cinfo->output_components, bgr);
+            }
+            row += read;
+        }
+        return;
+    }
+    int skip = crop.skip * cinfo->output_components;
+    J_COLOR_SPACE colorSpace = requestedColorSpace(params);
+    for (; row < height; ++row)
+    {
+        JDIMENSION y = topDown ? row : height - 1 - row;
+        unsigned char* dest = buffer + (size_t)y * row_stride;
+        (void) jpeg_read_scanlines(cinfo, rowbuffer, 1);
+        if (cmyk)
+        {
+            convertCMYKRow(rowbuffer[0] + skip, dest, crop.width, colorSpace, cinfo->saw_Adobe_marker);
+        }
+        else
+        {
+            memcpy(dest, rowbuffer[0] + skip, row_stride);
+            if (transform)
+                transform->convert(dest, crop.width, cinfo->output_components, bgr);
+        }
     }
-
-    dest = (stream_dest_ptr) cinfo->dest;
-    dest->pub.init_destination = init_destination;
-    dest->pub.empty_output_buffer = empty_output_buffer;
-    dest->pub.term_destination = term_destination;
-    dest->outfile = outfile;
 }
 
-/* END OF READ/WRITE STREAM CODE */
-
-int
-simage_jpeg_error(char * buffer, int buflen)
+/* Allocate the rows that jpeg_read_raw_data() writes one iMCU row of
+ * each component into. They go away when the image is done.
+ */
+void allocRawRows(j_decompress_ptr cinfo, JSAMPARRAY planeRows[3])
 {
-    switch (jpegerror)
+    for (int ci = 0; ci < 3; ++ci)
     {
-        case ERR_OPEN:
-            strncpy(buffer, "JPEG loader: Error opening file", buflen);
-            break;
-        case ERR_MEM:
-            strncpy(buffer, "JPEG loader: Out of memory error", buflen);
-            break;
-        case ERR_JPEGLIB:
-            strncpy(buffer, "JPEG loader: Illegal jpeg file", buflen);
-            break;
+        jpeg_component_info* comp = &cinfo->comp_info[ci];
+        planeRows[ci] = (*cinfo->mem->alloc_sarray)
+            ((j_common_ptr) cinfo, JPOOL_IMAGE,
+             comp->width_in_blocks * comp->DCT_scaled_size,
+             comp->v_samp_factor * comp->DCT_scaled_size);
     }
-    return jpegerror;
 }
 
-
-struct my_error_mgr
+/* Read the raw YCbCr data of the current output pass into the planes
+ * of buffer, top row of each plane first if topDown, otherwise bottom
+ * row first.
+ */
+void readRawPlanes(j_decompress_ptr cinfo, JSAMPARRAY planeRows[3], unsigned char* buffer,
+                   const PlaneLayout& planes, bool topDown)
 {
-    struct jpeg_error_mgr pub;   /* "public" fields */
+    JDIMENSION lines = cinfo->max_v_samp_factor * cinfo->min_DCT_scaled_size;
 
-    jmp_buf setjmp_buffer;       /* for return to caller */
-};
-
-typedef struct my_error_mgr * my_error_ptr;
+    while (cinfo->output_scanline < cinfo->output_height)
+    {
+        JDIMENSION iMCURow = cinfo->output_scanline / lines;
+        (void) jpeg_read_raw_data(cinfo, planeRows, lines);
+        for (int ci = 0; ci < 3; ++ci)
+        {
+            jpeg_component_info* comp = &cinfo->comp_info[ci];
+            unsigned int rows = comp->v_samp_factor * comp->DCT_scaled_size;
+            for (unsigned int r = 0; r < rows; ++r)
+            {
+                unsigned int y = iMCURow * rows + r;
+                if (y >= planes.height[ci])
+                    break;
+                if (!topDown)
+                    y = planes.height[ci] - 1 - y;
+                memcpy(buffer + planes.offset[ci] + (size_t)y * planes.width[ci],
+                       planeRows[ci][r], planes.width[ci]);
+            }
+        }
+    }
+}
 
-static void
-my_error_exit (j_common_ptr cinfo)
+/* Allocate the row buffers for the output passes of a started
+ * decompressor, and return the dimensions of the image. If the
+ * output is cropped, the pass must have been started with
+ * startCrop(), as the row buffer covers the decoded columns.
+ */
+void allocOutputRows(DecompressContext* context, const PlaneLayout& planes, const OutputCrop& crop,
+                     JSAMPARRAY* rowbuffer, JSAMPARRAY planeRows[3], int* width, int* height)
 {
-    /* cinfo->err really points to a my_error_mgr struct, so coerce pointer */
-    my_error_ptr myerr = (my_error_ptr) cinfo->err;
-
-    /* Always display the message. */
-    /* We could postpone this until after returning, if we chose. */
-    /*(*cinfo->err->output_message) (cinfo);*/
-
-    /* FIXME: get error messahe from jpeglib */
-
-    /* Return control to the setjmp point */
-    longjmp(myerr->setjmp_buffer, 1);
+    j_decompress_ptr cinfo = &context->cinfo;
+    if (planes.format != VK_FORMAT_UNDEFINED)
+    {
+        allocRawRows(cinfo, planeRows);
+        *width = planes.width[0];
+        *height = planes.height[0];
+    }
+    else
+    {
+        *rowbuffer = context->rowBuffer(static_cast<size_t>(cinfo->output_width) * cinfo->output_components);
+        *width = crop.width;
+        *height = crop.height;
+    }
 }
 
-static void
-my_output_message (j_common_ptr cinfo)
+size_t outputSize(const PlaneLayout& planes, int row_stride, int height)
 {
-  char buffer[JMSG_LENGTH_MAX];
-
-  /* Create the message */
-  (*cinfo->err->format_message) (cinfo, buffer);
-
-  // OSG_WARN<<buffer<<std::endl;
+    return planes.format != VK_FORMAT_UNDEFINED ? planes.size : (size_t)row_stride * height;
 }
 
-
-int
-simage_jpeg_identify(const char *,
-const unsigned char *header,
-int headerlen)
+void readOutputPass(j_decompress_ptr cinfo, JSAMPARRAY rowbuffer, JSAMPARRAY planeRows[3],
+                    unsigned char* buffer, int row_stride, const OutputCrop& crop, const PlaneLayout& planes,
+                    const JPEGDecodeParams& params, const ColorTransform* transform)
 {
-    static unsigned char jpgcmp[] = {'J', 'F', 'I', 'F' };
-    if (headerlen < 4) return 0;
-    if (memcmp((const void*)&header[6],
-        (const void*)jpgcmp, 4) == 0) return 1;
-    return 0;
+    if (planes.format != VK_FORMAT_UNDEFINED)
+        readRawPlanes(cinfo, planeRows, buffer, planes, params.topDown);
+    else
+        readScanlines(cinfo, rowbuffer, buffer, row_stride, crop, params, transform);
 }
 
-
-static unsigned char*
-copyScanline(unsigned char *currPtr, unsigned char *from, int cnt)
+/* Read only the header of a JPEG and work out the dimensions that
+ * simage_jpeg_load() would produce with the same parameters. No
+ * entropy-coded data is read.
+ */
+bool simage_jpeg_probe(DecompressContext* context,
+                       const JPEGInput& input,
+                       const JPEGDecodeParams& params,
+                       int *width_ret,
+                       int *height_ret,
+                       int *numComponents_ret,
+                       unsigned int* exif_orientation,
+                       unsigned int* scale_denom_ret,
+                       unsigned int* full_width_ret,
+                       unsigned int* full_height_ret,
+                       PlaneLayout* planes_ret,
+                       OutputCrop* crop_ret,
+                       J_COLOR_SPACE* color_space_ret,
+                       int* error_ret)
 {
-    memcpy((void*)currPtr, (void*)from, cnt);
-    currPtr -= cnt;
-    return currPtr;
+    struct jpeg_decompress_struct& cinfo = context->cinfo;
+    struct my_error_mgr& jerr = context->jerr;
+
+    *error_ret = ERR_NO_ERROR;
+    if (setjmp(jerr.setjmp_buffer))
+    {
+        VSGSB_DEBUG << "JPEG loader: " << jerr.message << std::endl;
+        *error_ret = ERR_JPEGLIB;
+        jpeg_abort_decompress(&cinfo);
+        return false;
+    }
+    if (input.data)
+        context->memorySource(input.data, input.size);
+    else
+        context->istreamSource(input.stream);
+    jpeg_save_markers (&cinfo, EXIF_JPEG_MARKER, 0xffff);
+    jpeg_save_markers (&cinfo, ICC_JPEG_MARKER, 0xffff);
+    (void) jpeg_read_header(&cinfo, TRUE);
+    *exif_orientation = EXIF_Orientation (&cinfo);
+    /* Describe the image that readJPG() will decode instead */
+    if (params.applyOrientation && orientHeader(&cinfo, *exif_orientation))
+        *exif_orientation = 1;
+    *full_width_ret = cinfo.image_width;
+    *full_height_ret = cinfo.image_height;
+    *color_space_ret = cinfo.jpeg_color_space;
+    *numComponents_ret = setDecompressParams(&cinfo, params, scale_denom_ret, planes_ret);
+    (void) prepareColorTransform(context, params, *numComponents_ret, *planes_ret);
+    jpeg_calc_output_dimensions(&cinfo);
+    if (!requestedCrop(params, &cinfo, *scale_denom_ret, crop_ret))
+    {
+        *error_ret = ERR_REGION;
+        jpeg_abort_decompress(&cinfo);
+        return false;
+    }
+    *width_ret = planes_ret->format != VK_FORMAT_UNDEFINED ? planes_ret->width[0] : crop_ret->width;
+    *height_ret = planes_ret->format != VK_FORMAT_UNDEFINED ? planes_ret->height[0] : crop_ret->height;
+    jpeg_abort_decompress(&cinfo);
+    return true;
 }
 
-unsigned char* simage_jpeg_load(std::istream& fin,
+unsigned char* simage_jpeg_load(DecompressContext* context,
+                                const JPEGInput& input,
+                                const JPEGDecodeParams& params,
                                 int *width_ret,
                                 int *height_ret,
                                 int *numComponents_ret,
-                                unsigned int* exif_orientation)
+                                unsigned int* exif_orientation,
+                                unsigned int* scale_denom_ret,
+                                unsigned int* full_width_ret,
+                                unsigned int* full_height_ret,
+                                PlaneLayout* planes_ret,
+                                OutputCrop* crop_ret,
+                                int* error_ret)
 {
-    int width;
-    int height;
-    unsigned char *currPtr;
     int format;
     /* This struct contains the JPEG decompression parameters and pointers to
      * working space (which is allocated as needed by the JPEG library).
+     * It comes from the pool, already created, and is reset when it
+     * goes back.
      */
-    struct jpeg_decompress_struct cinfo;
-    /* We use our private extension JPEG error handler.
-     * Note that this struct must live as long as the main JPEG parameter
-     * struct, to avoid dangling-pointer problems.
+    struct jpeg_decompress_struct& cinfo = context->cinfo;
+    /* We use our private extension JPEG error handler, which lives in
+     * the context alongside cinfo.
      */
-    struct my_error_mgr jerr;
+    struct my_error_mgr& jerr = context->jerr;
     /* More stuff */
     //FILE * infile;               /* source file */
-    JSAMPARRAY rowbuffer;        /* Output row buffer */
-    int row_stride;              /* physical row width in output buffer */
+    JSAMPARRAY planeRows[3];     /* Output rows of each component, for raw data */
 
-    jpegerror = ERR_NO_ERROR;
+    *error_ret = ERR_NO_ERROR;
 
     /* In this example we want to open the input file before doing anything else,
      * so that the setjmp() error recovery below can assume the file is open.
@@ -486,45 +846,48 @@ unsigned char* simage_jpeg_load(std::istream& fin,
 
     /*if ((infile = fopen(filename, "rb")) == NULL)
     {
-        jpegerror = ERR_OPEN;
+        *error_ret = ERR_OPEN;
         return NULL;
     }*/
 
-    /* Step 1: allocate and initialize JPEG decompression object */
+    /* Step 1: the JPEG decompression object was initialized by the pool */
 
-    /* We set up the normal JPEG error routines, then override error_exit. */
-    cinfo.err = jpeg_std_error(&jerr.pub);
-    jerr.pub.error_exit = my_error_exit;
-    jerr.pub.output_message = my_output_message;
     /* Establish the setjmp return context for my_error_exit to use. */
     if (setjmp(jerr.setjmp_buffer))
     {
         /* If we get here, the JPEG code has signaled an error.
          * We need to clean up the JPEG object, close the input file, and return.
          */
-        jpegerror = ERR_JPEGLIB;
-        jpeg_destroy_decompress(&cinfo);
+        VSGSB_DEBUG << "JPEG loader: " << jerr.message << std::endl;
+        *error_ret = ERR_JPEGLIB;
+        jpeg_abort_decompress(&cinfo);
         //fclose(infile);
-        //if (buffer) delete [] buffer;
+        delete [] jerr.buffer;
+        jerr.buffer = NULL;
         return NULL;
     }
 
     // used to be before setjump above, but have moved to after to avoid compile warnings.
     unsigned char *buffer = NULL;
-
-    /* Now we can initialize the JPEG decompression object. */
-    jpeg_create_decompress(&cinfo);
+    int row_stride = 0;          /* physical row width in output buffer */
+    JSAMPARRAY rowbuffer = NULL; /* Output row buffer */
+    int width = 0;
+    int height = 0;
 
     /* Step 2: specify data source (eg, a file) */
 
     //jpeg_stdio_src(&cinfo, infile);
-    jpeg_istream_src(&cinfo,&fin);
+    if (input.data)
+        context->memorySource(input.data, input.size);
+    else
+        context->istreamSource(input.stream);
 
 
 
     /* Step 3: read file parameters with jpeg_read_header() */
 
     jpeg_save_markers (&cinfo, EXIF_JPEG_MARKER, 0xffff);
+    jpeg_save_markers (&cinfo, ICC_JPEG_MARKER, 0xffff);
 
     (void) jpeg_read_header(&cinfo, TRUE);
     /* We can ignore the return value from jpeg_read_header since
@@ -541,76 +904,161 @@ unsigned char* simage_jpeg_load(std::istream& fin,
     }
 
     /* Step 4: set parameters for decompression */
-    /* In this example, we don't need to change any of the defaults set by
-     * jpeg_read_header(), so we do nothing here.
-     */
+    *full_width_ret = cinfo.image_width;
+    *full_height_ret = cinfo.image_height;
+    format = setDecompressParams(&cinfo, params, scale_denom_ret, planes_ret);
+    const ColorTransform* transform = prepareColorTransform(context, params, format, *planes_ret);
+    jpeg_calc_output_dimensions(&cinfo);
+    if (!requestedCrop(params, &cinfo, *scale_denom_ret, crop_ret))
+    {
+        *error_ret = ERR_REGION;
+        jpeg_abort_decompress(&cinfo);
+        return NULL;
+    }
 
     /* Step 5: Start decompressor */
-    if (cinfo.jpeg_color_space == JCS_GRAYSCALE)
+
+    /* A large image in memory with restart markers can be decoded in
+     * bands on several threads. If its markers don't allow that,
+     * decode it normally.
+     */
+    bool decoded = false;
+    if (input.data && params.numThreads > 1 && cinfo.restart_interval != 0 && !cinfo.progressive_mode
+        && planes_ret->format == VK_FORMAT_UNDEFINED && !crop_ret->cropped && cinfo.out_color_space != JCS_CMYK)
     {
-        format = 1;
-        cinfo.out_color_space = JCS_GRAYSCALE;
+        if (cinfo.output_width * cinfo.output_height >= MIN_PARALLEL_PIXELS)
+        {
+            row_stride = cinfo.output_width * cinfo.output_components;
+            buffer = new unsigned char [row_stride * cinfo.output_height];
+            jerr.buffer = buffer;
+            decoded = decodeParallel(input, &cinfo, params.numThreads, buffer, row_stride,
+                                     params.topDown);
+        }
     }
-    else                         /* use rgb */
+    if (decoded)
     {
-        format = 3;
-        cinfo.out_color_space = JCS_RGB;
+        width = cinfo.output_width;
+        height = cinfo.output_height;
+        jpeg_abort_decompress(&cinfo);
+        if (transform)
+        {
+            const bool bgr = isBGR(requestedColorSpace(params));
+            for (int y = 0; y < height; ++y)
+                transform->convert(buffer + (size_t)y * row_stride, width, format, bgr);
+        }
     }
+    else if (cinfo.progressive_mode && (params.progress || params.maxScans > 0))
+    {
+        /* Buffered-image mode: the scans are absorbed into the
+         * coefficient buffer one at a time, and an output pass
+         * produces the image as refined so far.
+         */
+        cinfo.buffered_image = TRUE;
+        (void) jpeg_start_decompress(&cinfo);
+        JDIMENSION full_output_width = cinfo.output_width;
+        bool allocated = false;
+        for (;;)
+        {
+            /* Absorb the next scan, and the markers up to the start of
+             * the one after it, to find out if it was the last one.
+             * Without a callback, keep going until the last scan that
+             * will be output.
+             */
+            int status;
+            int scans;
+            bool complete;
+            do
+            {
+                do
+                {
+                    status = jpeg_consume_input(&cinfo);
+                } while (status != JPEG_REACHED_SOS && status != JPEG_REACHED_EOI);
+                complete = status == JPEG_REACHED_EOI;
+                scans = complete ? cinfo.input_scan_number : cinfo.input_scan_number - 1;
+            } while (!complete && !params.progress
+                     && (params.maxScans == 0 || scans < (int)params.maxScans));
+
+            (void) jpeg_start_output(&cinfo, scans);
+            startCrop(&cinfo, full_output_width, crop_ret);
+            if (!allocated)
+            {
+                row_stride = crop_ret->width * format;
+                allocOutputRows(context, *planes_ret, *crop_ret, &rowbuffer, planeRows, &width, &height);
+                allocated = true;
+            }
+            buffer = new unsigned char [outputSize(*planes_ret, row_stride, height)];
+            jerr.buffer = buffer;
+            readOutputPass(&cinfo, rowbuffer, planeRows, buffer, row_stride, *crop_ret, *planes_ret, params,
+                           transform);
+            (void) jpeg_finish_output(&cinfo);
+            if (complete || (params.maxScans > 0 && scans >= (int)params.maxScans))
+            {
+                break;
+            }
+            /* The callback's image owns the buffer from here on. */
+            jerr.buffer = NULL;
+            deliverScan(context, params, buffer, width, height, format, *planes_ret, scans,
+                        *exif_orientation, *scale_denom_ret, *full_width_ret, *full_height_ret, *crop_ret);
+            buffer = NULL;
+        }
+        /* Don't read any scans that weren't used */
+        jpeg_abort_decompress(&cinfo);
+    }
+    else
+    {
+        (void) jpeg_start_decompress(&cinfo);
+        /* We can ignore the return value since suspension is not possible
+         * with the stdio data source.
+         */
+        startCrop(&cinfo, cinfo.output_width, crop_ret);
 
-    (void) jpeg_start_decompress(&cinfo);
-    /* We can ignore the return value since suspension is not possible
-     * with the stdio data source.
-     */
+        /* We may need to do some setup of our own at this point before reading
+         * the data.  After jpeg_start_decompress() we have the correct scaled
+         * output image dimensions available, as well as the output colormap
+         * if we asked for color quantization.
+         * In this example, we need to make an output work buffer of the right size.
+         */
+        /* JSAMPLEs per row in output buffer */
+        row_stride = crop_ret->width * format;
+        /* Make a one-row-high sample array that will go away when done with image */
+        allocOutputRows(context, *planes_ret, *crop_ret, &rowbuffer, planeRows, &width, &height);
+        if (!buffer)
+        {
+            buffer = new unsigned char [outputSize(*planes_ret, row_stride, height)];
+            jerr.buffer = buffer;
+        }
 
-    /* We may need to do some setup of our own at this point before reading
-     * the data.  After jpeg_start_decompress() we have the correct scaled
-     * output image dimensions available, as well as the output colormap
-     * if we asked for color quantization.
-     * In this example, we need to make an output work buffer of the right size.
-     */
-    /* JSAMPLEs per row in output buffer */
-    row_stride = cinfo.output_width * cinfo.output_components;
-    /* Make a one-row-high sample array that will go away when done with image */
-    rowbuffer = (*cinfo.mem->alloc_sarray)
-        ((j_common_ptr) &cinfo, JPOOL_IMAGE, row_stride, 1);
-    width = cinfo.output_width;
-    height = cinfo.output_height;
-    buffer = currPtr = new unsigned char [width*height*cinfo.output_components];
-
-    /* Step 6: while (scan lines remain to be read) */
-    /*           jpeg_read_scanlines(...); */
-
-    /* Here we use the library's state variable cinfo.output_scanline as the
-     * loop counter, so that we don't have to keep track ourselves.
-     */
+        /* Step 6: while (scan lines remain to be read) */
+        /*           jpeg_read_scanlines(...); */
 
-    /* flip image upside down */
-    if (buffer)
-    {
-        currPtr = buffer + row_stride * (cinfo.output_height-1);
+        /* Here we use the library's state variable cinfo.output_scanline as the
+         * loop counter, so that we don't have to keep track ourselves.
+         */
 
-        while (cinfo.output_scanline < cinfo.output_height)
+        if (buffer)
         {
-            /* jpeg_read_scanlines expects an array of pointers to scanlines.
-             * Here the array is only one element long, but you could ask for
-             * more than one scanline at a time if that's more convenient.
-             */
-            (void) jpeg_read_scanlines(&cinfo, rowbuffer, 1);
-            /* Assume put_scanline_someplace wants a pointer and sample count. */
-            currPtr = copyScanline(currPtr, rowbuffer[0], row_stride);
+            readOutputPass(&cinfo, rowbuffer, planeRows, buffer, row_stride, *crop_ret, *planes_ret, params,
+                           transform);
         }
+        /* Step 7: Finish decompression */
+
+        /* The rows below a region were never read */
+        if (crop_ret->cropped)
+            jpeg_abort_decompress(&cinfo);
+        else
+            (void) jpeg_finish_decompress(&cinfo);
+        /* We can ignore the return value since suspension is not possible
+         * with the stdio data source.
+         */
     }
-    /* Step 7: Finish decompression */
-
-    (void) jpeg_finish_decompress(&cinfo);
-    /* We can ignore the return value since suspension is not possible
-     * with the stdio data source.
-     */
 
-    /* Step 8: Release JPEG decompression object */
+    /* Step 8: Release the memory of this image */
 
-    /* This is an important step since it will release a good deal of memory. */
-    jpeg_destroy_decompress(&cinfo);
+    /* This is an important step since it will release a good deal of memory.
+     * The object itself is kept, and goes back to the pool.
+     */
+    jpeg_abort_decompress(&cinfo);
+    jerr.buffer = NULL;
 
     /* After finish_decompress, we can close the input file.
      * Here we postpone it until after no more JPEG errors are possible,
@@ -632,7 +1080,7 @@ unsigned char* simage_jpeg_load(std::istream& fin,
     }
     else
     {
-        jpegerror = ERR_MEM;
+        *error_ret = ERR_MEM;
     }
     return buffer;
 }
@@ -640,232 +1088,514 @@ unsigned char* simage_jpeg_load(std::istream& fin,
 
 namespace
 {
-#if 0
-bool write_JPEG_file (std::ostream &fout, const osg::Image &img, int quality = 100) const
+/* The libjpeg color space of the pixels of an image that can be
+ * written as a JPEG, and the number of bytes in each pixel. The
+ * alpha of 4 component images is dropped by the color converter.
+ * BGR and 4 component images need libjpeg-turbo's color space
+ * extensions.
+ */
+bool jpegInputFormat(VkFormat format, J_COLOR_SPACE* colorSpace, int* components)
 {
-    if (!img.isDataContiguous())
+    switch (format)
     {
-        // OSG_WARN<<"Warning: Writing of image data, that is non contiguous, is not supported by JPEG plugin."<<std::endl;
-        return WriteResult::ERROR_IN_WRITING_FILE;
+    case VK_FORMAT_R8_UNORM:
+    case VK_FORMAT_R8_SRGB:
+        *colorSpace = JCS_GRAYSCALE;
+        *components = 1;
+        return true;
+    case VK_FORMAT_R8G8B8_UNORM:
+    case VK_FORMAT_R8G8B8_SRGB:
+        *colorSpace = JCS_RGB;
+        *components = 3;
+        return true;
+#ifdef JCS_EXTENSIONS
+    case VK_FORMAT_B8G8R8_UNORM:
+    case VK_FORMAT_B8G8R8_SRGB:
+        *colorSpace = JCS_EXT_BGR;
+        *components = 3;
+        return true;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        *colorSpace = JCS_EXT_RGBX;
+        *components = 4;
+        return true;
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+        *colorSpace = JCS_EXT_BGRX;
+        *components = 4;
+        return true;
+#endif
+    default:
+        return false;
     }
+}
 
-    int image_width = img.s();
-    int image_height = img.t();
-    if ( (image_width == 0) || (image_height == 0) )
+/* Encode image, which is stored bottom row first like the images that
+ * the reader returns, or top row first if it has an ImageOrigin that
+ * says so. Large images are encoded in strips on several threads.
+ */
+bool writeJPG(const vsg::Data* image, std::ostream& fout, const vsg::Options* options)
+{
+    JPEGEncodeParams params;
+    if (!jpegInputFormat(image->getFormat(), &params.colorSpace, &params.components))
     {
-        // OSG_DEBUG << "ReaderWriterJPEG::write_JPEG_file - Error no size" << std::endl;
+        VSGSB_DEBUG << "JPEG writer: unsupported format " << image->getFormat() << std::endl;
         return false;
     }
-
-    J_COLOR_SPACE image_color_space = JCS_RGB;
-    int image_components = 3;
-    // Only cater for gray, alpha and RGB for now
-    switch(img.getPixelFormat()) {
-    case(GL_DEPTH_COMPONENT):
-    case(GL_LUMINANCE):
-    case(GL_ALPHA): {
-        image_color_space = JCS_GRAYSCALE;
-        image_components = 1;
-        break;
-    }
-    case(GL_RGB): {
-        image_color_space = JCS_RGB;
-        image_components = 3;
-        break;
+    params.width = image->width();
+    params.height = image->height();
+    params.rowStride = static_cast<std::size_t>(params.width) * params.components;
+    if (params.width == 0 || params.height == 0 || image->depth() > 1
+        || image->dataSize() != params.rowStride * params.height)
+    {
+        VSGSB_DEBUG << "JPEG writer: image has no data or an unexpected layout" << std::endl;
+        return false;
     }
-    default:
+    params.pixels = static_cast<const unsigned char*>(image->dataPointer());
+    auto origin = ImageOrigin::get(const_cast<vsg::Data*>(image));
+    params.bottomUp = !origin || origin->origin != ImageOrigin::TopLeft;
+
+    unsigned int quality = 100;
+    unsigned int numThreads = 0;
+    if (options)
     {
-        // OSG_DEBUG << "ReaderWriterJPEG::write_JPEG_file - Error pixel format non supported" << std::endl;
-        return false; break;
+        options->getValue(ReaderWriter_jpeg::quality, quality);
+        options->getValue(ReaderWriter_jpeg::numThreads, numThreads);
     }
+    params.quality = static_cast<int>(std::min(std::max(quality, 1u), 100u));
+    if (numThreads == 0)
+    {
+        numThreads = hardwareThreads();
     }
 
-    JSAMPLE* image_buffer = (JSAMPLE*)(img.data());
-
-    /* This struct contains the JPEG compression parameters and pointers to
-     * working space (which is allocated as needed by the JPEG library).
-     * It is possible to have several such structures, representing multiple
-     * compression/decompression processes, in existence at once.  We refer
-     * to any one struct (and its associated working data) as a "JPEG object".
-     */
-    struct jpeg_compress_struct cinfo;
-    /* This struct represents a JPEG error handler.  It is declared separately
-     * because applications often want to supply a specialized error handler
-     * (see the second half of this file for an example).  But here we just
-     * take the easy way out and use the standard error handler, which will
-     * print a message on stderr and call exit() if compression fails.
-     * Note that this struct must live as long as the main JPEG parameter
-     * struct, to avoid dangling-pointer problems.
-     */
-    struct jpeg_error_mgr jerr;
-    /* More stuff */
-    //FILE * outfile;        /* target file */
-    JSAMPROW row_pointer[1];    /* pointer to JSAMPLE row[s] */
-    int row_stride;        /* physical row width in image buffer */
-
-    /* Step 1: allocate and initialize JPEG compression object */
+    std::string message;
+    bool written;
+    StripResult result = encodeJPEGStrips(params, numThreads, fout, &message);
+    if (result == StripResult::TooSmall)
+        written = encodeJPEG(params, fout, &message);
+    else
+        written = result == StripResult::Written;
+    if (!written)
+    {
+        VSGSB_DEBUG << "JPEG writer: " << message << std::endl;
+    }
+    return written;
+}
+}
 
-    /* We have to set up the error handler first, in case the initialization
-     * step fails.  (Unlikely, but it could happen if you are out of memory.)
-     * This routine fills in the contents of struct jerr, and returns jerr's
-     * address which we place into the link field in cinfo.
-     */
-    cinfo.err = jpeg_std_error(&jerr);
-    /* Now we can initialize the JPEG compression object. */
-    jpeg_create_compress(&cinfo);
+ReaderWriter_jpeg::ReaderWriter_jpeg()
+{
+}
 
-    /* Step 2: specify data destination (eg, a file) */
-    /* Note: steps 2 and 3 can be done in either order. */
+void ReaderWriter_jpeg::setDecompressorPoolSize(unsigned int size)
+{
+    PooledDecompressor::setPoolSize(size);
+}
 
-    /* Here we use the library-supplied code to send compressed data to a
-     * stdio stream.  You can also write your own code to do something else.
-     * VERY IMPORTANT: use "b" option to fopen() if you are on a machine that
-     * requires it in order to write binary files.
-     */
-    /*if (!(outfile = fopen(filename, "wb")))
-      {
-      return WriteResult::ERROR_IN_WRITING_FILE;
-      }*/
+unsigned int ReaderWriter_jpeg::getDecompressorPoolSize()
+{
+    return PooledDecompressor::getPoolSize();
+}
 
-    //jpeg_stdio_dest(&cinfo, outfile);
-    osgDBJPEG::jpeg_stream_dest(&cinfo, &fout);
+bool ReaderWriter_jpeg::hasDecoder(JPEGDecoder decoder)
+{
+    switch (decoder)
+    {
+    case JPEGDecoder::TurboJPEG:
+        return turboJPEGBackend() != nullptr;
+    default:
+        return true;
+    }
+}
 
-    /* Step 3: set parameters for compression */
+/* The backend that decodes an image, or null if the scanline decoder
+ * does. Only the scanline decoder can decode part of an image, its
+ * planes or its scans one at a time.
+ */
+const JPEGDecodeBackend* chooseBackend(const JPEGDecodeParams& params)
+{
+    if (params.region || params.ycbcrPlanes || params.progress || params.maxScans > 0)
+        return nullptr;
+    switch (static_cast<JPEGDecoder>(params.decoder))
+    {
+    case JPEGDecoder::TurboJPEG:
+        return turboJPEGBackend();
+    case JPEGDecoder::STBImage:
+        return stbImageBackend();
+    default:
+        return nullptr;
+    }
+}
 
-    /* First we supply a description of the input image.
-     * Four fields of the cinfo struct must be filled in:
-     */
-    cinfo.image_width = image_width;     /* image width and height, in pixels */
-    cinfo.image_height = image_height;
-    cinfo.input_components = image_components;        /* # of color components per pixel */
-    cinfo.in_color_space = image_color_space;     /* colorspace of input image */
-    /* Now use the library's routine to set default compression parameters.
-     * (You must set at least cinfo.in_color_space before calling this,
-     * since the defaults depend on the source color space.)
-     */
-    jpeg_set_defaults(&cinfo);
-    /* Now you can set any non-default parameters you wish to.
-     * Here we just illustrate the use of quality (quantization table) scaling:
-     */
-    jpeg_set_quality(&cinfo, quality, TRUE /* limit to baseline-JPEG values */);
+/* Decode a JPEG in memory with a backend, to the image that the
+ * scanline decoder would produce. Returns null if the backend can't
+ * decode it.
+ */
+vsg::ref_ptr<vsg::Data> decodeWithBackend(const JPEGDecodeBackend* backend, const JPEGInput& input,
+                                          const JPEGDecodeParams& params)
+{
+    int width = 0;
+    int height = 0;
+    int numComponents = 0;
+    unsigned int exif_orientation = 1;
+    unsigned int scale_denom = 1;
+    unsigned int full_width = 0;
+    unsigned int full_height = 0;
+    PlaneLayout planes;
+    OutputCrop crop;
+    J_COLOR_SPACE colorSpace = JCS_UNKNOWN;
+    int error = ERR_NO_ERROR;
+
+    /* The input has already been oriented, if it could be */
+    JPEGDecodeParams headerParams = params;
+    headerParams.applyOrientation = false;
+    /* The header's ICC profile stays in the decompressor */
+    PooledDecompressor decompressor;
+    if (!simage_jpeg_probe(decompressor.get(), input, headerParams,
+                           &width, &height, &numComponents, &exif_orientation,
+                           &scale_denom, &full_width, &full_height, &planes, &crop, &colorSpace, &error))
+    {
+        return {};
+    }
+    std::string message;
+    if (colorSpace != JCS_YCbCr && colorSpace != JCS_GRAYSCALE && colorSpace != JCS_RGB)
+    {
+        VSGSB_DEBUG << "JPEG loader: " << backend->name() << ": unsupported color space" << std::endl;
+        return {};
+    }
+    JPEGBackendParams backendParams;
+    backendParams.data = input.data;
+    backendParams.size = input.size;
+    backendParams.width = width;
+    backendParams.height = height;
+    backendParams.components = numComponents;
+    backendParams.colorSpace = numComponents == 1 ? JCS_GRAYSCALE : requestedColorSpace(params);
+    backendParams.scaleDenom = scale_denom;
+    backendParams.topDown = params.topDown;
+    backendParams.quality = params.quality;
+    unsigned char* imageData = nullptr;
+    if (backend->supports(backendParams, &message))
+        imageData = backend->decode(backendParams, &message);
+    if (!imageData)
+    {
+        VSGSB_DEBUG << "JPEG loader: " << backend->name() << ": " << message << std::endl;
+        return {};
+    }
+    const ColorTransform& transform = decompressor->colorTransform;
+    if (transform.status() == ColorTransform::Convert)
+    {
+        for (int y = 0; y < height; ++y)
+        {
+            transform.convert(imageData + (size_t)y * width * numComponents, width, numComponents,
+                              isBGR(backendParams.colorSpace));
+        }
+    }
+    auto image = makeImage(imageData, width, height, numComponents, jpegFormat(params, numComponents), planes,
+                           exif_orientation, scale_denom, full_width, full_height, crop, params.topDown,
+                           params.quality);
+    attachProfile(image, decompressor.get());
+    return image;
+}
 
-    /* Step 4: Start compressor */
+/* Apply the EXIF orientation of a JPEG in the DCT domain. Returns the
+ * input to decode: the transformed JPEG, which is stored in oriented,
+ * or the original if there is nothing to do or it can't be
+ * transformed. A stream is read into buffer first.
+ */
+JPEGInput orientInput(const JPEGInput& fin, std::vector<unsigned char>& buffer,
+                      std::vector<unsigned char>& oriented)
+{
+    JPEGInput input = fin;
+    if (!input.data)
+    {
+        buffer.assign(std::istreambuf_iterator<char>(*fin.stream), std::istreambuf_iterator<char>());
+        input = JPEGInput(buffer.data(), buffer.size());
+    }
+    /* The result is decoded straight away, so don't make it progressive */
+    if (normalizeOrientation(input.data, input.size, oriented, false) == OrientResult::Transformed)
+        return JPEGInput(oriented.data(), oriented.size());
+    return input;
+}
 
-    /* TRUE ensures that we will write a complete interchange-JPEG file.
-     * Pass TRUE unless you are very sure of what you're doing.
-     */
-    jpeg_start_compress(&cinfo, TRUE);
+vsg::ref_ptr<vsg::Data> readJPG(const JPEGInput& fin, const vsg::Options* options)
+{
+    unsigned char *imageData = NULL;
+    int width_ret;
+    int height_ret;
+    int numComponents_ret;
+    unsigned int exif_orientation=1;
+    unsigned int scale_denom = 1;
+    unsigned int full_width = 0;
+    unsigned int full_height = 0;
+    PlaneLayout planes;
+    OutputCrop crop;
+    int error = ERR_NO_ERROR;
+
+    JPEGDecodeParams params(options);
+    std::vector<unsigned char> buffer;
+    std::vector<unsigned char> oriented;
+    JPEGInput input = params.applyOrientation ? orientInput(fin, buffer, oriented) : fin;
+    if (const JPEGDecodeBackend* backend = chooseBackend(params))
+    {
+        /* Backends decode from memory */
+        if (!input.data)
+        {
+            buffer.assign(std::istreambuf_iterator<char>(*fin.stream), std::istreambuf_iterator<char>());
+            input = JPEGInput(buffer.data(), buffer.size());
+        }
+        if (auto image = decodeWithBackend(backend, input, params))
+            return image;
+    }
+    PooledDecompressor decompressor;
+    imageData = simage_jpeg_load(decompressor.get(), input, params,
+                                 &width_ret, &height_ret, &numComponents_ret, &exif_orientation,
+                                 &scale_denom, &full_width, &full_height, &planes, &crop, &error);
 
-    /* Step 5: while (scan lines remain to be written) */
-    /*           jpeg_write_scanlines(...); */
+    if (imageData==NULL)
+    {
+        char message[80] = "";
+        simage_jpeg_error(error, message, sizeof(message));
+        VSGSB_DEBUG << message << std::endl;
+        return {};
+    }
 
-    /* Here we use the library's state variable cinfo.next_scanline as the
-     * loop counter, so that we don't have to keep track ourselves.
-     * To keep things simple, we pass one scanline per call; you can pass
-     * more if you wish, though.
-     */
-    row_stride = image_width * image_components;    /* JSAMPLEs per row in image_buffer */
+    auto image = makeImage(imageData, width_ret, height_ret, numComponents_ret,
+                           jpegFormat(params, numComponents_ret), planes,
+                           exif_orientation, scale_denom, full_width, full_height, crop, params.topDown,
+                           params.quality);
+    attachProfile(image, decompressor.get());
+    return image;
+}
 
-    while (cinfo.next_scanline < cinfo.image_height)
+vsg::ref_ptr<ImageInfo> probeJPG(const JPEGInput& fin, const vsg::Options* options)
+{
+    int width_ret;
+    int height_ret;
+    int numComponents_ret;
+    unsigned int exif_orientation=1;
+    unsigned int scale_denom = 1;
+    unsigned int full_width = 0;
+    unsigned int full_height = 0;
+    PlaneLayout planes;
+    OutputCrop crop;
+    J_COLOR_SPACE colorSpace = JCS_UNKNOWN;
+    int error = ERR_NO_ERROR;
+
+    JPEGDecodeParams params(options);
+    PooledDecompressor decompressor;
+    if (!simage_jpeg_probe(decompressor.get(), fin, params,
+                           &width_ret, &height_ret, &numComponents_ret, &exif_orientation,
+                           &scale_denom, &full_width, &full_height, &planes, &crop, &colorSpace, &error))
     {
-        /* jpeg_write_scanlines expects an array of pointers to scanlines.
-         * Here the array is only one element long, but you could pass
-         * more than one scanline at a time if that's more convenient.
-         */
-        row_pointer[0] = & image_buffer[cinfo.next_scanline * row_stride];
-        (void) jpeg_write_scanlines(&cinfo, row_pointer, 1);
+        char message[80] = "";
+        simage_jpeg_error(error, message, sizeof(message));
+        VSGSB_DEBUG << message << std::endl;
+        return {};
     }
+    auto info = ImageInfo::create();
+    info->width = width_ret;
+    info->height = height_ret;
+    info->components = numComponents_ret;
+    info->bitDepth = 8;
+    info->format = planes.format != VK_FORMAT_UNDEFINED ? planes.format : jpegFormat(params, numComponents_ret);
+    info->exif = EXIF::create(static_cast<EXIF::Orientation>(exif_orientation));
+    info->scale = ImageScale::create(scale_denom, full_width, full_height);
+    if (crop.cropped)
+        info->region = cropRegion(crop, scale_denom, full_width, full_height);
+    if (params.topDown)
+        info->origin = ImageOrigin::create(ImageOrigin::TopLeft);
+    info->iccProfile = attachedProfile(decompressor.get());
+    info->quality = DecodeQuality::create(params.quality);
+    return info;
+}
 
-    /* Step 6: Finish compression */
+/* Find the EXIF APP1 segment among the markers before the first scan.
+ * Returns its contents, after the length field, or null.
+ */
+const unsigned char* findEXIFSegment(const unsigned char* data, size_t size, size_t* length_ret)
+{
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+        return nullptr;
+    size_t pos = 2;
+    while (pos + 4 <= size)
+    {
+        if (data[pos] != 0xFF)
+            return nullptr;
+        unsigned int marker = data[pos + 1];
+        if (marker == 0xFF)     /* fill byte */
+        {
+            ++pos;
+            continue;
+        }
+        if (marker == 0xDA || marker == 0xD9) /* SOS or EOI */
+            return nullptr;
+        size_t length = (data[pos + 2] << 8) | data[pos + 3];
+        if (length < 2 || pos + 2 + length > size)
+            return nullptr;
+        if (marker == EXIF_JPEG_MARKER && length >= 8 && memcmp(data + pos + 4, "Exif\0\0", 6) == 0)
+        {
+            *length_ret = length - 2;
+            return data + pos + 4;
+        }
+        pos += 2 + length;
+    }
+    return nullptr;
+}
 
-    jpeg_finish_compress(&cinfo);
-    /* After finish_compress, we can close the output file. */
-    //fclose(outfile);
+/* The same for a stream, which is read only as far as the end of the
+ * EXIF segment.
+ */
+bool readEXIFSegment(std::istream& fin, std::vector<unsigned char>& segment)
+{
+    unsigned char buf[4];
+    if (!fin.read((char*)buf, 2) || buf[0] != 0xFF || buf[1] != 0xD8)
+        return false;
+    for (;;)
+    {
+        if (!fin.read((char*)buf, 2) || buf[0] != 0xFF)
+            return false;
+        while (buf[1] == 0xFF)
+        {
+            if (!fin.read((char*)&buf[1], 1))
+                return false;
+        }
+        if (buf[1] == 0xDA || buf[1] == 0xD9)
+            return false;
+        if (!fin.read((char*)&buf[2], 2))
+            return false;
+        size_t length = (buf[2] << 8) | buf[3];
+        if (length < 2)
+            return false;
+        if (buf[1] == EXIF_JPEG_MARKER)
+        {
+            segment.resize(length - 2);
+            if (!fin.read((char*)segment.data(), segment.size()))
+                return false;
+            if (segment.size() >= 6 && memcmp(segment.data(), "Exif\0\0", 6) == 0)
+                return true;
+        }
+        else
+        {
+            fin.ignore(length - 2);
+        }
+    }
+}
 
-    /* Step 7: release JPEG compression object */
+/* Decode the JPEG thumbnail in an EXIF segment, if there is one. The
+ * thumbnail is stored the same way up as the main image but has no
+ * EXIF data of its own, so it is given the main image's orientation.
+ */
+vsg::ref_ptr<vsg::Data> readThumbnailJPG(const unsigned char* exif, size_t length, const vsg::Options* options)
+{
+    unsigned int offset = 0;
+    unsigned int thumbLength = 0;
+    if (!exif || !EXIF_Thumbnail(exif, length, &offset, &thumbLength))
+        return {};
+    auto image = readJPG(JPEGInput(exif + offset, thumbLength), options);
+    if (image)
+    {
+        int orientation = EXIF_Orientation(exif, length);
+        auto exifData = EXIF::create(orientation > 0 ? static_cast<EXIF::Orientation>(orientation) : EXIF::TopLeft);
+        EXIF::set(image, exifData);
+    }
+    return image;
+}
 
-    /* This is an important step since it will release a good deal of memory. */
-    jpeg_destroy_compress(&cinfo);
+vsg::ref_ptr<vsg::Data> readThumbnailJPG(std::istream& fin, const vsg::Options* options)
+{
+    std::vector<unsigned char> segment;
+    if (!readEXIFSegment(fin, segment))
+        return {};
+    return readThumbnailJPG(segment.data(), segment.size(), options);
+}
 
-    /* And we're done! */
-    return true;
+vsg::ref_ptr<vsg::Object> ReaderWriter_jpeg::read(std::istream& fin,
+                                                  const vsg::ref_ptr<const vsg::Options> options) const
+{
+    bool thumbnailOnly = false;
+    if (options && options->getValue(thumbnail, thumbnailOnly) && thumbnailOnly)
+    {
+        // The main image is read if there is no thumbnail, and a
+        // stream such as a pipe can't be rewound to it, so read the
+        // whole file into memory and go on as for a mapped file.
+        std::vector<unsigned char> buffer((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+        size_t length = 0;
+        const unsigned char* exif = findEXIFSegment(buffer.data(), buffer.size(), &length);
+        if (auto image = readThumbnailJPG(exif, length, options))
+            return image;
+        return readJPG(JPEGInput(buffer.data(), buffer.size()), options);
+    }
+    return readJPG(JPEGInput(fin), options);
 }
-#endif
 
-#if 0
-int getQuality(const osgDB::ReaderWriter::Options *options) const {
-            if(options) {
-                std::istringstream iss(options->getOptionString());
-                std::string opt;
-                while (iss >> opt) {
-                    if(opt=="JPEG_QUALITY") {
-                        int quality;
-                        iss >> quality;
-                        return quality;
-                    }
-                }
-            }
+vsg::ref_ptr<vsg::Object> ReaderWriter_jpeg::read(const vsg::Path& filename,
+                                                  const vsg::ref_ptr<const vsg::Options> options) const
+{
+    auto ext = vsg::fileExtension(filename);
+    if (ext == "jpeg" || ext == "jpg")
+    {
+        vsg::Path filenameToUse = options ? findFile(filename, options) : filename;
+        if (filenameToUse.empty()) return {};
 
-            return 100;
+        MappedFile mappedFile(filenameToUse);
+        if (mappedFile.valid())
+        {
+            bool thumbnailOnly = false;
+            if (options && options->getValue(thumbnail, thumbnailOnly) && thumbnailOnly)
+            {
+                size_t length = 0;
+                const unsigned char* exif = findEXIFSegment(mappedFile.data(), mappedFile.size(), &length);
+                if (auto image = readThumbnailJPG(exif, length, options))
+                    return image;
+            }
+            return readJPG(JPEGInput(mappedFile.data(), mappedFile.size()), options);
         }
-#endif
+
+        std::ifstream fin(filenameToUse, std::ios::in | std::ios::binary);
+        if (!fin) return {};
+        return read(fin, options);
+    }
+    return {};
 }
 
-ReaderWriter_jpeg::ReaderWriter_jpeg()
+vsg::ref_ptr<vsg::Data> ReaderWriter_jpeg::readThumbnail(std::istream& fin,
+                                                         const vsg::ref_ptr<const vsg::Options> options) const
 {
+    return readThumbnailJPG(fin, options);
 }
 
-vsg::ref_ptr<vsg::Data> readJPGStream(std::istream& fin)
+vsg::ref_ptr<vsg::Data> ReaderWriter_jpeg::readThumbnail(const vsg::Path& filename,
+                                                         const vsg::ref_ptr<const vsg::Options> options) const
 {
-    unsigned char *imageData = NULL;
-    int width_ret;
-    int height_ret;
-    int numComponents_ret;
-    unsigned int exif_orientation=1;
-
-    imageData = simage_jpeg_load(fin, &width_ret, &height_ret, &numComponents_ret, &exif_orientation);
-
-    if (imageData==NULL) return {};
+    auto ext = vsg::fileExtension(filename);
+    if (ext == "jpeg" || ext == "jpg")
+    {
+        vsg::Path filenameToUse = options ? findFile(filename, options) : filename;
+        if (filenameToUse.empty()) return {};
 
-    int s = width_ret;
-    int t = height_ret;
+        MappedFile mappedFile(filenameToUse);
+        if (mappedFile.valid())
+        {
+            size_t length = 0;
+            const unsigned char* exif = findEXIFSegment(mappedFile.data(), mappedFile.size(), &length);
+            return readThumbnailJPG(exif, length, options);
+        }
 
-    //int internalFormat = numComponents_ret;
-    vsg::ref_ptr<vsg::Data> result;
-    switch (numComponents_ret)
-    {
-    case 1:
-        result = createArray<std::uint8_t>(s, t, imageData,
-                                           VK_FORMAT_R8_SRGB);
-        break;
-    case 2:
-        result = createArray<vsg::ubvec2>(s, t, imageData,
-                                          VK_FORMAT_R8G8_SRGB);
-        break;
-    case 3:
-        result = createArray<vsg::ubvec3>(s, t, imageData,
-                                          VK_FORMAT_R8G8B8_SRGB);
-        break;
-    case 4:
-        result = createArray<vsg::ubvec4>(s, t, imageData,
-                                          VK_FORMAT_R8G8B8A8_SRGB);
-        break;
-    default:
-        break;
+        std::ifstream fin(filenameToUse, std::ios::in | std::ios::binary);
+        if (!fin) return {};
+        return readThumbnailJPG(fin, options);
     }
-    auto exif = EXIF::create(static_cast<EXIF::Orientation>(exif_orientation));
-    EXIF::set(result, exif);
-    return result;
+    return {};
 }
 
-vsg::ref_ptr<vsg::Object> ReaderWriter_jpeg::read(std::istream& fin,
-                                                  const vsg::ref_ptr<const vsg::Options>) const
+vsg::ref_ptr<ImageInfo> ReaderWriter_jpeg::probe(std::istream& fin,
+                                                 const vsg::ref_ptr<const vsg::Options> options) const
 {
-    return readJPGStream(fin);
+    return probeJPG(JPEGInput(fin), options);
 }
 
-vsg::ref_ptr<vsg::Object> ReaderWriter_jpeg::read(const vsg::Path& filename,
-                                                  const vsg::ref_ptr<const vsg::Options> options) const
+vsg::ref_ptr<ImageInfo> ReaderWriter_jpeg::probe(const vsg::Path& filename,
+                                                 const vsg::ref_ptr<const vsg::Options> options) const
 {
     auto ext = vsg::fileExtension(filename);
     if (ext == "jpeg" || ext == "jpg")
@@ -873,42 +1603,304 @@ vsg::ref_ptr<vsg::Object> ReaderWriter_jpeg::read(const vsg::Path& filename,
         vsg::Path filenameToUse = options ? findFile(filename, options) : filename;
         if (filenameToUse.empty()) return {};
 
+        MappedFile mappedFile(filenameToUse);
+        if (mappedFile.valid())
+            return probeJPG(JPEGInput(mappedFile.data(), mappedFile.size()), options);
+
         std::ifstream fin(filenameToUse, std::ios::in | std::ios::binary);
         if (!fin) return {};
-        return readJPGStream(fin);
+        return probeJPG(JPEGInput(fin), options);
     }
     return {};
 }
 
-#if 0
-virtual WriteResult writeImage(const osg::Image& img,std::ostream& fout,const osgDB::ReaderWriter::Options *options) const
+bool ReaderWriter_jpeg::write(const vsg::Object* object, std::ostream& fout,
+                              const vsg::ref_ptr<const vsg::Options> options) const
+{
+    auto image = dynamic_cast<const vsg::Data*>(object);
+    if (!image) return false;
+    return writeJPG(image, fout, options);
+}
+
+bool ReaderWriter_jpeg::write(const vsg::Object* object, const vsg::Path& filename,
+                              const vsg::ref_ptr<const vsg::Options> options) const
+{
+    auto ext = vsg::fileExtension(filename);
+    if (ext == "jpeg" || ext == "jpg")
+    {
+        auto image = dynamic_cast<const vsg::Data*>(object);
+        if (!image) return false;
+
+        std::ofstream fout(filename, std::ios::out | std::ios::binary);
+        if (!fout) return false;
+        return writeJPG(image, fout, options);
+    }
+    return false;
+}
+
+namespace
+{
+/* How far an incremental decode has got */
+enum class DecodeStage
+{
+    Header,     /* reading the markers up to the first scan */
+    Start,      /* in jpeg_start_decompress() */
+    Allocate,   /* started; the image has to be allocated */
+    Scanlines,  /* reading scanlines */
+    Complete,
+    Failed
+};
+
+/* The state of an incremental decode, which is kept between calls to
+ * decodeAvailable(). It is plain data, as it is changed in the frame
+ * that a libjpeg error longjmps back to.
+ */
+struct IncrementalState
 {
-    osg::ref_ptr<osg::Image> tmp_img = new osg::Image(img);
-    tmp_img->flipVertical();
-    WriteResult::WriteStatus ws = write_JPEG_file(fout, *(tmp_img.get()), getQuality(options));
-    return ws;
+    DecodeStage stage = DecodeStage::Header;
+    bool header = false;
+    int width = 0;
+    int height = 0;
+    int numComponents = 0;
+    unsigned int exif_orientation = 1;
+    unsigned int scale_denom = 1;
+    unsigned int full_width = 0;
+    unsigned int full_height = 0;
+    unsigned char* buffer = nullptr;   /* owned by the image */
+    size_t row_stride = 0;
+    JDIMENSION rows = 0;
+    JSAMPARRAY cmykRow = nullptr;      /* for converting CMYK rows */
+    const ColorTransform* transform = nullptr;
+};
+
+/* Rows passed to each jpeg_read_scanlines() call */
+#define INCREMENTAL_ROWS  16
+
+/* Set up a pooled decompressor to read from input. */
+bool startIncremental(DecompressContext* context, SuspendingInput* input)
+{
+    if (setjmp(context->jerr.setjmp_buffer))
+    {
+        jpeg_abort_decompress(&context->cinfo);
+        return false;
+    }
+    context->suspendingSource(input);
+    jpeg_save_markers(&context->cinfo, EXIF_JPEG_MARKER, 0xffff);
+    jpeg_save_markers(&context->cinfo, ICC_JPEG_MARKER, 0xffff);
+    return true;
 }
 
-virtual WriteResult writeImage(const osg::Image &img,const std::string& fileName, const osgDB::ReaderWriter::Options *options) const
+/* Decode as far as the data in the suspending source allows. The
+ * libjpeg calls return early when it runs out, and are made again
+ * from the same stage next time. Returns at the Allocate stage so that
+ * the image is created outside this frame.
+ */
+void decodeAvailable(DecompressContext* context, const JPEGDecodeParams& params, IncrementalState* state)
 {
-    std::string ext = osgDB::getFileExtension(fileName);
-    if (!acceptsExtension(ext)) return WriteResult::FILE_NOT_HANDLED;
+    struct jpeg_decompress_struct& cinfo = context->cinfo;
+    struct my_error_mgr& jerr = context->jerr;
+    JSAMPROW rows[INCREMENTAL_ROWS];
 
-    osgDB::ofstream fout(fileName.c_str(), std::ios::out | std::ios::binary);
-    if(!fout) return WriteResult::ERROR_IN_WRITING_FILE;
+    if (setjmp(jerr.setjmp_buffer))
+    {
+        state->stage = DecodeStage::Failed;
+        jpeg_abort_decompress(&cinfo);
+        return;
+    }
+    if (state->stage == DecodeStage::Header)
+    {
+        if (jpeg_read_header(&cinfo, TRUE) == JPEG_SUSPENDED)
+            return;
+        PlaneLayout planes;
+        state->exif_orientation = EXIF_Orientation(&cinfo);
+        state->full_width = cinfo.image_width;
+        state->full_height = cinfo.image_height;
+        state->numComponents = setDecompressParams(&cinfo, params, &state->scale_denom, &planes);
+        state->transform = prepareColorTransform(context, params, state->numComponents, planes);
+        jpeg_calc_output_dimensions(&cinfo);
+        state->width = cinfo.output_width;
+        state->height = cinfo.output_height;
+        state->header = true;
+        state->stage = DecodeStage::Start;
+    }
+    if (state->stage == DecodeStage::Start)
+    {
+        /* A progressive JPEG is absorbed whole in here */
+        if (!jpeg_start_decompress(&cinfo))
+            return;
+        state->row_stride = (size_t)cinfo.output_width * state->numComponents;
+        if (cinfo.out_color_space == JCS_CMYK)
+            state->cmykRow = context->rowBuffer((size_t)cinfo.output_width * cinfo.output_components);
+        state->stage = DecodeStage::Allocate;
+        return;
+    }
+    if (state->stage == DecodeStage::Scanlines)
+    {
+        /* CMYK rows are converted one at a time */
+        while (state->cmykRow && cinfo.output_scanline < cinfo.output_height)
+        {
+            JDIMENSION y = cinfo.output_scanline;
+            if (!params.topDown)
+                y = cinfo.output_height - 1 - y;
+            JDIMENSION read = jpeg_read_scanlines(&cinfo, state->cmykRow, 1);
+            state->rows = cinfo.output_scanline;
+            if (read == 0)
+                return;
+            convertCMYKRow(state->cmykRow[0], state->buffer + y * state->row_stride, cinfo.output_width,
+                           requestedColorSpace(params), cinfo.saw_Adobe_marker);
+        }
+        /* Other rows go straight into the image */
+        while (cinfo.output_scanline < cinfo.output_height)
+        {
+            JDIMENSION count = std::min<JDIMENSION>(INCREMENTAL_ROWS, cinfo.output_height - cinfo.output_scanline);
+            for (JDIMENSION i = 0; i < count; ++i)
+            {
+                JDIMENSION y = cinfo.output_scanline + i;
+                if (!params.topDown)
+                    y = cinfo.output_height - 1 - y;
+                rows[i] = state->buffer + y * state->row_stride;
+            }
+            JDIMENSION read = jpeg_read_scanlines(&cinfo, rows, count);
+            if (state->transform)
+            {
+                for (JDIMENSION i = 0; i < read; ++i)
+                {
+                    state->transform->convert(rows[i], cinfo.output_width, state->numComponents,
+                                              isBGR(requestedColorSpace(params)));
+                }
+            }
+            state->rows = cinfo.output_scanline;
+            if (read == 0)
+                return;
+        }
+        /* Whatever follows the last scanline isn't needed */
+        jpeg_abort_decompress(&cinfo);
+        state->stage = DecodeStage::Complete;
+    }
+}
+}
 
-    return writeImage(img,fout,options);
+struct IncrementalJPEGDecoder::Implementation
+{
+    Implementation(const vsg::Options* options)
+        : params(options)
+    {
+        /* Only the scale, output format and row order apply */
+        params.ycbcrPlanes = false;
+        params.applyOrientation = false;
+        params.progress = nullptr;
+        params.region = nullptr;
+    }
+
+    void decode()
+    {
+        for (;;)
+        {
+            decodeAvailable(decompressor.get(), params, &state);
+            if (state.header && !info)
+            {
+                info = ImageInfo::create();
+                info->width = state.width;
+                info->height = state.height;
+                info->components = state.numComponents;
+                info->bitDepth = 8;
+                info->format = jpegFormat(params, state.numComponents);
+                info->exif = EXIF::create(static_cast<EXIF::Orientation>(state.exif_orientation));
+                info->scale = ImageScale::create(state.scale_denom, state.full_width, state.full_height);
+                if (params.topDown)
+                    info->origin = ImageOrigin::create(ImageOrigin::TopLeft);
+                info->iccProfile = attachedProfile(decompressor.get());
+                info->quality = DecodeQuality::create(params.quality);
+            }
+            if (state.stage != DecodeStage::Allocate)
+                break;
+            state.buffer = new unsigned char [state.row_stride * state.height];
+            image = makeImage(state.buffer, state.width, state.height, state.numComponents,
+                              jpegFormat(params, state.numComponents), PlaneLayout(),
+                              state.exif_orientation, state.scale_denom, state.full_width, state.full_height,
+                              OutputCrop(), params.topDown, params.quality);
+            attachProfile(image, decompressor.get());
+            state.stage = DecodeStage::Scanlines;
+        }
+        if (state.stage == DecodeStage::Failed)
+        {
+            message = decompressor->jerr.message;
+            VSGSB_DEBUG << "JPEG loader: " << message << std::endl;
+        }
+    }
+
+    JPEGDecodeParams params;
+    PooledDecompressor decompressor;
+    SuspendingInput input;
+    IncrementalState state;
+    vsg::ref_ptr<ImageInfo> info;
+    vsg::ref_ptr<vsg::Data> image;
+    std::string message;
+};
+
+IncrementalJPEGDecoder::IncrementalJPEGDecoder(vsg::ref_ptr<const vsg::Options> options)
+    : _implementation(new Implementation(options))
+{
+    if (!startIncremental(_implementation->decompressor.get(), &_implementation->input))
+    {
+        _implementation->state.stage = DecodeStage::Failed;
+        _implementation->message = _implementation->decompressor->jerr.message;
+    }
 }
-#endif
 
-const std::string exifKey("vsgsandbox/exif");
+IncrementalJPEGDecoder::~IncrementalJPEGDecoder()
+{
+}
+
+IncrementalJPEGDecoder::Status IncrementalJPEGDecoder::push(const void* data, std::size_t size)
+{
+    Implementation& impl = *_implementation;
+    if (impl.state.stage == DecodeStage::Complete || impl.state.stage == DecodeStage::Failed || impl.input.finished)
+        return status();
+    jpeg_suspending_append(&impl.decompressor->cinfo, static_cast<const unsigned char*>(data), size);
+    impl.decode();
+    return status();
+}
+
+IncrementalJPEGDecoder::Status IncrementalJPEGDecoder::finish()
+{
+    Implementation& impl = *_implementation;
+    if (impl.state.stage == DecodeStage::Complete || impl.state.stage == DecodeStage::Failed || impl.input.finished)
+        return status();
+    impl.input.finished = true;
+    impl.decode();
+    return status();
+}
+
+IncrementalJPEGDecoder::Status IncrementalJPEGDecoder::status() const
+{
+    switch (_implementation->state.stage)
+    {
+    case DecodeStage::Complete:
+        return Complete;
+    case DecodeStage::Failed:
+        return Failed;
+    default:
+        return NeedMoreData;
+    }
+}
+
+vsg::ref_ptr<ImageInfo> IncrementalJPEGDecoder::info() const
+{
+    return _implementation->info;
+}
+
+vsg::ref_ptr<vsg::Data> IncrementalJPEGDecoder::image() const
+{
+    return _implementation->image;
+}
 
-vsg::ref_ptr<EXIF> EXIF::get(vsg::Object* obj)
+std::uint32_t IncrementalJPEGDecoder::rowsDecoded() const
 {
-    return vsg::ref_ptr<EXIF>(obj->getObject<EXIF>(exifKey));
+    return _implementation->state.rows;
 }
 
-void EXIF::set(vsg::Object* obj, EXIF* exif)
+const std::string& IncrementalJPEGDecoder::message() const
 {
-    obj->setObject(exifKey, exif);
+    return _implementation->message;
 }
@@ -13,60 +13,267 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 </editor-fold> */
 
 #include <vsgsandbox/Export.h>
+#include <vsg/core/Data.h>
 #include <vsg/io/ReaderWriter.h>
 
+#include "ReaderWriter_sandbox/ImageMetadata.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
 namespace vsgsandbox
 {
-    class VSGSANDBOX_DECLSPEC EXIF : public vsg::Inherit<vsg::Object, EXIF>
+    // Receives the intermediate images of a progressive JPEG. Each
+    // one is a complete vsg::Data, decoded from the first scan scans
+    // of the file, with the same format, dimensions and auxilliary
+    // data as the final image. The callback is called
+    // on the thread that is reading the file; the final image is
+    // returned by read() and isn't passed to the callback.
+    class VSGSANDBOX_DECLSPEC ProgressiveCallback : public vsg::Inherit<vsg::Object, ProgressiveCallback>
     {
     public:
-        // Positions of the "0th row and 0th column"" when the
-        // picture was taken. TopLeft is the normal orientation.
-        // Note that the jpeg reader actually writes out the bottom row first.
-        // Another view of the image's orientation from
-        // http://sylvana.net/jpegcrop/exif_orientation.html:
-        /*
-          Here is another description given by Adam M. Costello:
-
-          For convenience, here is what the letter F would look like if it were tagged correctly
-          and displayed by a program that ignores the orientation tag (thus showing the stored image): 
-          1        2       3      4         5            6           7          8
-
-          888888  888888      88  88      8888888888  88                  88  8888888888
-          88          88      88  88      88  88      88  88          88  88      88  88
-          8888      8888    8888  8888    88          8888888888  8888888888          88
-          88          88      88  88
-          88          88  888888  888888
-        */
-        enum Orientation
-        {
-            TopLeft = 1,
-            TopRight,
-            BottomRight,
-            BottomLeft,
-            LeftTop,
-            RightTop,
-            RightBottom,
-            LeftBottom
-        };
-        EXIF(Orientation orient = TopLeft)
-            : orientation(orient)
+        using Function = std::function<void(vsg::ref_ptr<vsg::Data> image, unsigned int scan)>;
+        ProgressiveCallback(Function func = {})
+            : refined(func)
         {
         }
-        Orientation orientation;
-        // Getter / setter for use as VSG auxilliary data
-        static vsg::ref_ptr<EXIF> get(vsg::Object* obj);
-        static void set(vsg::Object* obj, EXIF* exif);
+        Function refined;
+    };
+
+    // The decoders that ReaderWriter_jpeg can use; see
+    // ReaderWriter_jpeg::decoder.
+    enum class JPEGDecoder : unsigned int
+    {
+        Auto,
+        // libjpeg's scanline interface, which supports every option
+        LibJPEG,
+        // The TurboJPEG API; only available if the library was
+        // built with TurboJPEG
+        TurboJPEG,
+        // The stb_image decoder in third-party/tinygltf, which needs
+        // no libraries; full resolution only
+        STBImage
     };
 
     class VSGSANDBOX_DECLSPEC ReaderWriter_jpeg : public vsg::Inherit<vsg::ReaderWriter, ReaderWriter_jpeg>
     {
     public:
+        // Keys of vsg::Options values understood by read().
+        //
+        // unsigned int: decode at 1/1, 1/2, 1/4 or 1/8 of full
+        // resolution. The scaling is done in the DCT domain, so the
+        // decoder does correspondingly less work.
+        static constexpr const char* scaleDenominator = "jpeg_scale_denominator";
+        // unsigned int: choose the smallest scale at which the longer
+        // side of the image is still at least this many pixels.
+        // Overrides scaleDenominator.
+        static constexpr const char* targetSize = "jpeg_target_size";
+        // unsigned int: the number of threads that may be used to
+        // decode one large image that has restart markers, or to
+        // encode one large image in write(). 0, the default, uses
+        // one per hardware core; 1 always decodes and encodes
+        // serially.
+        static constexpr const char* numThreads = "jpeg_threads";
+        // ProgressiveCallback object, stored with setObject(): decode
+        // progressive JPEGs one scan at a time and pass each
+        // intermediate image to the callback.
+        static constexpr const char* progressiveCallback = "jpeg_progressive_callback";
+        // unsigned int: stop decoding a progressive JPEG after this
+        // many scans, and return the image as refined so far. Early
+        // scans carry the low frequencies and the high bits of each
+        // coefficient, so a few of them give a usable image for a
+        // fraction of the decoding time. 0, the default, decodes
+        // all of them.
+        static constexpr const char* maxScans = "jpeg_max_scans";
+        // bool: return YCbCr images as their Y, Cb and Cr planes at
+        // the sampling they are stored with, in a multi-planar format
+        // such as VK_FORMAT_G8_B8_R8_3PLANE_420_UNORM, instead of
+        // converting them to RGB. The layout of the planes is
+        // retrieved with ImagePlanes::get(). Images whose sampling
+        // has no multi-planar format are still converted to RGB.
+        static constexpr const char* ycbcrPlanes = "jpeg_ycbcr_planes";
+        // unsigned int: a VkFormat giving the pixel layout that the
+        // image should be decoded to: VK_FORMAT_R8G8B8A8_SRGB,
+        // VK_FORMAT_B8G8R8A8_SRGB or VK_FORMAT_B8G8R8_SRGB. The
+        // pixels are written in that layout by the color converter,
+        // so the image doesn't need to be expanded afterwards.
+        // Grayscale images are expanded to the 4 component formats,
+        // but otherwise stay grayscale. The same key is used by
+        // ReaderWriter_png.
+        static constexpr const char* outputFormat = "image_output_format";
+        // bool: store the image top row first, as it is in the file,
+        // instead of bottom row first. libjpeg then writes the rows
+        // straight into the image, several at a time; an
+        // ImageOrigin of TopLeft is attached, and the image should
+        // be drawn with its texture coordinates flipped vertically.
+        // This applies to planar images and ImageRegion too. The
+        // same key is used by ReaderWriter_png.
+        static constexpr const char* topDown = "image_top_down";
+        // bool: convert the pixels of an image with an embedded ICC
+        // profile for an RGB space built from three primaries and
+        // tone curves, such as Display P3 or Adobe RGB, to sRGB as
+        // it is decoded. True by default. Other profiles, and every
+        // profile if this is false, are attached to the image as an
+        // ICCProfile, as are those of planar images. The same key is
+        // used by ReaderWriter_png.
+        static constexpr const char* convertToSRGB = "image_convert_to_srgb";
+        // std::string: the DecodeQuality to decode with, by name:
+        // "exact", the default, uses libjpeg's accurate integer IDCT
+        // and smooth chroma upsampling; "balanced" uses the fast
+        // integer IDCT, which is typically within a few levels of the
+        // exact pixels; "fast" also replicates chroma samples instead
+        // of interpolating them, which can leave visible steps along
+        // sharp color edges in 4:2:0 and 4:2:2 images, and doesn't
+        // smooth the blocks of a partly decoded progressive JPEG.
+        // The quality is attached to the image as a DecodeQuality.
+        // jpegbench --quality measures the speed and error of each.
+        // The same key is used by ReaderWriter_png.
+        static constexpr const char* decodeQuality = "image_decode_quality";
+        // bool: rotate and flip the image as its EXIF orientation
+        // says before decoding it, so that the returned image has
+        // the orientation TopLeft. This is done losslessly on the
+        // DCT coefficients, at a fraction of the cost of a decode;
+        // a partial MCU on an edge that moves to the top or left is
+        // trimmed off.
+        static constexpr const char* applyOrientation = "jpeg_apply_orientation";
+        // bool: if the file has an EXIF thumbnail, return that
+        // instead of the image; see readThumbnail(). Files without
+        // one are read as usual.
+        static constexpr const char* thumbnail = "jpeg_thumbnail";
+        // ImageRegion object, stored with setObject(): decode only
+        // this rectangle of the image, given in full resolution
+        // pixels even if a scale is set, and in the orientation
+        // after applyOrientation. Only the iMCU columns that cover
+        // it are decoded and the rows above it aren't run through
+        // the IDCT, so a small region of a large image is much
+        // cheaper than the whole. The region is clipped to the
+        // image, and at reduced scale rounded out to whole output
+        // pixels; the rectangle that the image covers is retrieved
+        // from it with ImageRegion::get(). Planar output and
+        // multithreaded decoding aren't used with a region. This
+        // needs libjpeg-turbo; with other libjpegs the region is
+        // ignored and the whole image is decoded.
+        static constexpr const char* region = "jpeg_region";
+        // unsigned int, a JPEGDecoder: the decoder that read() uses.
+        // The other decoders decode a whole file in memory, so a
+        // stream is read in first. If the chosen decoder isn't
+        // available, or can't do what the other options ask, such as
+        // decoding a region, planes or individual scans, or a scale
+        // that stb_image doesn't have, or if it fails, the libjpeg
+        // scanline decoder is used. Auto, the default, chooses the
+        // scanline decoder: stb_image is slower on every class of
+        // image that jpegbench --decoders compares, and TurboJPEG
+        // runs the same IDCT and upsampling code as the scanline
+        // decoder at each decodeQuality.
+        static constexpr const char* decoder = "jpeg_decoder";
+
+        // Keys of vsg::Options values understood by write(), which
+        // also uses numThreads.
+        //
+        // unsigned int: the JPEG quality, from 1 to 100. The default
+        // is 100.
+        static constexpr const char* quality = "jpeg_quality";
+
         ReaderWriter_jpeg();
         // Returns a vsg::Data object. EXIF data is stored in the
-        // auxilliary object; retrieve with EXIF::get().
-        // contains EXIF object.
+        // auxilliary object; retrieve with EXIF::get(). The scale
+        // that the image was decoded at is retrieved with
+        // ImageScale::get(). CMYK and YCCK images, including Adobe's
+        // inverted CMYK, are converted to RGB in the output format.
         vsg::ref_ptr<vsg::Object> read(const vsg::Path& filename, vsg::ref_ptr<const vsg::Options> options = {}) const override;
         vsg::ref_ptr<vsg::Object> read(std::istream& fin, vsg::ref_ptr<const vsg::Options> = {}) const override;
+        // Read only the image header and return what read() would
+        // produce with the same options, or null if the file isn't
+        // a JPEG.
+        vsg::ref_ptr<ImageInfo> probe(const vsg::Path& filename, vsg::ref_ptr<const vsg::Options> options = {}) const;
+        vsg::ref_ptr<ImageInfo> probe(std::istream& fin, vsg::ref_ptr<const vsg::Options> = {}) const;
+        // Decode the small JPEG preview that cameras store in the
+        // EXIF data, typically 160x120, without reading any of the
+        // main image. The other options apply to the thumbnail as
+        // they would to the image. Its EXIF orientation is that of
+        // the main image, even if applyOrientation is set. Returns
+        // null if there is no thumbnail.
+        vsg::ref_ptr<vsg::Data> readThumbnail(const vsg::Path& filename, vsg::ref_ptr<const vsg::Options> options = {}) const;
+        vsg::ref_ptr<vsg::Data> readThumbnail(std::istream& fin, vsg::ref_ptr<const vsg::Options> = {}) const;
+        // Write a vsg::Data whose format is R8, R8G8B8, B8G8R8,
+        // R8G8B8A8 or B8G8R8A8, UNORM or SRGB, stored bottom row
+        // first like the images that read() returns, or top row
+        // first if its ImageOrigin says so; alpha is dropped. The BGR
+        // and 4 component formats need libjpeg-turbo. Large images
+        // are split into strips of MCU rows that are encoded on
+        // several threads and joined with restart markers, and so
+        // written with a restart marker at the end of every MCU row.
+        bool write(const vsg::Object* object, const vsg::Path& filename, vsg::ref_ptr<const vsg::Options> options = {}) const override;
+        bool write(const vsg::Object* object, std::ostream& fout, vsg::ref_ptr<const vsg::Options> = {}) const override;
+
+        // libjpeg decompressors are reused from image to image; each
+        // thread keeps up to this many idle ones, 4 by default. 0
+        // creates and destroys one for every image.
+        static void setDecompressorPoolSize(unsigned int size);
+        static unsigned int getDecompressorPoolSize();
+
+        // Whether the library was built with a decoder
+        static bool hasDecoder(JPEGDecoder decoder);
+    };
+
+    // Decodes a JPEG whose data arrives in pieces, e.g. from a pipe,
+    // a socket or an asynchronous read, without tying up a thread
+    // while it waits. push() decodes as far as the data allows and
+    // returns; the bytes that couldn't be used yet are kept, and
+    // decoding carries on from there at the next push(). One thread
+    // can drive any number of decoders, but each one must only be
+    // used by one thread at a time. A decoder takes its libjpeg
+    // decompressor from the pool of the thread that creates it, and
+    // shouldn't outlive that thread: the decompressor only goes back
+    // to the pool if the decoder is destroyed there while the thread
+    // is still running, and is deleted otherwise.
+    //
+    // The image's rows become available from the top down as they
+    // are decoded, except for progressive JPEGs, which are only
+    // output once all of their scans have arrived.
+    class VSGSANDBOX_DECLSPEC IncrementalJPEGDecoder : public vsg::Inherit<vsg::Object, IncrementalJPEGDecoder>
+    {
+    public:
+        enum Status
+        {
+            NeedMoreData,
+            Complete,
+            Failed
+        };
+        // Of the ReaderWriter_jpeg options, scaleDenominator,
+        // targetSize, outputFormat, topDown, convertToSRGB and
+        // decodeQuality are used.
+        IncrementalJPEGDecoder(vsg::ref_ptr<const vsg::Options> options = {});
+        // Add the next size bytes of the file and decode as much as
+        // possible. Data pushed after the image is complete is
+        // ignored.
+        Status push(const void* data, std::size_t size);
+        // Say that no more data will come. The rows of a truncated
+        // image that couldn't be decoded are filled in, as read()
+        // does, and the image is complete; a file that ends before
+        // its first scan fails.
+        Status finish();
+        Status status() const;
+        // What the header says about the image, once it has been
+        // read; null until then.
+        vsg::ref_ptr<ImageInfo> info() const;
+        // The image, allocated once decoding of its pixels has
+        // started, and null until then. Like the images that read()
+        // returns, its bottom row is stored first unless topDown is
+        // set; the top rowsDecoded() rows are valid.
+        vsg::ref_ptr<vsg::Data> image() const;
+        std::uint32_t rowsDecoded() const;
+        // libjpeg's message, if decoding failed
+        const std::string& message() const;
+
+    protected:
+        virtual ~IncrementalJPEGDecoder();
+
+    private:
+        struct Implementation;
+        std::unique_ptr<Implementation> _implementation;
     };
 }
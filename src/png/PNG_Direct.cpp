@@ -0,0 +1,279 @@
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+#include "PNG_Direct.h"
+#include "PNG_Filter.h"
+#include "PNG_Inflate.h"
+
+#include <cstring>
+#include <memory>
+
+extern "C"
+{
+    #include <zlib.h>
+}
+
+using namespace vsgsandbox;
+
+namespace
+{
+    inline std::uint32_t readBigEndian32(const unsigned char* p)
+    {
+        return (static_cast<std::uint32_t>(p[0]) << 24) | (static_cast<std::uint32_t>(p[1]) << 16)
+            | (static_cast<std::uint32_t>(p[2]) << 8) | p[3];
+    }
+
+    constexpr std::uint32_t chunkName(const char (&name)[5])
+    {
+        return (static_cast<std::uint32_t>(name[0]) << 24) | (static_cast<std::uint32_t>(name[1]) << 16)
+            | (static_cast<std::uint32_t>(name[2]) << 8) | static_cast<std::uint32_t>(name[3]);
+    }
+
+    // libpng's limits on the dimensions of images it reads
+    const std::uint32_t MAX_DIMENSION = 1000000;
+
+    bool validChunkName(const unsigned char* name)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            const unsigned char c = name[i];
+            if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')))
+                return false;
+        }
+        return true;
+    }
+
+    // Expand a row of unfiltered samples to the output layout
+    void convertRow(const unsigned char* src, unsigned char* dst, std::uint32_t width, unsigned int channels,
+                    const PNGPixelLayout& pixels)
+    {
+        const unsigned int red = pixels.bgr ? 2 : 0;
+        const unsigned int blue = pixels.bgr ? 0 : 2;
+        switch (channels)
+        {
+        case 1:
+            for (std::uint32_t x = 0; x < width; ++x, ++src, dst += 4)
+            {
+                dst[0] = dst[1] = dst[2] = src[0];
+                dst[3] = 0xff;
+            }
+            break;
+        case 2:
+            for (std::uint32_t x = 0; x < width; ++x, src += 2, dst += 4)
+            {
+                dst[0] = dst[1] = dst[2] = src[0];
+                dst[3] = src[1];
+            }
+            break;
+        case 3:
+            if (pixels.channels == 4)
+            {
+                for (std::uint32_t x = 0; x < width; ++x, src += 3, dst += 4)
+                {
+                    dst[red] = src[0];
+                    dst[1] = src[1];
+                    dst[blue] = src[2];
+                    dst[3] = 0xff;
+                }
+            }
+            else
+            {
+                for (std::uint32_t x = 0; x < width; ++x, src += 3, dst += 3)
+                {
+                    dst[red] = src[0];
+                    dst[1] = src[1];
+                    dst[blue] = src[2];
+                }
+            }
+            break;
+        case 4:
+            for (std::uint32_t x = 0; x < width; ++x, src += 4, dst += 4)
+            {
+                dst[red] = src[0];
+                dst[1] = src[1];
+                dst[blue] = src[2];
+                dst[3] = src[3];
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+bool vsgsandbox::scanPNGChunks(const unsigned char* data, std::size_t size, bool checkCRC, PNGLayout& layout)
+{
+    static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    if (size < 8 || memcmp(data, signature, 8) != 0)
+        return false;
+
+    enum
+    {
+        BeforeImageData,
+        InImageData,
+        AfterImageData
+    } state = BeforeImageData;
+    bool haveHeader = false;
+    bool havePalette = false;
+    std::size_t pos = 8;
+    for (;;)
+    {
+        if (size - pos < 12)
+            return false;
+        const std::uint32_t length = readBigEndian32(data + pos);
+        if (length > 0x7fffffff || length > size - pos - 12)
+            return false;
+        const unsigned char* type = data + pos + 4;
+        const unsigned char* body = type + 4;
+        if (!validChunkName(type))
+            return false;
+        if (checkCRC && crc32(0L, type, length + 4) != readBigEndian32(body + length))
+            return false;
+        const std::uint32_t name = readBigEndian32(type);
+
+        if (!haveHeader)
+        {
+            if (name != chunkName("IHDR") || length != 13)
+                return false;
+            layout.width = readBigEndian32(body);
+            layout.height = readBigEndian32(body + 4);
+            const unsigned int depth = body[8];
+            const unsigned int colorType = body[9];
+            // Compression method, filter method, interlace method
+            if (layout.width == 0 || layout.width > MAX_DIMENSION || layout.height == 0
+                || layout.height > MAX_DIMENSION || depth != 8 || body[10] != 0 || body[11] != 0 || body[12] != 0)
+            {
+                return false;
+            }
+            switch (colorType)
+            {
+            case 0:
+                layout.channels = 1;
+                break;
+            case 2:
+                layout.channels = 3;
+                break;
+            case 4:
+                layout.channels = 2;
+                break;
+            case 6:
+                layout.channels = 4;
+                break;
+            default:
+                return false;
+            }
+            haveHeader = true;
+        }
+        else if (name == chunkName("IDAT"))
+        {
+            if (state == AfterImageData)
+                return false;
+            state = InImageData;
+            layout.imageData.emplace_back(pos + 8, length);
+        }
+        else
+        {
+            if (state == InImageData)
+                state = AfterImageData;
+            if (name == chunkName("IEND"))
+                return length == 0 && state == AfterImageData;
+            // Only ancillary chunks may come after the image data
+            if ((type[0] & 0x20) == 0 && state != BeforeImageData)
+                return false;
+            if (name == chunkName("PLTE"))
+            {
+                // A suggested palette for a color image
+                if (layout.channels < 3 || havePalette)
+                    return false;
+                havePalette = true;
+            }
+            else if (name == chunkName("tRNS") || name == chunkName("iCCP"))
+            {
+                return false;
+            }
+            else if (state == BeforeImageData && name == chunkName("gAMA"))
+            {
+                // libpng ignores a gAMA or sRGB after the palette
+                if (length != 4 || layout.hasGamma || havePalette)
+                    return false;
+                layout.hasGamma = true;
+                layout.gamma = readBigEndian32(body);
+            }
+            else if (state == BeforeImageData && name == chunkName("sRGB"))
+            {
+                if (length != 1 || body[0] > 3 || layout.hasSRGB || havePalette)
+                    return false;
+                layout.hasSRGB = true;
+            }
+            else if (state == BeforeImageData && name == chunkName("eXIf"))
+            {
+                // As libpng, use the first one with a byte order mark
+                if (!layout.exif && length >= 2 && (body[0] == 'M' || body[0] == 'I') && body[1] == body[0])
+                {
+                    layout.exif = body;
+                    layout.exifSize = length;
+                }
+            }
+            else if ((type[0] & 0x20) == 0)
+            {
+                // An unknown critical chunk, or a second IHDR
+                return false;
+            }
+        }
+        pos += 12 + static_cast<std::size_t>(length);
+    }
+}
+
+bool vsgsandbox::decodePNGImage(const unsigned char* data, const PNGLayout& layout, bool checkAdler,
+                                const PNGPixelLayout& pixels, unsigned char* buffer)
+{
+    const std::size_t rowBytes = static_cast<std::size_t>(layout.width) * layout.channels;
+    const std::size_t filteredSize = (rowBytes + 1) * layout.height;
+    std::unique_ptr<unsigned char[]> filtered(new unsigned char[filteredSize]);
+
+    // The zlib stream may be split over several chunks
+    const unsigned char* stream = data + layout.imageData.front().first;
+    std::size_t streamSize = layout.imageData.front().second;
+    std::vector<unsigned char> joined;
+    if (layout.imageData.size() > 1)
+    {
+        std::size_t total = 0;
+        for (const auto& chunk : layout.imageData)
+            total += chunk.second;
+        joined.reserve(total);
+        for (const auto& chunk : layout.imageData)
+            joined.insert(joined.end(), data + chunk.first, data + chunk.first + chunk.second);
+        stream = joined.data();
+        streamSize = joined.size();
+    }
+    if (!inflateZlib(stream, streamSize, filtered.get(), filteredSize, checkAdler))
+        return false;
+
+    // Rows whose layout changes are unfiltered into a pair of
+    // scratch rows, so that the one above stays available.
+    const std::size_t outputRowBytes = static_cast<std::size_t>(layout.width) * pixels.channels;
+    const bool direct = pixels.channels == layout.channels && !(pixels.bgr && layout.channels >= 3);
+    std::vector<unsigned char> scratch(direct ? 0 : 2 * rowBytes);
+    const unsigned char* previous = nullptr;
+    for (std::uint32_t y = 0; y < layout.height; ++y)
+    {
+        const unsigned char* src = filtered.get() + y * (rowBytes + 1);
+        unsigned char* dst = buffer + (pixels.bottomUp ? layout.height - 1 - y : y) * outputRowBytes;
+        unsigned char* row = direct ? dst : scratch.data() + (y & 1) * rowBytes;
+        if (!unfilterPNGRow(src[0], src + 1, previous, row, rowBytes, layout.channels))
+            return false;
+        if (!direct)
+            convertRow(row, dst, layout.width, layout.channels, pixels);
+        previous = row;
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+// Decoding of the most common kinds of PNG without libpng: 8 bit
+// gray, gray and alpha, RGB and RGBA images that aren't interlaced,
+// held in memory. The chunks are parsed in place, all of the image
+// data is decompressed in one piece by inflateZlib(), and each row is
+// unfiltered straight into the output image. Anything else, including
+// anything out of the ordinary in the chunks, is left to libpng.
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace vsgsandbox
+{
+    // What the chunks of a PNG say about the image
+    struct PNGLayout
+    {
+        std::uint32_t width = 0;
+        std::uint32_t height = 0;
+        unsigned int channels = 0;      // 1 to 4: gray, gray alpha, RGB, RGBA
+        bool hasGamma = false;
+        std::uint32_t gamma = 0;        // from the gAMA chunk, times 100000
+        bool hasSRGB = false;
+        // The first valid eXIf chunk before the image data
+        const unsigned char* exif = nullptr;
+        std::size_t exifSize = 0;
+        // The IDAT chunks, as offset / length pairs
+        std::vector<std::pair<std::size_t, std::size_t>> imageData;
+    };
+
+    // Parse the chunks of the PNG in [data, data + size). Returns
+    // false if the image isn't one that decodePNGImage() handles:
+    // another bit depth or color type, interlaced, with a tRNS or
+    // iCCP chunk, or chunks that are malformed, out of order, unknown
+    // and critical or, if checkCRC, have the wrong CRC; libpng knows
+    // what to do with those.
+    bool scanPNGChunks(const unsigned char* data, std::size_t size, bool checkCRC, PNGLayout& layout);
+
+    // How decodePNGImage() lays out the pixels: with channels
+    // components, which is either the image's own number or 4, to
+    // add an opaque alpha and expand gray to RGB; in BGR order if
+    // bgr; and with the bottom row first if bottomUp. The rows are
+    // packed.
+    struct PNGPixelLayout
+    {
+        unsigned int channels = 0;
+        bool bgr = false;
+        bool bottomUp = true;
+    };
+
+    // Decode the image that scanPNGChunks() found in data into
+    // buffer. Returns false if the image data is corrupt, or if
+    // checkAdler and its checksum is wrong.
+    bool decodePNGImage(const unsigned char* data, const PNGLayout& layout, bool checkAdler,
+                        const PNGPixelLayout& pixels, unsigned char* buffer);
+}
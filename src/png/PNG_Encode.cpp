@@ -0,0 +1,384 @@
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+#include "PNG_Encode.h"
+#include "PNG_Filter.h"
+#include <vsgsandbox/Endian.h>
+
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+extern "C"
+{
+    #include <zlib.h>
+
+    // zlib always exports adler32_combine64 but only declares it for
+    // large-file builds, which excludes MSVC.
+#if !defined(Z_LARGE64) && !defined(Z_WANT64)
+    ZEXTERN uLong ZEXPORT adler32_combine64(uLong, uLong, z_off64_t);
+#endif
+}
+
+using namespace vsgsandbox;
+
+namespace
+{
+    // Bands smaller than this aren't worth compressing on a thread of
+    // their own
+    const std::size_t MIN_BAND_BYTES = 1024 * 1024;
+    // Filtered data passed to each deflate() call
+    const std::size_t BYTES_PER_CALL = 64 * 1024;
+    // Output space added for each deflate() call
+    const std::size_t OUTPUT_STEP = 256 * 1024;
+    // The size of deflate's window, which the dictionary of a band fills
+    const std::size_t WINDOW_SIZE = 32 * 1024;
+    // The size of the IDAT chunks
+    const std::size_t IDAT_SIZE = 1024 * 1024;
+    // PNG's limit on the width and height
+    const std::uint32_t MAX_DIMENSION = 0x7FFFFFFF;
+
+    const unsigned char PNG_SIGNATURE[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+
+    void writeBigEndian32(unsigned char* p, std::uint32_t value)
+    {
+        p[0] = static_cast<unsigned char>(value >> 24);
+        p[1] = static_cast<unsigned char>(value >> 16);
+        p[2] = static_cast<unsigned char>(value >> 8);
+        p[3] = static_cast<unsigned char>(value);
+    }
+
+    void writeChunk(std::ostream& out, const char* type, const unsigned char* data, std::size_t size)
+    {
+        unsigned char header[8];
+        writeBigEndian32(header, static_cast<std::uint32_t>(size));
+        memcpy(header + 4, type, 4);
+        uLong crc = crc32(0L, header + 4, 4);
+        if (size > 0)
+            crc = crc32(crc, data, static_cast<uInt>(size));
+        unsigned char trailer[4];
+        writeBigEndian32(trailer, static_cast<std::uint32_t>(crc));
+        out.write(reinterpret_cast<const char*>(header), 8);
+        out.write(reinterpret_cast<const char*>(data), size);
+        out.write(reinterpret_cast<const char*>(trailer), 4);
+    }
+
+    // Writes the zlib stream as IDAT chunks of IDAT_SIZE bytes,
+    // followed by one with whatever is left when flush() is called.
+    class IDATWriter
+    {
+    public:
+        IDATWriter(std::ostream& out)
+            : _out(out)
+        {
+            _buffer.reserve(IDAT_SIZE);
+        }
+        void write(const unsigned char* data, std::size_t size)
+        {
+            while (size > 0)
+            {
+                const std::size_t count = std::min(size, IDAT_SIZE - _buffer.size());
+                _buffer.insert(_buffer.end(), data, data + count);
+                data += count;
+                size -= count;
+                if (_buffer.size() == IDAT_SIZE)
+                    flush();
+            }
+        }
+        void flush()
+        {
+            if (!_buffer.empty())
+                writeChunk(_out, "IDAT", _buffer.data(), _buffer.size());
+            _buffer.clear();
+        }
+    private:
+        std::ostream& _out;
+        std::vector<unsigned char> _buffer;
+    };
+
+    // The zlib header of a deflate stream with a 32K window, with the
+    // compression level recorded as deflate() records it
+    void zlibHeader(int level, unsigned char* header)
+    {
+        unsigned int levelFlags = 3;
+        if (level < 2)
+            levelFlags = 0;
+        else if (level < 6)
+            levelFlags = 1;
+        else if (level == 6)
+            levelFlags = 2;
+        unsigned int value = (0x78 << 8) | (levelFlags << 6);
+        value += 31 - value % 31;
+        header[0] = static_cast<unsigned char>(value >> 8);
+        header[1] = static_cast<unsigned char>(value & 0xFF);
+    }
+
+    std::size_t pngRowBytes(const PNGEncodeParams& params)
+    {
+        return static_cast<std::size_t>(params.width) * params.channels * (params.bitDepth / 8);
+    }
+
+    // Row y of the image, counted from the top, as PNG stores it: in
+    // RGB order, with 16 bit samples big endian. The row is copied to
+    // buffer and converted there if it isn't like that in the image.
+    const unsigned char* imageRow(const PNGEncodeParams& params, std::uint32_t y, unsigned char* buffer)
+    {
+        if (params.bottomUp)
+            y = params.height - 1 - y;
+        const unsigned char* row = params.pixels + y * params.rowStride;
+        const bool bgr = params.bgr && params.channels >= 3;
+        const bool swap = params.bitDepth > 8 && !isHostBigEndian();
+        if (!bgr && !swap)
+            return row;
+
+        const unsigned int sampleBytes = params.bitDepth / 8;
+        const std::size_t pixelBytes = params.channels * sampleBytes;
+        const std::size_t rowBytes = pngRowBytes(params);
+        memcpy(buffer, row, rowBytes);
+        if (bgr)
+        {
+            for (std::size_t i = 0; i < rowBytes; i += pixelBytes)
+                std::swap_ranges(buffer + i, buffer + i + sampleBytes, buffer + i + 2 * sampleBytes);
+        }
+        if (swap)
+        {
+            for (std::size_t i = 0; i < rowBytes; i += 2)
+                std::swap(buffer[i], buffer[i + 1]);
+        }
+        return buffer;
+    }
+
+    // Filters the rows of the image one after another, starting from
+    // firstRow, each preceded by its filter type byte.
+    class RowFilter
+    {
+    public:
+        RowFilter(const PNGEncodeParams& params, std::uint32_t firstRow)
+            : _params(params), _rowBytes(pngRowBytes(params)),
+              _bytesPerPixel(params.channels * (params.bitDepth / 8)), _buffers(3 * _rowBytes), _next(firstRow)
+        {
+            if (firstRow > 0)
+                _previous = imageRow(_params, firstRow - 1, buffer((firstRow - 1) & 1));
+        }
+
+        std::size_t filteredBytes() const { return _rowBytes + 1; }
+
+        // Filter the next row into filtered, which is filteredBytes()
+        // long.
+        void filterNext(unsigned char* filtered)
+        {
+            const unsigned char* row = imageRow(_params, _next, buffer(_next & 1));
+            if (_params.filter == PNGFilter::Adaptive)
+            {
+                filtered[0] = static_cast<unsigned char>(
+                    filterPNGRowAdaptive(row, _previous, filtered + 1, buffer(2), _rowBytes, _bytesPerPixel));
+            }
+            else
+            {
+                // The filter types are in the same order as PNGFilter
+                const unsigned int type = static_cast<unsigned int>(_params.filter) - 1;
+                filtered[0] = static_cast<unsigned char>(type);
+                filterPNGRow(type, row, _previous, filtered + 1, _rowBytes, _bytesPerPixel);
+            }
+            _previous = row;
+            ++_next;
+        }
+
+    private:
+        // Rows converted from the image alternate between the first
+        // two buffers, so that the row above is still there; the
+        // third is the scratch row of filterPNGRowAdaptive().
+        unsigned char* buffer(unsigned int index)
+        {
+            return _buffers.data() + index * _rowBytes;
+        }
+
+        const PNGEncodeParams& _params;
+        const std::size_t _rowBytes;
+        const unsigned int _bytesPerPixel;
+        std::vector<unsigned char> _buffers;
+        std::uint32_t _next;
+        const unsigned char* _previous = nullptr;
+    };
+
+    // Run deflate() on the input that stream has been given, and
+    // append what it produces to out.
+    bool deflateInto(z_stream& stream, int flush, std::vector<unsigned char>& out)
+    {
+        do
+        {
+            const std::size_t used = out.size();
+            out.resize(used + OUTPUT_STEP);
+            stream.next_out = out.data() + used;
+            stream.avail_out = static_cast<uInt>(OUTPUT_STEP);
+            const int result = deflate(&stream, flush);
+            out.resize(used + OUTPUT_STEP - stream.avail_out);
+            if (result == Z_STREAM_ERROR)
+                return false;
+        } while (stream.avail_out == 0);
+        return true;
+    }
+
+    struct Band
+    {
+        std::uint32_t firstRow;
+        std::uint32_t numRows;
+        std::vector<unsigned char> stream;  // raw deflate data
+        uLong adler;                        // of the filtered rows
+        bool compressed;
+    };
+
+    // Filter and compress the rows of a band. The last band finishes
+    // the deflate stream, and the others end with a sync flush.
+    bool compressBand(const PNGEncodeParams& params, Band& band, bool last)
+    {
+        RowFilter filter(params, band.firstRow);
+        const std::size_t filteredBytes = filter.filteredBytes();
+        const std::uint32_t rowsPerCall = static_cast<std::uint32_t>(std::max<std::size_t>(BYTES_PER_CALL / filteredBytes, 1));
+
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        // libpng's choice of strategy
+        const int strategy = params.filter == PNGFilter::None ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+        if (deflateInit2(&stream, params.level, Z_DEFLATED, -MAX_WBITS, 8, strategy) != Z_OK)
+            return false;
+
+        std::vector<unsigned char> buffer;
+        if (band.firstRow > 0)
+        {
+            // The rows above the band that fill the window, filtered
+            // just as the band before this one filters them
+            const std::uint32_t dictionaryRows = static_cast<std::uint32_t>(
+                std::min<std::size_t>(band.firstRow, (WINDOW_SIZE + filteredBytes - 1) / filteredBytes));
+            RowFilter above(params, band.firstRow - dictionaryRows);
+            buffer.resize(dictionaryRows * filteredBytes);
+            for (std::uint32_t i = 0; i < dictionaryRows; ++i)
+                above.filterNext(&buffer[i * filteredBytes]);
+            const std::size_t size = std::min(buffer.size(), WINDOW_SIZE);
+            deflateSetDictionary(&stream, buffer.data() + buffer.size() - size, static_cast<uInt>(size));
+        }
+
+        buffer.resize(rowsPerCall * filteredBytes);
+        band.adler = adler32(0L, Z_NULL, 0);
+        bool compressed = true;
+        for (std::uint32_t row = 0; row < band.numRows && compressed;)
+        {
+            const std::uint32_t count = std::min(rowsPerCall, band.numRows - row);
+            for (std::uint32_t i = 0; i < count; ++i)
+                filter.filterNext(&buffer[i * filteredBytes]);
+            row += count;
+
+            const uInt size = static_cast<uInt>(count * filteredBytes);
+            band.adler = adler32(band.adler, buffer.data(), size);
+            stream.next_in = buffer.data();
+            stream.avail_in = size;
+            int flush = Z_NO_FLUSH;
+            if (row == band.numRows)
+                flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+            compressed = deflateInto(stream, flush, band.stream);
+        }
+        deflateEnd(&stream);
+        return compressed;
+    }
+}
+
+bool vsgsandbox::encodePNG(const PNGEncodeParams& params, unsigned int numThreads, std::ostream& out,
+                           std::string* message)
+{
+    if (params.width == 0 || params.height == 0 || params.width > MAX_DIMENSION || params.height > MAX_DIMENSION
+        || params.channels < 1 || params.channels > 4 || (params.bitDepth != 8 && params.bitDepth != 16))
+    {
+        if (message)
+            *message = "unsupported image dimensions or layout";
+        return false;
+    }
+
+    const std::size_t filteredBytes = pngRowBytes(params) + 1;
+    const std::size_t imageBytes = filteredBytes * params.height;
+    std::size_t numBands = std::min<std::size_t>(std::max(numThreads, 1u), params.height);
+    numBands = std::max<std::size_t>(std::min(numBands, imageBytes / MIN_BAND_BYTES), 1);
+    const std::uint32_t bandHeight = static_cast<std::uint32_t>((params.height + numBands - 1) / numBands);
+
+    std::vector<Band> bands;
+    for (std::uint32_t firstRow = 0; firstRow < params.height; firstRow += bandHeight)
+    {
+        bands.emplace_back();
+        bands.back().firstRow = firstRow;
+        bands.back().numRows = std::min(bandHeight, params.height - firstRow);
+        bands.back().compressed = false;
+    }
+
+    auto compress = [&params, &bands](std::size_t i)
+    {
+        bands[i].compressed = compressBand(params, bands[i], i + 1 == bands.size());
+    };
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < bands.size(); ++i)
+    {
+        threads.emplace_back(compress, i);
+    }
+    compress(0);
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    uLong adler = bands[0].adler;
+    for (std::size_t i = 0; i < bands.size(); ++i)
+    {
+        if (!bands[i].compressed)
+        {
+            if (message)
+                *message = "zlib error";
+            return false;
+        }
+        if (i > 0)
+            adler = adler32_combine64(adler, bands[i].adler, static_cast<z_off64_t>(bands[i].numRows * filteredBytes));
+    }
+
+    out.write(reinterpret_cast<const char*>(PNG_SIGNATURE), sizeof(PNG_SIGNATURE));
+    unsigned char header[13];
+    writeBigEndian32(header, params.width);
+    writeBigEndian32(header + 4, params.height);
+    header[8] = static_cast<unsigned char>(params.bitDepth);
+    // Gray, gray and alpha, RGB and RGBA
+    const unsigned char colorTypes[4] = {0, 4, 2, 6};
+    header[9] = colorTypes[params.channels - 1];
+    header[10] = 0;     // deflate
+    header[11] = 0;     // the standard filters
+    header[12] = 0;     // not interlaced
+    writeChunk(out, "IHDR", header, sizeof(header));
+
+    IDATWriter idat(out);
+    unsigned char zlibBytes[4];
+    zlibHeader(params.level, zlibBytes);
+    idat.write(zlibBytes, 2);
+    for (const Band& band : bands)
+    {
+        idat.write(band.stream.data(), band.stream.size());
+    }
+    writeBigEndian32(zlibBytes, static_cast<std::uint32_t>(adler));
+    idat.write(zlibBytes, 4);
+    idat.flush();
+    writeChunk(out, "IEND", nullptr, 0);
+
+    out.flush();
+    if (!out)
+    {
+        if (message)
+            *message = "error writing the stream";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+// PNG encoding, with the image data compressed in bands of rows on
+// several threads, as pigz does. Each band is filtered and compressed
+// as raw deflate data with a z_stream of its own, which is given the
+// last 32K of the filtered rows above the band as its dictionary, so
+// it compresses almost as well as if it carried on from them. The
+// bands before the last end with a sync flush, which finishes on a
+// byte boundary without marking the last block, so the bands joined
+// together are a single deflate stream. That is wrapped in a zlib
+// header and the Adler-32 of the whole image data, combined from
+// those of the bands, and written as IDAT chunks.
+
+#include "ReaderWriter_png.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+namespace vsgsandbox
+{
+    struct PNGEncodeParams
+    {
+        const unsigned char* pixels = nullptr;
+        std::uint32_t width = 0;
+        std::uint32_t height = 0;
+        std::size_t rowStride = 0;      // in bytes
+        bool bottomUp = true;           // the first row in pixels is the bottom one
+        unsigned int channels = 0;      // 1 to 4: gray, gray and alpha, RGB or RGBA
+        unsigned int bitDepth = 8;      // 8 or 16; 16 bit samples are in the host's byte order
+        bool bgr = false;               // the first three channels of pixels are in BGR order
+        int level = 6;                  // zlib compression level
+        PNGFilter filter = PNGFilter::Adaptive;
+    };
+
+    // Encode the image to out, compressing it in bands on up to
+    // numThreads threads; small images are compressed serially. The
+    // file depends on the number of bands, but not its pixels. The
+    // image data is all compressed before anything is written, so a
+    // zlib error leaves out untouched. Returns false, with the reason
+    // in message if that isn't null, if encoding failed.
+    bool encodePNG(const PNGEncodeParams& params, unsigned int numThreads, std::ostream& out,
+                   std::string* message = nullptr);
+}
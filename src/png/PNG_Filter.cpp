@@ -0,0 +1,427 @@
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+#include "PNG_Filter.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FILTER_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace vsgsandbox;
+
+namespace
+{
+    enum FilterType
+    {
+        FilterNone,
+        FilterSub,
+        FilterUp,
+        FilterAverage,
+        FilterPaeth
+    };
+
+    void unfilterSub(const unsigned char* filtered, unsigned char* row, std::size_t rowBytes, unsigned int bpp)
+    {
+        memcpy(row, filtered, bpp);
+        for (std::size_t i = bpp; i < rowBytes; ++i)
+            row[i] = static_cast<unsigned char>(filtered[i] + row[i - bpp]);
+    }
+
+    void unfilterUp(const unsigned char* filtered, const unsigned char* previous, unsigned char* row,
+                    std::size_t rowBytes)
+    {
+        std::size_t i = 0;
+#ifdef FILTER_SSE2
+        for (; i + 16 <= rowBytes; i += 16)
+        {
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(filtered + i));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(previous + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(row + i), _mm_add_epi8(x, b));
+        }
+#endif
+        for (; i < rowBytes; ++i)
+            row[i] = static_cast<unsigned char>(filtered[i] + previous[i]);
+    }
+
+    // previous is null for the first row, where the row above counts
+    // as zeros.
+    void unfilterAverage(const unsigned char* filtered, const unsigned char* previous, unsigned char* row,
+                         std::size_t rowBytes, unsigned int bpp)
+    {
+        if (!previous)
+        {
+            memcpy(row, filtered, bpp);
+            for (std::size_t i = bpp; i < rowBytes; ++i)
+                row[i] = static_cast<unsigned char>(filtered[i] + (row[i - bpp] >> 1));
+            return;
+        }
+        for (std::size_t i = 0; i < bpp; ++i)
+            row[i] = static_cast<unsigned char>(filtered[i] + (previous[i] >> 1));
+        for (std::size_t i = bpp; i < rowBytes; ++i)
+            row[i] = static_cast<unsigned char>(filtered[i] + ((row[i - bpp] + previous[i]) >> 1));
+    }
+
+    inline int paethPredictor(int a, int b, int c)
+    {
+        const int pa = std::abs(b - c);
+        const int pb = std::abs(a - c);
+        const int pc = std::abs(a + b - 2 * c);
+        if (pa <= pb && pa <= pc)
+            return a;
+        return pb <= pc ? b : c;
+    }
+
+    void unfilterPaeth(const unsigned char* filtered, const unsigned char* previous, unsigned char* row,
+                       std::size_t rowBytes, unsigned int bpp)
+    {
+        for (std::size_t i = 0; i < bpp; ++i)
+            row[i] = static_cast<unsigned char>(filtered[i] + previous[i]);
+        for (std::size_t i = bpp; i < rowBytes; ++i)
+            row[i] = static_cast<unsigned char>(filtered[i] + paethPredictor(row[i - bpp], previous[i], previous[i - bpp]));
+    }
+
+#ifdef FILTER_SSE2
+    // Pixels are moved in and out of the low bytes of a register. A
+    // 3 byte pixel is moved as a word, except at the end of the row:
+    // the extra byte belongs to the next pixel, which is stored
+    // after it.
+    template<unsigned int BPP>
+    inline __m128i loadPixel(const unsigned char* p, bool last)
+    {
+        std::uint32_t value = 0;
+        if (BPP == 4 || !last)
+            memcpy(&value, p, 4);
+        else
+            memcpy(&value, p, BPP);
+        return _mm_cvtsi32_si128(static_cast<int>(value));
+    }
+
+    template<unsigned int BPP>
+    inline void storePixel(unsigned char* p, __m128i pixel, bool last)
+    {
+        const std::uint32_t value = static_cast<std::uint32_t>(_mm_cvtsi128_si32(pixel));
+        if (BPP == 4 || !last)
+            memcpy(p, &value, 4);
+        else
+            memcpy(p, &value, BPP);
+    }
+
+    template<unsigned int BPP>
+    void unfilterSubSSE2(const unsigned char* filtered, unsigned char* row, std::size_t rowBytes)
+    {
+        __m128i a = _mm_setzero_si128();
+        for (std::size_t i = 0; i < rowBytes; i += BPP)
+        {
+            const bool last = i + BPP == rowBytes;
+            a = _mm_add_epi8(a, loadPixel<BPP>(filtered + i, last));
+            storePixel<BPP>(row + i, a, last);
+        }
+    }
+
+    // _mm_avg_epu8 rounds up; the filter rounds down
+    template<unsigned int BPP>
+    void unfilterAverageSSE2(const unsigned char* filtered, const unsigned char* previous, unsigned char* row,
+                             std::size_t rowBytes)
+    {
+        const __m128i ones = _mm_set1_epi8(1);
+        __m128i a = _mm_setzero_si128();
+        for (std::size_t i = 0; i < rowBytes; i += BPP)
+        {
+            const bool last = i + BPP == rowBytes;
+            const __m128i b = loadPixel<BPP>(previous + i, last);
+            __m128i average = _mm_avg_epu8(a, b);
+            average = _mm_sub_epi8(average, _mm_and_si128(_mm_xor_si128(a, b), ones));
+            a = _mm_add_epi8(average, loadPixel<BPP>(filtered + i, last));
+            storePixel<BPP>(row + i, a, last);
+        }
+    }
+
+    inline __m128i abs16(__m128i x)
+    {
+        return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+    }
+
+    inline __m128i select(__m128i mask, __m128i a, __m128i b)
+    {
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+    }
+
+    // The predictor is computed in 16 bit lanes, with the same tie
+    // breaking as the scalar version.
+    template<unsigned int BPP>
+    void unfilterPaethSSE2(const unsigned char* filtered, const unsigned char* previous, unsigned char* row,
+                           std::size_t rowBytes)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i a = zero;
+        __m128i c = zero;
+        for (std::size_t i = 0; i < rowBytes; i += BPP)
+        {
+            const bool last = i + BPP == rowBytes;
+            const __m128i b = _mm_unpacklo_epi8(loadPixel<BPP>(previous + i, last), zero);
+            const __m128i fromA = _mm_sub_epi16(b, c);
+            const __m128i fromB = _mm_sub_epi16(a, c);
+            const __m128i pa = abs16(fromA);
+            const __m128i pb = abs16(fromB);
+            const __m128i pc = abs16(_mm_add_epi16(fromA, fromB));
+            const __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+            const __m128i predicted = select(_mm_cmpeq_epi16(smallest, pa), a,
+                                             select(_mm_cmpeq_epi16(smallest, pb), b, c));
+            const __m128i pixel = _mm_add_epi8(_mm_packus_epi16(predicted, predicted),
+                                               loadPixel<BPP>(filtered + i, last));
+            storePixel<BPP>(row + i, pixel, last);
+            a = _mm_unpacklo_epi8(pixel, zero);
+            c = b;
+        }
+    }
+#endif
+
+    // The filters that filterPNGRow() applies. Each byte depends only
+    // on the unfiltered rows, so with SSE2 they are done 16 bytes at
+    // a time, or 8 for Paeth, whatever the size of the pixels.
+    void filterSub(const unsigned char* row, unsigned char* filtered, std::size_t rowBytes, unsigned int bpp)
+    {
+        memcpy(filtered, row, bpp);
+        std::size_t i = bpp;
+#ifdef FILTER_SSE2
+        for (; i + 16 <= rowBytes; i += 16)
+        {
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i - bpp));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(filtered + i), _mm_sub_epi8(x, a));
+        }
+#endif
+        for (; i < rowBytes; ++i)
+            filtered[i] = static_cast<unsigned char>(row[i] - row[i - bpp]);
+    }
+
+    void filterUp(const unsigned char* row, const unsigned char* previous, unsigned char* filtered,
+                  std::size_t rowBytes)
+    {
+        std::size_t i = 0;
+#ifdef FILTER_SSE2
+        for (; i + 16 <= rowBytes; i += 16)
+        {
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(previous + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(filtered + i), _mm_sub_epi8(x, b));
+        }
+#endif
+        for (; i < rowBytes; ++i)
+            filtered[i] = static_cast<unsigned char>(row[i] - previous[i]);
+    }
+
+    // previous is null for the first row
+    void filterAverage(const unsigned char* row, const unsigned char* previous, unsigned char* filtered,
+                       std::size_t rowBytes, unsigned int bpp)
+    {
+        if (!previous)
+        {
+            memcpy(filtered, row, bpp);
+            for (std::size_t i = bpp; i < rowBytes; ++i)
+                filtered[i] = static_cast<unsigned char>(row[i] - (row[i - bpp] >> 1));
+            return;
+        }
+        for (std::size_t i = 0; i < bpp; ++i)
+            filtered[i] = static_cast<unsigned char>(row[i] - (previous[i] >> 1));
+        std::size_t i = bpp;
+#ifdef FILTER_SSE2
+        // _mm_avg_epu8 rounds up; the filter rounds down
+        const __m128i ones = _mm_set1_epi8(1);
+        for (; i + 16 <= rowBytes; i += 16)
+        {
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i - bpp));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(previous + i));
+            const __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), ones));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(filtered + i), _mm_sub_epi8(x, average));
+        }
+#endif
+        for (; i < rowBytes; ++i)
+            filtered[i] = static_cast<unsigned char>(row[i] - ((row[i - bpp] + previous[i]) >> 1));
+    }
+
+    void filterPaeth(const unsigned char* row, const unsigned char* previous, unsigned char* filtered,
+                     std::size_t rowBytes, unsigned int bpp)
+    {
+        for (std::size_t i = 0; i < bpp; ++i)
+            filtered[i] = static_cast<unsigned char>(row[i] - previous[i]);
+        std::size_t i = bpp;
+#ifdef FILTER_SSE2
+        // 8 bytes at a time, predicted in 16 bit lanes
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 8 <= rowBytes; i += 8)
+        {
+            const __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + i - bpp)), zero);
+            const __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(previous + i)), zero);
+            const __m128i c = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(previous + i - bpp)),
+                                                zero);
+            const __m128i fromA = _mm_sub_epi16(b, c);
+            const __m128i fromB = _mm_sub_epi16(a, c);
+            const __m128i pa = abs16(fromA);
+            const __m128i pb = abs16(fromB);
+            const __m128i pc = abs16(_mm_add_epi16(fromA, fromB));
+            const __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+            const __m128i predicted = select(_mm_cmpeq_epi16(smallest, pa), a,
+                                             select(_mm_cmpeq_epi16(smallest, pb), b, c));
+            const __m128i x = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + i));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(filtered + i),
+                             _mm_sub_epi8(x, _mm_packus_epi16(predicted, predicted)));
+        }
+#endif
+        for (; i < rowBytes; ++i)
+            filtered[i] = static_cast<unsigned char>(row[i] - paethPredictor(row[i - bpp], previous[i], previous[i - bpp]));
+    }
+
+    // The sum of the absolute values of the bytes taken as signed
+    std::size_t signedSum(const unsigned char* filtered, std::size_t rowBytes)
+    {
+        std::size_t sum = 0;
+        std::size_t i = 0;
+#ifdef FILTER_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        __m128i total = zero;
+        for (; i + 16 <= rowBytes; i += 16)
+        {
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(filtered + i));
+            const __m128i magnitude = _mm_min_epu8(x, _mm_sub_epi8(zero, x));
+            total = _mm_add_epi64(total, _mm_sad_epu8(magnitude, zero));
+        }
+        sum = static_cast<std::uint32_t>(_mm_cvtsi128_si32(total))
+            + static_cast<std::uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(total, 8)));
+#endif
+        for (; i < rowBytes; ++i)
+        {
+            const unsigned int value = filtered[i];
+            sum += value < 128 ? value : 256 - value;
+        }
+        return sum;
+    }
+}
+
+bool vsgsandbox::unfilterPNGRow(unsigned int filter, const unsigned char* filtered, const unsigned char* previous,
+                                unsigned char* row, std::size_t rowBytes, unsigned int bytesPerPixel)
+{
+    // Above the first row everything is zero, which makes Up the
+    // same as None and Paeth the same as Sub.
+    if (!previous)
+    {
+        if (filter == FilterUp)
+            filter = FilterNone;
+        else if (filter == FilterPaeth)
+            filter = FilterSub;
+    }
+    switch (filter)
+    {
+    case FilterNone:
+        memcpy(row, filtered, rowBytes);
+        return true;
+    case FilterSub:
+#ifdef FILTER_SSE2
+        if (bytesPerPixel == 3)
+            unfilterSubSSE2<3>(filtered, row, rowBytes);
+        else if (bytesPerPixel == 4)
+            unfilterSubSSE2<4>(filtered, row, rowBytes);
+        else
+#endif
+            unfilterSub(filtered, row, rowBytes, bytesPerPixel);
+        return true;
+    case FilterUp:
+        unfilterUp(filtered, previous, row, rowBytes);
+        return true;
+    case FilterAverage:
+#ifdef FILTER_SSE2
+        if (previous && bytesPerPixel == 3)
+            unfilterAverageSSE2<3>(filtered, previous, row, rowBytes);
+        else if (previous && bytesPerPixel == 4)
+            unfilterAverageSSE2<4>(filtered, previous, row, rowBytes);
+        else
+#endif
+            unfilterAverage(filtered, previous, row, rowBytes, bytesPerPixel);
+        return true;
+    case FilterPaeth:
+#ifdef FILTER_SSE2
+        if (bytesPerPixel == 3)
+            unfilterPaethSSE2<3>(filtered, previous, row, rowBytes);
+        else if (bytesPerPixel == 4)
+            unfilterPaethSSE2<4>(filtered, previous, row, rowBytes);
+        else
+#endif
+            unfilterPaeth(filtered, previous, row, rowBytes, bytesPerPixel);
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool vsgsandbox::filterPNGRow(unsigned int filter, const unsigned char* row, const unsigned char* previous,
+                              unsigned char* filtered, std::size_t rowBytes, unsigned int bytesPerPixel)
+{
+    if (!previous)
+    {
+        if (filter == FilterUp)
+            filter = FilterNone;
+        else if (filter == FilterPaeth)
+            filter = FilterSub;
+    }
+    switch (filter)
+    {
+    case FilterNone:
+        memcpy(filtered, row, rowBytes);
+        return true;
+    case FilterSub:
+        filterSub(row, filtered, rowBytes, bytesPerPixel);
+        return true;
+    case FilterUp:
+        filterUp(row, previous, filtered, rowBytes);
+        return true;
+    case FilterAverage:
+        filterAverage(row, previous, filtered, rowBytes, bytesPerPixel);
+        return true;
+    case FilterPaeth:
+        filterPaeth(row, previous, filtered, rowBytes, bytesPerPixel);
+        return true;
+    default:
+        return false;
+    }
+}
+
+unsigned int vsgsandbox::filterPNGRowAdaptive(const unsigned char* row, const unsigned char* previous,
+                                              unsigned char* filtered, unsigned char* scratch, std::size_t rowBytes,
+                                              unsigned int bytesPerPixel)
+{
+    // Up and Paeth are the same as None and Sub on the first row
+    const unsigned int lastFilter = previous ? FilterPaeth : FilterAverage;
+    unsigned int best = FilterNone;
+    std::size_t bestSum = signedSum(row, rowBytes);
+    for (unsigned int filter = FilterSub; filter <= lastFilter && bestSum != 0; ++filter)
+    {
+        if (!previous && filter == FilterUp)
+            continue;
+        filterPNGRow(filter, row, previous, scratch, rowBytes, bytesPerPixel);
+        const std::size_t sum = signedSum(scratch, rowBytes);
+        if (sum < bestSum)
+        {
+            memcpy(filtered, scratch, rowBytes);
+            best = filter;
+            bestSum = sum;
+        }
+    }
+    if (best == FilterNone)
+        memcpy(filtered, row, rowBytes);
+    return best;
+}
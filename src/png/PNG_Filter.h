@@ -0,0 +1,51 @@
+#pragma once
+
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+// The filters that PNG applies to the rows of image data before
+// compressing them, and their reconstruction. Rows of 3 and 4 byte
+// pixels are reconstructed a pixel at a time with SSE2 where
+// available; libpng's own vectorized filters are often left out of
+// its builds.
+
+#include <cstddef>
+
+namespace vsgsandbox
+{
+    // Undo the filter of one row of 8 bit image data. filter is the
+    // filter type byte, filtered the rest of the row as it was
+    // decompressed, and previous the reconstructed row above, or null
+    // for the first row. The result, rowBytes long, goes into row,
+    // which mustn't overlap the other two. bytesPerPixel is from 1 to
+    // 8. Returns false if filter isn't a valid filter type.
+    bool unfilterPNGRow(unsigned int filter, const unsigned char* filtered, const unsigned char* previous,
+                        unsigned char* row, std::size_t rowBytes, unsigned int bytesPerPixel);
+
+    // Filter one row of image data for compression, the reverse of
+    // unfilterPNGRow(), with the filter type filter. row is the row,
+    // rowBytes long, and previous the row above, or null for the
+    // first row; the result goes into filtered, without the filter
+    // type byte. 16 bit samples are filtered a byte at a time, as
+    // they are stored in the file. Returns false if filter isn't a
+    // valid filter type.
+    bool filterPNGRow(unsigned int filter, const unsigned char* row, const unsigned char* previous,
+                      unsigned char* filtered, std::size_t rowBytes, unsigned int bytesPerPixel);
+
+    // Filter a row with each of the filters, and keep the one whose
+    // output has the smallest sum of absolute values, taking the
+    // bytes as signed, as libpng does. scratch is rowBytes long.
+    // Returns the filter type.
+    unsigned int filterPNGRowAdaptive(const unsigned char* row, const unsigned char* previous,
+                                      unsigned char* filtered, unsigned char* scratch, std::size_t rowBytes,
+                                      unsigned int bytesPerPixel);
+}
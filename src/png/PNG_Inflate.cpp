@@ -0,0 +1,528 @@
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+#include "PNG_Inflate.h"
+#include <vsgsandbox/Endian.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+extern "C"
+{
+    #include <zlib.h>
+}
+
+using namespace vsgsandbox;
+
+namespace
+{
+    // An entry of a decode table. The low 5 bits are the number of
+    // bits of the codeword that the entry covers, and the next 5 the
+    // number of extra bits that follow the codeword, or the index
+    // bits of a subtable. Then comes the kind of entry, and the top
+    // 16 bits hold the literal, the base of a length or distance, or
+    // the offset of a subtable.
+    enum EntryKind : std::uint32_t
+    {
+        Literal,
+        Length,                 // a length or distance, before its extra bits
+        EndOfBlock,
+        Subtable,
+        Invalid
+    };
+
+    constexpr std::uint32_t makeEntry(EntryKind kind, std::uint32_t value, std::uint32_t extra = 0)
+    {
+        return (value << 16) | (static_cast<std::uint32_t>(kind) << 10) | (extra << 5);
+    }
+
+    inline unsigned entryBits(std::uint32_t entry)
+    {
+        return entry & 31;
+    }
+
+    inline unsigned entryExtra(std::uint32_t entry)
+    {
+        return (entry >> 5) & 31;
+    }
+
+    inline EntryKind entryKind(std::uint32_t entry)
+    {
+        return static_cast<EntryKind>((entry >> 10) & 7);
+    }
+
+    inline unsigned entryValue(std::uint32_t entry)
+    {
+        return entry >> 16;
+    }
+
+    const unsigned MAX_CODE_BITS = 15;
+    const unsigned NUM_LITLEN = 288;
+    const unsigned NUM_DIST = 32;
+    const unsigned NUM_PRECODE = 19;
+
+    // Bits looked up in the first level of each table. Longer codes
+    // go on to a subtable, which has room for the longest code of
+    // the block; there can't be more subtables than symbols.
+    const unsigned LITLEN_BITS = 11;
+    const unsigned DIST_BITS = 8;
+    const unsigned PRECODE_BITS = 7;
+    const unsigned LITLEN_TABLE_SIZE = (1u << LITLEN_BITS) + NUM_LITLEN * (1u << (MAX_CODE_BITS - LITLEN_BITS));
+    const unsigned DIST_TABLE_SIZE = (1u << DIST_BITS) + NUM_DIST * (1u << (MAX_CODE_BITS - DIST_BITS));
+
+    struct DecodeTables
+    {
+        std::uint32_t litlen[LITLEN_TABLE_SIZE];
+        std::uint32_t dist[DIST_TABLE_SIZE];
+        std::uint32_t precode[1u << PRECODE_BITS];
+    };
+
+    // What each symbol of the three codes decodes to
+    struct SymbolEntries
+    {
+        SymbolEntries()
+        {
+            static const std::uint16_t lengthBase[29] = {
+                3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+            static const std::uint8_t lengthExtra[29] = {
+                0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+            static const std::uint16_t distBase[30] = {
+                1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+            static const std::uint8_t distExtra[30] = {
+                0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+            for (unsigned i = 0; i < 256; ++i)
+                litlen[i] = makeEntry(Literal, i);
+            litlen[256] = makeEntry(EndOfBlock, 0);
+            for (unsigned i = 0; i < 29; ++i)
+                litlen[257 + i] = makeEntry(Length, lengthBase[i], lengthExtra[i]);
+            // 286 and 287 only appear in the fixed code, and are errors
+            litlen[286] = litlen[287] = makeEntry(Invalid, 0);
+            for (unsigned i = 0; i < 30; ++i)
+                dist[i] = makeEntry(Length, distBase[i], distExtra[i]);
+            dist[30] = dist[31] = makeEntry(Invalid, 0);
+            for (unsigned i = 0; i < NUM_PRECODE; ++i)
+                precode[i] = makeEntry(Literal, i);
+        }
+        std::uint32_t litlen[NUM_LITLEN];
+        std::uint32_t dist[NUM_DIST];
+        std::uint32_t precode[NUM_PRECODE];
+    };
+
+    const SymbolEntries& symbolEntries()
+    {
+        static const SymbolEntries entries;
+        return entries;
+    }
+
+    unsigned reverseBits(unsigned code, unsigned length)
+    {
+        unsigned result = 0;
+        for (unsigned i = 0; i < length; ++i, code >>= 1)
+            result = (result << 1) | (code & 1);
+        return result;
+    }
+
+    // Build the decode table of a canonical Huffman code in which
+    // symbol i has a codeword of lengths[i] bits, or none if that is
+    // 0, and decodes to entries[i]. Over-subscribed codes are
+    // rejected, as are incomplete ones unless allowIncomplete; even
+    // then, as in zlib, the only incomplete code allowed is one with
+    // a single 1 bit codeword, or none. Unused codewords decode to
+    // Invalid entries.
+    bool buildTable(std::uint32_t* table, unsigned tableBits, const std::uint8_t* lengths,
+                    unsigned numSymbols, const std::uint32_t* entries, bool allowIncomplete)
+    {
+        unsigned count[MAX_CODE_BITS + 1] = {};
+        for (unsigned i = 0; i < numSymbols; ++i)
+            ++count[lengths[i]];
+        count[0] = 0;
+        unsigned maxLength = 0;
+        int left = 1;
+        for (unsigned len = 1; len <= MAX_CODE_BITS; ++len)
+        {
+            left = 2 * left - static_cast<int>(count[len]);
+            if (left < 0)
+                return false;
+            if (count[len] != 0)
+                maxLength = len;
+        }
+        if (left > 0 && (!allowIncomplete || maxLength > 1))
+            return false;
+
+        // Symbols in order of codeword
+        unsigned offsets[MAX_CODE_BITS + 1];
+        offsets[1] = 0;
+        for (unsigned len = 1; len < MAX_CODE_BITS; ++len)
+            offsets[len + 1] = offsets[len] + count[len];
+        std::uint16_t sorted[NUM_LITLEN];
+        for (unsigned i = 0; i < numSymbols; ++i)
+        {
+            if (lengths[i] != 0)
+                sorted[offsets[lengths[i]]++] = static_cast<std::uint16_t>(i);
+        }
+
+        const unsigned mainSize = 1u << tableBits;
+        std::fill(table, table + mainSize, makeEntry(Invalid, 0));
+        unsigned nextSubtable = mainSize;
+        unsigned code = 0;
+        unsigned next = 0;
+        for (unsigned len = 1; len <= maxLength; ++len, code <<= 1)
+        {
+            for (unsigned n = 0; n < count[len]; ++n, ++code, ++next)
+            {
+                const std::uint32_t entry = entries[sorted[next]];
+                const unsigned reversed = reverseBits(code, len);
+                if (len <= tableBits)
+                {
+                    for (unsigned i = reversed; i < mainSize; i += 1u << len)
+                        table[i] = entry | len;
+                    continue;
+                }
+                std::uint32_t& link = table[reversed & (mainSize - 1)];
+                const unsigned subBits = maxLength - tableBits;
+                if (entryKind(link) != Subtable)
+                {
+                    link = makeEntry(Subtable, nextSubtable, subBits) | tableBits;
+                    std::fill(table + nextSubtable, table + nextSubtable + (1u << subBits), makeEntry(Invalid, 0));
+                    nextSubtable += 1u << subBits;
+                }
+                std::uint32_t* subtable = table + entryValue(link);
+                const unsigned subLen = len - tableBits;
+                for (unsigned i = reversed >> tableBits; i < (1u << subBits); i += 1u << subLen)
+                    subtable[i] = entry | subLen;
+            }
+        }
+        return true;
+    }
+
+    // The codes of blocks compressed with fixed Huffman codes
+    struct FixedTables
+    {
+        FixedTables()
+        {
+            std::uint8_t lengths[NUM_LITLEN];
+            std::fill(lengths, lengths + 144, 8);
+            std::fill(lengths + 144, lengths + 256, 9);
+            std::fill(lengths + 256, lengths + 280, 7);
+            std::fill(lengths + 280, lengths + NUM_LITLEN, 8);
+            buildTable(litlen, LITLEN_BITS, lengths, NUM_LITLEN, symbolEntries().litlen, false);
+            std::fill(lengths, lengths + NUM_DIST, 5);
+            buildTable(dist, DIST_BITS, lengths, NUM_DIST, symbolEntries().dist, false);
+        }
+        std::uint32_t litlen[1u << LITLEN_BITS];
+        std::uint32_t dist[1u << DIST_BITS];
+    };
+
+    const FixedTables& fixedTables()
+    {
+        static const FixedTables tables;
+        return tables;
+    }
+
+    inline std::uint64_t loadLittleEndian64(const unsigned char* p)
+    {
+        std::uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        if (isHostBigEndian())
+            swapBytes(reinterpret_cast<char*>(&word), sizeof(word));
+        return word;
+    }
+
+    inline void copy8(unsigned char* dst, const unsigned char* src)
+    {
+        std::uint64_t word;
+        memcpy(&word, src, sizeof(word));
+        memcpy(dst, &word, sizeof(word));
+    }
+
+    // zlib's adler32() takes the length as a uInt
+    unsigned long adler32Of(const unsigned char* data, std::size_t size)
+    {
+        unsigned long adler = adler32(0L, Z_NULL, 0);
+        const std::size_t maxChunk = 1u << 30;
+        for (std::size_t done = 0; done < size; done += maxChunk)
+            adler = adler32(adler, data + done, static_cast<uInt>(std::min(maxChunk, size - done)));
+        return adler;
+    }
+}
+
+bool vsgsandbox::inflateZlib(const unsigned char* data, std::size_t size,
+                             unsigned char* output, std::size_t outputSize, bool checkAdler)
+{
+    if (size < 2)
+        return false;
+    const unsigned cmf = data[0];
+    const unsigned flg = data[1];
+    // Deflate, a window of no more than 32K, no preset dictionary
+    if ((cmf & 0x0f) != 8 || (cmf >> 4) > 7 || (cmf * 256 + flg) % 31 != 0 || (flg & 0x20) != 0)
+        return false;
+
+    const SymbolEntries& entries = symbolEntries();
+    const FixedTables& fixed = fixedTables();
+    std::unique_ptr<DecodeTables> dynamic;
+
+    const unsigned char* in = data + 2;
+    const unsigned char* const inEnd = data + size;
+    unsigned char* out = output;
+    unsigned char* const outEnd = output + outputSize;
+
+    // The bits in the buffer below bitsLeft are those of the input
+    // before in; anything above them is either 0 or the input that
+    // follows, so reloading it does no harm. Past the end of the
+    // input, zeros are added and counted in padding; it is an error
+    // to use them.
+    std::uint64_t bitBuffer = 0;
+    unsigned bitsLeft = 0;
+    std::size_t padding = 0;
+    auto refill = [&]() {
+        if (inEnd - in >= 8)
+        {
+            bitBuffer |= loadLittleEndian64(in) << bitsLeft;
+            in += (63 - bitsLeft) >> 3;
+            bitsLeft |= 56;
+        }
+        else
+        {
+            for (; bitsLeft <= 56; bitsLeft += 8)
+            {
+                if (in < inEnd)
+                    bitBuffer |= static_cast<std::uint64_t>(*in++) << bitsLeft;
+                else
+                    ++padding;
+            }
+        }
+    };
+    auto consume = [&](unsigned bits) {
+        bitBuffer >>= bits;
+        bitsLeft -= bits;
+    };
+    auto takeBits = [&](unsigned bits) {
+        const unsigned value = static_cast<unsigned>(bitBuffer & ((1u << bits) - 1));
+        consume(bits);
+        return value;
+    };
+    // Go to the next byte boundary, and give the whole bytes still in
+    // the bit buffer back to the input.
+    auto alignToByte = [&]() {
+        consume(bitsLeft & 7);
+        if (padding * 8 > bitsLeft)
+            return false;
+        in -= bitsLeft / 8 - padding;
+        bitBuffer = 0;
+        bitsLeft = 0;
+        padding = 0;
+        return true;
+    };
+
+    // Decode a literal / length or distance symbol
+    auto decode = [&](const std::uint32_t* table, unsigned tableBits) {
+        std::uint32_t entry = table[bitBuffer & ((1u << tableBits) - 1)];
+        if (entryKind(entry) == Subtable)
+        {
+            consume(tableBits);
+            entry = table[entryValue(entry) + (bitBuffer & ((1u << entryExtra(entry)) - 1))];
+        }
+        consume(entryBits(entry));
+        return entry;
+    };
+
+    bool finalBlock = false;
+    while (!finalBlock)
+    {
+        refill();
+        finalBlock = takeBits(1) != 0;
+        const unsigned type = takeBits(2);
+        const std::uint32_t* litlen = fixed.litlen;
+        const std::uint32_t* dist = fixed.dist;
+        if (type == 0)
+        {
+            if (!alignToByte() || inEnd - in < 4)
+                return false;
+            const std::size_t length = in[0] | (in[1] << 8);
+            const std::size_t check = in[2] | (in[3] << 8);
+            in += 4;
+            if (length != (~check & 0xffff) || length > static_cast<std::size_t>(inEnd - in)
+                || length > static_cast<std::size_t>(outEnd - out))
+            {
+                return false;
+            }
+            if (length != 0)
+                memcpy(out, in, length);
+            in += length;
+            out += length;
+            continue;
+        }
+        else if (type == 2)
+        {
+            if (!dynamic)
+                dynamic.reset(new DecodeTables);
+            const unsigned numLitlen = takeBits(5) + 257;
+            const unsigned numDist = takeBits(5) + 1;
+            const unsigned numPrecode = takeBits(4) + 4;
+            if (numLitlen > 286 || numDist > 30)
+                return false;
+            static const std::uint8_t precodeOrder[NUM_PRECODE] = {
+                16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+            std::uint8_t lengths[NUM_LITLEN + NUM_DIST] = {};
+            for (unsigned i = 0; i < numPrecode; ++i)
+            {
+                refill();
+                lengths[precodeOrder[i]] = static_cast<std::uint8_t>(takeBits(3));
+            }
+            if (!buildTable(dynamic->precode, PRECODE_BITS, lengths, NUM_PRECODE, entries.precode, false))
+                return false;
+            const unsigned total = numLitlen + numDist;
+            for (unsigned i = 0; i < total;)
+            {
+                refill();
+                const std::uint32_t entry = dynamic->precode[bitBuffer & ((1u << PRECODE_BITS) - 1)];
+                consume(entryBits(entry));
+                const unsigned symbol = entryValue(entry);
+                if (symbol < 16)
+                {
+                    lengths[i++] = static_cast<std::uint8_t>(symbol);
+                    continue;
+                }
+                std::uint8_t value = 0;
+                unsigned repeat;
+                if (symbol == 16)
+                {
+                    if (i == 0)
+                        return false;
+                    value = lengths[i - 1];
+                    repeat = 3 + takeBits(2);
+                }
+                else if (symbol == 17)
+                {
+                    repeat = 3 + takeBits(3);
+                }
+                else
+                {
+                    repeat = 11 + takeBits(7);
+                }
+                if (repeat > total - i)
+                    return false;
+                std::fill(lengths + i, lengths + i + repeat, value);
+                i += repeat;
+            }
+            if (lengths[256] == 0
+                || !buildTable(dynamic->litlen, LITLEN_BITS, lengths, numLitlen, entries.litlen, true)
+                || !buildTable(dynamic->dist, DIST_BITS, lengths + numLitlen, numDist, entries.dist, true))
+            {
+                return false;
+            }
+            litlen = dynamic->litlen;
+            dist = dynamic->dist;
+        }
+        else if (type != 1)
+        {
+            return false;
+        }
+
+        for (;;)
+        {
+            // After a refill there are at least 56 bits, enough for
+            // three literal codes. When there is room in the output
+            // for them, or for the longest match and the overshoot of
+            // copying it a word at a time, nothing more is checked.
+            refill();
+            std::uint32_t entry = decode(litlen, LITLEN_BITS);
+            const bool roomy = outEnd - out >= 258 + 8;
+            if (roomy)
+            {
+                if (entryKind(entry) == Literal)
+                {
+                    *out++ = static_cast<unsigned char>(entryValue(entry));
+                    entry = decode(litlen, LITLEN_BITS);
+                    if (entryKind(entry) == Literal)
+                    {
+                        *out++ = static_cast<unsigned char>(entryValue(entry));
+                        entry = decode(litlen, LITLEN_BITS);
+                        if (entryKind(entry) == Literal)
+                        {
+                            *out++ = static_cast<unsigned char>(entryValue(entry));
+                            continue;
+                        }
+                    }
+                    refill();
+                }
+            }
+            else if (entryKind(entry) == Literal)
+            {
+                if (out == outEnd)
+                    return false;
+                *out++ = static_cast<unsigned char>(entryValue(entry));
+                continue;
+            }
+            if (entryKind(entry) != Length)
+            {
+                if (entryKind(entry) == EndOfBlock)
+                    break;
+                return false;
+            }
+            const std::size_t length = entryValue(entry) + takeBits(entryExtra(entry));
+            entry = decode(dist, DIST_BITS);
+            if (entryKind(entry) != Length)
+                return false;
+            const std::size_t distance = entryValue(entry) + takeBits(entryExtra(entry));
+            if (distance > static_cast<std::size_t>(out - output) || length > static_cast<std::size_t>(outEnd - out))
+                return false;
+
+            const unsigned char* src = out - distance;
+            unsigned char* const end = out + length;
+            if (!roomy && outEnd - end < 8)
+            {
+                while (out < end)
+                    *out++ = *src++;
+            }
+            else if (distance >= 8)
+            {
+                for (; out < end; out += 8, src += 8)
+                    copy8(out, src);
+                out = end;
+            }
+            else if (distance == 1)
+            {
+                memset(out, out[-1], length);
+                out = end;
+            }
+            else
+            {
+                // Each copy gets distance bytes right, and leaves
+                // garbage after them that the next one overwrites.
+                for (; out < end; out += distance, src += distance)
+                    copy8(out, src);
+                out = end;
+            }
+        }
+        if (padding * 8 > bitsLeft)
+            return false;
+    }
+
+    if (!alignToByte() || out != outEnd)
+        return false;
+    if (checkAdler)
+    {
+        if (inEnd - in < 4)
+            return false;
+        const unsigned long expected = (static_cast<unsigned long>(in[0]) << 24) | (in[1] << 16) | (in[2] << 8) | in[3];
+        if (adler32Of(output, outputSize) != expected)
+            return false;
+    }
+    return true;
+}
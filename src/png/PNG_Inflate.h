@@ -0,0 +1,34 @@
+#pragma once
+
+/* <editor-fold desc="MIT License">
+
+Copyright(c) 2020 Tim Moore
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+</editor-fold> */
+
+// A decompressor for zlib streams (RFC 1950 and 1951) that are held
+// entirely in memory and whose decompressed size is known, such as
+// the image data of a PNG. Because it never has to stop part way
+// through and resume, as zlib's inflate() must, it keeps its bit
+// buffer in a register, refills it a word at a time, and copies
+// matches eight bytes at a time.
+
+#include <cstddef>
+
+namespace vsgsandbox
+{
+    // Decompress the zlib stream in [data, data + size) into output,
+    // which has room for exactly outputSize bytes. Returns false if
+    // the stream is corrupt or truncated, or doesn't decompress to
+    // exactly outputSize bytes. The Adler-32 checksum of the output
+    // is only checked if checkAdler; data after the end of the stream
+    // is ignored.
+    bool inflateZlib(const unsigned char* data, std::size_t size,
+                     unsigned char* output, std::size_t outputSize, bool checkAdler);
+}
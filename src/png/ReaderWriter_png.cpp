@@ -13,12 +13,20 @@ Based on the OSG PNG plugin, with  copyright:(c) Robert Osfield
 </editor-fold> */
 
 #include "ReaderWriter_png.h"
+#include "PNG_Direct.h"
+#include "PNG_Encode.h"
+#include "jpeg/EXIF_Orientation.h"
+#include "ReaderWriter_sandbox/ColorProfile.h"
+#include "ReaderWriter_sandbox/MappedFile.h"
 #include <vsgsandbox/Debug.h>
 #include <vsgsandbox/Endian.h>
 #include <vsgsandbox/Utils.h>
 
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 #include <fstream>
+#include <thread>
 
 extern "C"
 {
@@ -74,107 +82,446 @@ void png_read_istream(png_structp png_ptr, png_bytep data, png_size_t length)
     stream->read((char*)data,length); //Read requested amount of data
 }
 
-void png_write_ostream(png_structp png_ptr, png_bytep data, png_size_t length)
+// Where a PNG is read from: a stream, or a block of memory, such as a
+// mapped file or an image embedded in another file, which libpng
+// copies from in place.
+struct PNGInput
 {
-    std::ostream *stream = (std::ostream*)png_get_io_ptr(png_ptr); //Get pointer to ostream
-    stream->write((char*)data,length); //Write requested amount of data
+    PNGInput(std::istream& fin)
+        : stream(&fin)
+    {
+    }
+    PNGInput(const unsigned char* in_data, size_t in_size)
+        : data(in_data), size(in_size)
+    {
+    }
+    std::istream* stream = nullptr;
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    size_t offset = 0;
+};
+
+void png_read_memory(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+    PNGInput* input = (PNGInput*)png_get_io_ptr(png_ptr);
+    if (length > input->size - input->offset)
+        png_error(png_ptr, "Read past end of data");
+    memcpy(data, input->data + input->offset, length);
+    input->offset += length;
 }
 
-void png_flush_ostream(png_structp png_ptr)
+// Check the signature and point libpng at the rest of the input.
+// Returns false if the input isn't a PNG.
+bool setPNGInput(png_structp png, PNGInput& input)
 {
-    std::ostream *stream = (std::ostream*)png_get_io_ptr(png_ptr); //Get pointer to ostream
-    stream->flush();
+    if (input.stream)
+    {
+        unsigned char header[8];
+        input.stream->read((char*)header, 8);
+        if (input.stream->gcount() != 8 || png_sig_cmp(header, 0, 8) != 0)
+            return false;
+        png_set_read_fn(png, input.stream, png_read_istream);
+    }
+    else
+    {
+        if (!input.data || input.size < 8 || png_sig_cmp(input.data, 0, 8) != 0)
+            return false;
+        input.offset = 8;
+        png_set_read_fn(png, &input, png_read_memory);
+    }
+    png_set_sig_bytes(png, 8);
+    return true;
 }
 
-#if 0
-WriteResult::WriteStatus writePngStream(std::ostream& fout, const osg::Image& img, int compression_level) const
+// Set up the transformations that the reader applies to the image
+// data. After png_read_update_info(), png_get_channels() and
+// png_get_bit_depth() describe the pixels that will be returned.
+// outputFormat is the layout requested in the options; returns true
+// if the color channels will be in BGR order. Gamma correction isn't
+// done if applyGamma is false, such as when the pixels will be
+// converted with an ICC profile, whose curves replace it. If
+// keepPalette is set for a palette image, its indices are returned
+// one per byte and the palette is left for pngPalette().
+bool setReadTransforms(png_structp png, png_infop info, int trans, unsigned int outputFormat,
+                       bool applyGamma, bool keepPalette)
 {
-    png_structp png = NULL;
-    png_infop   info = NULL;
-    int color;
-    int bitDepth;
-    png_bytep *rows = NULL;
+    png_uint_32 width, height;
+    int depth, color;
+    double  fileGamma;
 
-    //Create write structure
-    png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    if(!png) return WriteResult::ERROR_IN_WRITING_FILE;
+    png_get_IHDR(png, info, &width, &height, &depth, &color, NULL, NULL, NULL);
+    VSGSB_DEBUG<<"width="<<width<<" height="<<height<<" depth="<<depth<<std::endl;
+    if ( color == PNG_COLOR_TYPE_RGB) { VSGSB_DEBUG << "color == PNG_COLOR_TYPE_RGB "<<std::endl; }
+    if ( color == PNG_COLOR_TYPE_GRAY) { VSGSB_DEBUG << "color == PNG_COLOR_TYPE_GRAY "<<std::endl; }
+    if ( color == PNG_COLOR_TYPE_GRAY_ALPHA) { VSGSB_DEBUG << "color ==  PNG_COLOR_TYPE_GRAY_ALPHA"<<std::endl; }
 
-    //Create infr structure
-    info = png_create_info_struct(png);
-    if(!info) return WriteResult::ERROR_IN_WRITING_FILE;
+    // png default to big endian, so we'll need to swap bytes if on a little endian machine.
+    if (depth>8 && !vsgsandbox::isHostBigEndian())
+        png_set_swap(png);
 
-    //Set custom write function so it will write to ostream
-    png_set_write_fn(png,&fout,png_write_ostream,png_flush_ostream);
 
-    //Set compression level
-    png_set_compression_level(png, compression_level);
+    if (color == PNG_COLOR_TYPE_GRAY || color == PNG_COLOR_TYPE_GRAY_ALPHA)
+    {
+        //png_set_gray_to_rgb(png);
+    }
 
-    switch(img.getPixelFormat()) {
-    case(GL_DEPTH_COMPONENT): color = PNG_COLOR_TYPE_GRAY; break;
-    case(GL_LUMINANCE): color = PNG_COLOR_TYPE_GRAY; break;
-    case(GL_ALPHA): color = PNG_COLOR_TYPE_GRAY; break; //Couldn't find a color type for pure alpha, using gray instead
-    case(GL_LUMINANCE_ALPHA): color = PNG_COLOR_TYPE_GRAY_ALPHA ; break;
-    case(GL_RGB): color = PNG_COLOR_TYPE_RGB; break;
-    case(GL_RGBA): color = PNG_COLOR_TYPE_RGB_ALPHA; break;
-    case(GL_BGR): color = PNG_COLOR_TYPE_RGB; png_set_bgr(png); break;
-    case(GL_BGRA): color = PNG_COLOR_TYPE_RGB_ALPHA; png_set_bgr(png); break;
-    default: return WriteResult::ERROR_IN_WRITING_FILE; break;
+    if (color&PNG_COLOR_MASK_ALPHA && trans != PNG_ALPHA)
+    {
+        png_set_strip_alpha(png);
+        color &= ~PNG_COLOR_MASK_ALPHA;
     }
 
-    //wish there was a Image::computeComponentSizeInBits()
-    unsigned int numComponents = Image::computeNumComponents(img.getPixelFormat());
-    bitDepth = (numComponents>0) ? (Image::computePixelSizeInBits(img.getPixelFormat(),img.getDataType())/numComponents) : 0;
-    if(bitDepth!=8 && bitDepth!=16) return WriteResult::ERROR_IN_WRITING_FILE;
 
-    //Create row data
-    rows = new png_bytep[img.t()];
-    for(int i = 0; i < img.t(); ++i) {
-        rows[i] = (png_bytep)img.data(0,img.t() - i - 1);
+
+    //    if (!(PalettedTextures && mipmap >= 0 && trans == PNG_SOLID))
+    //if (color == PNG_COLOR_TYPE_PALETTE)
+    //    png_set_expand(png);
+
+    // In addition to expanding the palette, we also need to check
+    // to expand greyscale and alpha images.  See libpng man page.
+    if (color == PNG_COLOR_TYPE_PALETTE && !keepPalette)
+        png_set_palette_to_rgb(png);
+    if (color == PNG_COLOR_TYPE_GRAY && depth < 8)
+    {
+#if PNG_LIBPNG_VER >= 10209
+        png_set_expand_gray_1_2_4_to_8(png);
+#else
+        // use older now deprecated but identical call
+        png_set_gray_1_2_4_to_8(png);
+#endif
     }
+    if (png_get_valid(png, info, PNG_INFO_tRNS) && !keepPalette)
+        png_set_tRNS_to_alpha(png);
 
-    //Write header info
-    png_set_IHDR(png, info, img.s(), img.t(),
-                 bitDepth, color, PNG_INTERLACE_NONE,
-                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    // Make sure that files of small depth are packed properly.
+    if (depth < 8)
+        png_set_packing(png);
 
 
-    png_write_info(png, info);
+    /*--GAMMA--*/
+    //    checkForGammaEnv();
+    // XXX Use this to decide whether or not to return an SRGB format
+    // The palette of a kept palette image is corrected in place.
+    double screenGamma = 2.2 / 1.0;
+    if (applyGamma)
+    {
+        if (png_get_gAMA(png, info, &fileGamma))
+            png_set_gamma(png, screenGamma, fileGamma);
+        else
+            png_set_gamma(png, screenGamma, 1.0/2.2);
+    }
 
-    //must take place after png_write_info: png_set_swap verifies 16bit depth before setting transformation flag.
-    if(bitDepth > 8 && getCpuByteOrder()==LittleEndian) png_set_swap(png);
+    // Write the pixels straight into the requested layout. There
+    // are no 16 bit BGR formats, so those stay RGB.
+    if (keepPalette)
+        return false;
+    if (outputFormat == VK_FORMAT_R8G8B8A8_SRGB || outputFormat == VK_FORMAT_B8G8R8A8_SRGB)
+    {
+        if (color == PNG_COLOR_TYPE_GRAY || color == PNG_COLOR_TYPE_GRAY_ALPHA)
+            png_set_gray_to_rgb(png);
+        png_set_filler(png, depth > 8 ? 0xffff : 0xff, PNG_FILLER_AFTER);
+    }
+    bool bgr = depth <= 8
+        && (outputFormat == VK_FORMAT_B8G8R8A8_SRGB || outputFormat == VK_FORMAT_B8G8R8_SRGB);
+    if (bgr)
+        png_set_bgr(png);
+    return bgr;
+}
 
-    //Write data
-    png_write_image(png, rows);
+VkFormat pngFormat(int channels, int depth, bool bgr)
+{
+    if (depth <= 8)
+    {
+        switch(channels)
+        {
+        case 1:
+            return VK_FORMAT_R8_SRGB;
+        case 2:
+            return VK_FORMAT_R8G8_SRGB;
+        case 3:
+            return bgr ? VK_FORMAT_B8G8R8_SRGB : VK_FORMAT_R8G8B8_SRGB;
+        case 4:
+            return bgr ? VK_FORMAT_B8G8R8A8_SRGB : VK_FORMAT_R8G8B8A8_SRGB;
+        default:
+            return VK_FORMAT_UNDEFINED;
+        }
+    }
+    // 16 bit pixels
+    // Not sure what to do with SRGB. Should we convert to
+    // linear color before returning the image? Can we use
+    // png_set_gamma() to do that?
+    switch(channels)
+    {
+    case 1:
+        return VK_FORMAT_R16_UNORM;
+    case 2:
+        return VK_FORMAT_R16G16_UNORM;
+    case 3:
+        return VK_FORMAT_R16G16B16_UNORM;
+    case 4:
+        return VK_FORMAT_R16G16B16A16_UNORM;
+    default:
+        return VK_FORMAT_UNDEFINED;
+    }
+}
+
+unsigned int requestedFormat(const vsg::Options* options)
+{
+    unsigned int format = VK_FORMAT_UNDEFINED;
+    if (options)
+        options->getValue(ReaderWriter_png::outputFormat, format);
+    return format;
+}
 
-    //End write
-    png_write_end(png, NULL);
+bool requestedTopDown(const vsg::Options* options)
+{
+    bool topDown = false;
+    if (options)
+        options->getValue(ReaderWriter_png::topDown, topDown);
+    return topDown;
+}
+
+bool requestedConvertToSRGB(const vsg::Options* options)
+{
+    bool convert = true;
+    if (options)
+        options->getValue(ReaderWriter_png::convertToSRGB, convert);
+    return convert;
+}
 
-    //Cleanup
-    png_destroy_write_struct(&png,&info);
-    delete [] rows;
+// Whether a palette image is to be read as indices
+bool requestedKeepPalette(png_structp png, png_infop info, const vsg::Options* options)
+{
+    bool keepPalette = false;
+    if (options)
+        options->getValue(ReaderWriter_png::keepPalette, keepPalette);
+    return keepPalette && png_get_color_type(png, info) == PNG_COLOR_TYPE_PALETTE;
+}
 
-    return WriteResult::FILE_SAVED;
+DecodeQuality::Quality requestedQuality(const vsg::Options* options)
+{
+    DecodeQuality::Quality quality = DecodeQuality::Exact;
+    std::string name;
+    if (options && options->getValue(ReaderWriter_png::decodeQuality, name)
+        && !DecodeQuality::fromName(name, &quality))
+    {
+        VSGSB_DEBUG << "PNG loader: unknown decode quality " << name << std::endl;
+    }
+    return quality;
 }
+
+// Below Exact, the files are trusted: the CRCs of the chunks and the
+// Adler-32 of the image data aren't computed, so a corrupt file may
+// decode to garbage instead of failing.
+void setDecodeQuality(png_structp png, DecodeQuality::Quality quality)
+{
+    if (quality == DecodeQuality::Exact)
+        return;
+    png_set_crc_action(png, PNG_CRC_QUIET_USE, PNG_CRC_QUIET_USE);
+#if defined(PNG_SET_OPTION_SUPPORTED) && defined(PNG_IGNORE_ADLER32)
+    png_set_option(png, PNG_IGNORE_ADLER32, PNG_OPTION_ON);
 #endif
+}
 
-vsg::ref_ptr<vsg::Object> readPNGStream(std::istream& fin)
+// The contents of an iCCP chunk that comes before the image data
+bool pngProfile(png_structp png, png_infop info, const unsigned char** data, png_uint_32* size)
+{
+#ifdef PNG_iCCP_SUPPORTED
+    png_charp name = NULL;
+    int compression = 0;
+    png_bytep profile = NULL;
+    png_uint_32 length = 0;
+    if (png_get_iCCP(png, info, &name, &compression, &profile, &length) != 0 && profile && length > 0)
+    {
+        *data = profile;
+        *size = length;
+        return true;
+    }
+#endif
+    return false;
+}
+
+// Set up the conversion of the image's ICC profile to sRGB, which is
+// only done for 8 bit color images.
+void preparePNGTransform(png_structp png, png_infop info, const vsg::Options* options,
+                         ColorTransform* transform)
+{
+    const unsigned char* profile = NULL;
+    png_uint_32 size = 0;
+    transform->reset();
+    if (requestedConvertToSRGB(options) && png_get_bit_depth(png, info) <= 8
+        && (png_get_color_type(png, info) & PNG_COLOR_MASK_COLOR) && pngProfile(png, info, &profile, &size))
+    {
+        transform->setProfile(profile, size);
+    }
+}
+
+// The profile that goes with the image: the one in the file, unless
+// the pixels are converted from it or it is sRGB.
+vsg::ref_ptr<ICCProfile> attachedProfile(png_structp png, png_infop info, const ColorTransform& transform)
+{
+    const unsigned char* profile = NULL;
+    png_uint_32 size = 0;
+    if (transform.status() != ColorTransform::Unsupported || !pngProfile(png, info, &profile, &size))
+        return {};
+    return ICCProfile::create(profile, size);
+}
+
+// Orientation from an eXIf chunk that comes before the image data
+EXIF::Orientation pngOrientation(png_structp png, png_infop info)
+{
+#ifdef PNG_eXIf_SUPPORTED
+    png_uint_32 exifLength = 0;
+    png_bytep exifData = NULL;
+    if (png_get_eXIf_1(png, info, &exifLength, &exifData) != 0 && exifData)
+    {
+        int orientation = EXIF_Orientation(exifData, exifLength);
+        if (orientation >= EXIF::TopLeft && orientation <= EXIF::LeftBottom)
+            return static_cast<EXIF::Orientation>(orientation);
+    }
+#endif
+    return EXIF::TopLeft;
+}
+
+// The palette of an image whose indices are kept, with the alpha
+// from its tRNS chunk. png_read_update_info() has gamma corrected
+// it; if the image has a profile that is converted to sRGB, the
+// palette is converted instead of the indices.
+vsg::ref_ptr<ImagePalette> pngPalette(png_structp png, png_infop info, const ColorTransform& transform)
+{
+    png_colorp entries = NULL;
+    int numEntries = 0;
+    png_get_PLTE(png, info, &entries, &numEntries);
+    png_bytep alpha = NULL;
+    int numAlpha = 0;
+    png_get_tRNS(png, info, &alpha, &numAlpha, NULL);
+
+    // libpng expands indices past the end of the palette to black
+    auto colors = vsg::ubvec4Array::create(256);
+    colors->setFormat(VK_FORMAT_R8G8B8A8_SRGB);
+    for (int i = 0; i < 256; ++i)
+    {
+        if (i < numEntries)
+            colors->set(i, vsg::ubvec4(entries[i].red, entries[i].green, entries[i].blue,
+                                       i < numAlpha ? alpha[i] : 0xff));
+        else
+            colors->set(i, vsg::ubvec4(0, 0, 0, 0xff));
+    }
+    if (transform.status() == ColorTransform::Convert)
+        transform.convert(static_cast<unsigned char*>(colors->dataPointer()), 256, 4, false);
+    return ImagePalette::create(colors);
+}
+
+vsg::ref_ptr<vsg::Data> createPNGArray(png_uint_32 width, png_uint_32 height, int channels, int depth,
+                                       png_bytep data, VkFormat format)
+{
+    if (depth <= 8)
+    {
+        switch(channels)
+        {
+        case 1:
+            return createArray<std::uint8_t>(width, height, data, format);
+        case 2:
+            return createArray<vsg::ubvec2>(width, height, data, format);
+        case 3:
+            return createArray<vsg::ubvec3>(width, height, data, format);
+        case 4:
+            return createArray<vsg::ubvec4>(width, height, data, format);
+        default:
+            return {};
+        }
+    }
+    switch(channels)
+    {
+    case 1:
+        return createArray<std::uint16_t>(width, height, data, format);
+    case 2:
+        return createArray<vsg::usvec2>(width, height, data, format);
+    case 3:
+        return createArray<vsg::usvec3>(width, height, data, format);
+    case 4:
+        return createArray<vsg::usvec4>(width, height, data, format);
+    default:
+        return {};
+    }
+}
+
+// Whether libpng leaves the samples alone when it corrects them from
+// the file's gamma to the screen gamma of 2.2 that setReadTransforms()
+// gives it. It ignores corrections of up to 5%; this allows a little
+// less.
+bool gammaIsNoOp(std::uint32_t fileGamma)
+{
+    const std::uint64_t product = static_cast<std::uint64_t>(fileGamma) * 22 / 10;
+    return product >= 96000 && product <= 104000;
+}
+
+// Decode an image held in memory without libpng, if it is one that
+// decodePNGImage() handles and that libpng wouldn't change other than
+// to lay it out as requested. Returns null otherwise, including when
+// the image is corrupt, so that libpng can deal with it.
+vsg::ref_ptr<vsg::Data> readPNGDirect(const PNGInput& input, const vsg::Options* options)
+{
+    if (!input.data)
+        return {};
+    const DecodeQuality::Quality quality = requestedQuality(options);
+    PNGLayout layout;
+    if (!scanPNGChunks(input.data, input.size, quality == DecodeQuality::Exact, layout))
+        return {};
+    if (quality != DecodeQuality::Fast && layout.hasGamma && !gammaIsNoOp(layout.gamma))
+        return {};
+
+    const unsigned int outputFormat = requestedFormat(options);
+    PNGPixelLayout pixels;
+    pixels.channels = layout.channels;
+    if (outputFormat == VK_FORMAT_R8G8B8A8_SRGB || outputFormat == VK_FORMAT_B8G8R8A8_SRGB)
+        pixels.channels = 4;
+    pixels.bgr = outputFormat == VK_FORMAT_B8G8R8A8_SRGB || outputFormat == VK_FORMAT_B8G8R8_SRGB;
+    pixels.bottomUp = !requestedTopDown(options);
+
+    auto data = new unsigned char[static_cast<std::size_t>(layout.width) * layout.height * pixels.channels];
+    if (!decodePNGImage(input.data, layout, quality == DecodeQuality::Exact, pixels, data))
+    {
+        delete [] data;
+        return {};
+    }
+    auto result = createPNGArray(layout.width, layout.height, pixels.channels, 8, data,
+                                 pngFormat(pixels.channels, 8, pixels.bgr));
+    EXIF::Orientation orientation = EXIF::TopLeft;
+#ifdef PNG_eXIf_SUPPORTED
+    if (layout.exif)
+    {
+        int exifOrientation = EXIF_Orientation(layout.exif, static_cast<unsigned int>(layout.exifSize));
+        if (exifOrientation >= EXIF::TopLeft && exifOrientation <= EXIF::LeftBottom)
+            orientation = static_cast<EXIF::Orientation>(exifOrientation);
+    }
+#endif
+    EXIF::set(result, EXIF::create(orientation));
+    if (!pixels.bottomUp)
+        ImageOrigin::set(result, ImageOrigin::create(ImageOrigin::TopLeft));
+    DecodeQuality::set(result, DecodeQuality::create(quality));
+    return result;
+}
+
+vsg::ref_ptr<vsg::Object> readPNG(PNGInput& input, const vsg::Options* options)
 {
     int trans = PNG_ALPHA;
     pngInfo pInfo;
     pngInfo *pinfo = &pInfo;
 
-    unsigned char header[8];
     png_structp png;
     png_infop   info;
     png_infop   endinfo;
     png_bytep   data;    //, data2;
     png_bytep  *row_p;
-    double  fileGamma;
 
     png_uint_32 width, height;
     int depth, color;
 
     png_uint_32 i;
+    if (auto image = readPNGDirect(input, options))
+        return image;
+
     png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 
     // Set custom error handlers
@@ -185,18 +532,22 @@ vsg::ref_ptr<vsg::Object> readPNGStream(std::istream& fin)
         info = png_create_info_struct(png);
         endinfo = png_create_info_struct(png);
 
-        fin.read((char*)header,8);
-        if (fin.gcount() == 8 && png_sig_cmp(header, 0, 8) == 0)
-            png_set_read_fn(png,&fin,png_read_istream); //Use custom read function that will get data from istream
-        else
+        if (!setPNGInput(png, input))
         {
             png_destroy_read_struct(&png, &info, &endinfo);
             return {};
         }
-        png_set_sig_bytes(png, 8);
+        const DecodeQuality::Quality quality = requestedQuality(options);
+        setDecodeQuality(png, quality);
 
         png_read_info(png, info);
         png_get_IHDR(png, info, &width, &height, &depth, &color, NULL, NULL, NULL);
+        ColorTransform transform;
+        preparePNGTransform(png, info, options, &transform);
+        const bool keepPalette = requestedKeepPalette(png, info, options);
+        const bool convert = transform.status() == ColorTransform::Convert;
+        bool bgr = setReadTransforms(png, info, trans, requestedFormat(options),
+                                     !convert && quality != DecodeQuality::Fast, keepPalette);
 
         if (pinfo != NULL)
         {
@@ -205,69 +556,18 @@ vsg::ref_ptr<vsg::Object> readPNGStream(std::istream& fin)
             pinfo->Depth  = depth;
         }
 
-        VSGSB_DEBUG<<"width="<<width<<" height="<<height<<" depth="<<depth<<std::endl;
-        if ( color == PNG_COLOR_TYPE_RGB) { VSGSB_DEBUG << "color == PNG_COLOR_TYPE_RGB "<<std::endl; }
-        if ( color == PNG_COLOR_TYPE_GRAY) { VSGSB_DEBUG << "color == PNG_COLOR_TYPE_GRAY "<<std::endl; }
-        if ( color == PNG_COLOR_TYPE_GRAY_ALPHA) { VSGSB_DEBUG << "color ==  PNG_COLOR_TYPE_GRAY_ALPHA"<<std::endl; }
-
-        // png default to big endian, so we'll need to swap bytes if on a little endian machine.
-        if (depth>8 && !vsgsandbox::isHostBigEndian())
-            png_set_swap(png);
-
-
-        if (color == PNG_COLOR_TYPE_GRAY || color == PNG_COLOR_TYPE_GRAY_ALPHA)
-        {
-            //png_set_gray_to_rgb(png);
-        }
-
-        if (color&PNG_COLOR_MASK_ALPHA && trans != PNG_ALPHA)
-        {
-            png_set_strip_alpha(png);
-            color &= ~PNG_COLOR_MASK_ALPHA;
-        }
-
-
-
-        //    if (!(PalettedTextures && mipmap >= 0 && trans == PNG_SOLID))
-        //if (color == PNG_COLOR_TYPE_PALETTE)
-        //    png_set_expand(png);
-
-        // In addition to expanding the palette, we also need to check
-        // to expand greyscale and alpha images.  See libpng man page.
-        if (color == PNG_COLOR_TYPE_PALETTE)
-            png_set_palette_to_rgb(png);
-        if (color == PNG_COLOR_TYPE_GRAY && depth < 8)
-        {
-#if PNG_LIBPNG_VER >= 10209
-            png_set_expand_gray_1_2_4_to_8(png);
-#else
-            // use older now deprecated but identical call
-            png_set_gray_1_2_4_to_8(png);
-#endif
-        }
-        if (png_get_valid(png, info, PNG_INFO_tRNS))
-            png_set_tRNS_to_alpha(png);
-
-        // Make sure that files of small depth are packed properly.
-        if (depth < 8)
-            png_set_packing(png);
-
-
-        /*--GAMMA--*/
-        //    checkForGammaEnv();
-        // XXX Use this to decide whether or not to return an SRGB format
-        double screenGamma = 2.2 / 1.0;
-        if (png_get_gAMA(png, info, &fileGamma))
-            png_set_gamma(png, screenGamma, fileGamma);
-        else
-            png_set_gamma(png, screenGamma, 1.0/2.2);
-
+        int passes = png_set_interlace_handling(png);
         png_read_update_info(png, info);
+        vsg::ref_ptr<ImagePalette> palette;
+        if (keepPalette)
+            palette = pngPalette(png, info, transform);
 
         data = (png_bytep) new unsigned char [png_get_rowbytes(png, info)*height];
         row_p = new png_bytep [height];
 
-        bool StandardOrientation = true;
+        // libpng writes each row where its pointer says, so either
+        // order costs the same
+        bool StandardOrientation = !requestedTopDown(options);
         for (i = 0; i < height; i++)
         {
             if (StandardOrientation)
@@ -276,7 +576,24 @@ vsg::ref_ptr<vsg::Object> readPNGStream(std::istream& fin)
                 row_p[i] = &data[png_get_rowbytes(png, info)*i];
         }
 
-        png_read_image(png, row_p);
+        if (convert && !palette)
+        {
+            // Each row is converted as soon as its last pass is read
+            int channels = png_get_channels(png, info);
+            for (int pass = 0; pass < passes; ++pass)
+            {
+                for (i = 0; i < height; i++)
+                {
+                    png_read_row(png, row_p[i], NULL);
+                    if (pass == passes - 1)
+                        transform.convert(row_p[i], width, channels, bgr);
+                }
+            }
+        }
+        else
+        {
+            png_read_image(png, row_p);
+        }
         delete [] row_p;
         png_read_end(png, endinfo);
 
@@ -292,86 +609,26 @@ vsg::ref_ptr<vsg::Object> readPNGStream(std::istream& fin)
             color = PNG_COLOR_TYPE_RGB_ALPHA;
         }
 
-        vsg::ref_ptr<vsg::Data> result;
-        if (depth <= 8)
+        vsg::ref_ptr<vsg::Data> result = createPNGArray(width, height, png_get_channels(png, info), depth, data,
+                                                        palette ? VK_FORMAT_R8_UINT
+                                                                : pngFormat(png_get_channels(png, info), depth, bgr));
+        if (result)
         {
-            switch(color)
-            {
-                // XXX Will PNG_SOLID and PNG_ALPHA be returned by libpng?
-            case(PNG_SOLID):
-                result = createArray<std::uint8_t>(width, height, data,
-                                                   VK_FORMAT_R8_SRGB);
-                break;
-            case(PNG_ALPHA):
-                // XXX tag as alpha
-                result = createArray<std::uint8_t>(width, height, data,
-                                                   VK_FORMAT_R8_UNORM);
-                break; 
-            case(PNG_COLOR_TYPE_GRAY):
-                result = createArray<std::uint8_t>(width, height, data,
-                                                   VK_FORMAT_R8_SRGB);
-                break;
-            case(PNG_COLOR_TYPE_GRAY_ALPHA):
-                result = createArray<vsg::ubvec2>(width, height, data,
-                                                  VK_FORMAT_R8G8_SRGB);
-                break;
-            case(PNG_COLOR_TYPE_RGB):
-            case(PNG_COLOR_TYPE_PALETTE):
-                result = createArray<vsg::ubvec3>(width, height, data,
-                                                  VK_FORMAT_R8G8B8_SRGB);
-                break;
-            case(PNG_COLOR_TYPE_RGB_ALPHA):
-                result = createArray<vsg::ubvec4>(width, height, data,
-                                                  VK_FORMAT_R8G8B8A8_SRGB);
-                break;
-            default:
-                break;
-            }            
-        }
-        else
-        {
-            // 16 bit pixels
-            // Not sure what to do with SRGB. Should we convert to
-            // linear color before returning the image? Can we use
-            // png_set_gamma() to do that?
-            switch(color)
-            {
-            case(PNG_SOLID):
-                result = createArray<std::uint16_t>(width, height, data,
-                                                    VK_FORMAT_R16_UNORM);
-                break;
-            case(PNG_ALPHA):
-                // XXX tag as alpha
-                result = createArray<std::uint16_t>(width, height, data,
-                                                    VK_FORMAT_R16_UNORM);
-                break; 
-            case(PNG_COLOR_TYPE_GRAY):
-                result = createArray<std::uint16_t>(width, height, data,
-                                                    VK_FORMAT_R16_UNORM);
-                break;
-            case(PNG_COLOR_TYPE_GRAY_ALPHA):
-                result = createArray<vsg::ubvec2>(width, height, data,
-                                                  VK_FORMAT_R16G16_UNORM);
-                break;
-            case(PNG_COLOR_TYPE_PALETTE):
-            case(PNG_COLOR_TYPE_RGB):
-                result = createArray<vsg::ubvec3>(width, height, data,
-                                                  VK_FORMAT_R16G16B16_UNORM);
-                break;
-            case(PNG_COLOR_TYPE_RGB_ALPHA):
-                result = createArray<vsg::ubvec4>(width, height, data,
-                                                  VK_FORMAT_R16G16B16A16_UNORM);
-                break;
-            default:
-                break;
-            }
+            if (palette)
+                ImagePalette::set(result, palette);
+            EXIF::set(result, EXIF::create(pngOrientation(png, info)));
+            if (!StandardOrientation)
+                ImageOrigin::set(result, ImageOrigin::create(ImageOrigin::TopLeft));
+            if (auto profile = attachedProfile(png, info, transform))
+                ICCProfile::set(result, profile);
+            DecodeQuality::set(result, DecodeQuality::create(quality));
         }
 
         png_destroy_read_struct(&png, &info, &endinfo);
 
         //    delete [] data;
 
-        if (result->getFormat() == VK_FORMAT_UNDEFINED)
+        if (!result || result->getFormat() == VK_FORMAT_UNDEFINED)
             return {};
         return result;
     }
@@ -383,32 +640,200 @@ vsg::ref_ptr<vsg::Object> readPNGStream(std::istream& fin)
     }
 }
 
-#if 0
-int getCompressionLevel(const osgDB::ReaderWriter::Options *options) const
+// Describe the image that libpng, set up by setReadTransforms() and
+// png_read_update_info(), will return.
+vsg::ref_ptr<ImageInfo> pngImageInfo(png_structp png, png_infop info, const ColorTransform& transform, bool bgr,
+                                     bool topDown, DecodeQuality::Quality quality,
+                                     const vsg::ref_ptr<ImagePalette>& palette)
 {
-    if(options) {
-        std::istringstream iss(options->getOptionString());
-        std::string opt;
-        while (iss >> opt) {
-            if(opt=="PNG_COMPRESSION") {
-                int level;
-                iss >> level;
-                return level;
-            }
+    auto result = ImageInfo::create();
+    result->width = png_get_image_width(png, info);
+    result->height = png_get_image_height(png, info);
+    result->components = png_get_channels(png, info);
+    result->bitDepth = png_get_bit_depth(png, info);
+    result->format = palette ? VK_FORMAT_R8_UINT : pngFormat(result->components, result->bitDepth, bgr);
+    result->palette = palette;
+    result->exif = EXIF::create(pngOrientation(png, info));
+    if (topDown)
+        result->origin = ImageOrigin::create(ImageOrigin::TopLeft);
+    result->iccProfile = attachedProfile(png, info, transform);
+    result->quality = DecodeQuality::create(quality);
+    return result;
+}
+
+// Read the chunks up to the image data, and describe the image that
+// readPNG() would return.
+vsg::ref_ptr<ImageInfo> probePNG(PNGInput& input, const vsg::Options* options)
+{
+    png_structp png;
+    png_infop   info = NULL;
+
+    png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_set_error_fn(png, png_get_error_ptr(png), user_error_fn, user_warning_fn);
+    try
+    {
+        info = png_create_info_struct(png);
+        if (!setPNGInput(png, input))
+        {
+            png_destroy_read_struct(&png, &info, NULL);
+            return {};
         }
+        const DecodeQuality::Quality quality = requestedQuality(options);
+        setDecodeQuality(png, quality);
+        png_read_info(png, info);
+        ColorTransform transform;
+        preparePNGTransform(png, info, options, &transform);
+        const bool keepPalette = requestedKeepPalette(png, info, options);
+        bool bgr = setReadTransforms(png, info, PNG_ALPHA, requestedFormat(options),
+                                     transform.status() != ColorTransform::Convert && quality != DecodeQuality::Fast,
+                                     keepPalette);
+        png_read_update_info(png, info);
+
+        vsg::ref_ptr<ImagePalette> palette;
+        if (keepPalette)
+            palette = pngPalette(png, info, transform);
+        auto result = pngImageInfo(png, info, transform, bgr, requestedTopDown(options), quality, palette);
+        png_destroy_read_struct(&png, &info, NULL);
+        return result;
+    }
+    catch (PNGError& err)
+    {
+        VSGSB_DEBUG << err << std::endl;
+        png_destroy_read_struct(&png, &info, NULL);
+        return {};
     }
+}
 
-    return Z_DEFAULT_COMPRESSION;
+namespace
+{
+// The number of threads to use when numThreads is 0, looked up once
+// as in the JPEG reader.
+unsigned int hardwareThreads()
+{
+    static const unsigned int count = std::max(std::thread::hardware_concurrency(), 1u);
+    return count;
+}
+
+// The layout of the pixels of an image that can be written as a PNG
+bool pngInputFormat(VkFormat format, PNGEncodeParams* params)
+{
+    params->bitDepth = 8;
+    params->bgr = false;
+    switch (format)
+    {
+    case VK_FORMAT_R8_UNORM:
+    case VK_FORMAT_R8_SRGB:
+        params->channels = 1;
+        return true;
+    case VK_FORMAT_R8G8_UNORM:
+    case VK_FORMAT_R8G8_SRGB:
+        params->channels = 2;
+        return true;
+    case VK_FORMAT_R8G8B8_UNORM:
+    case VK_FORMAT_R8G8B8_SRGB:
+        params->channels = 3;
+        return true;
+    case VK_FORMAT_B8G8R8_UNORM:
+    case VK_FORMAT_B8G8R8_SRGB:
+        params->channels = 3;
+        params->bgr = true;
+        return true;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        params->channels = 4;
+        return true;
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+        params->channels = 4;
+        params->bgr = true;
+        return true;
+    case VK_FORMAT_R16_UNORM:
+        params->channels = 1;
+        params->bitDepth = 16;
+        return true;
+    case VK_FORMAT_R16G16_UNORM:
+        params->channels = 2;
+        params->bitDepth = 16;
+        return true;
+    case VK_FORMAT_R16G16B16_UNORM:
+        params->channels = 3;
+        params->bitDepth = 16;
+        return true;
+    case VK_FORMAT_R16G16B16A16_UNORM:
+        params->channels = 4;
+        params->bitDepth = 16;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Encode image, which is stored bottom row first like the images that
+// the reader returns, or top row first if it has an ImageOrigin that
+// says so.
+bool writePNG(const vsg::Data* image, std::ostream& fout, const vsg::Options* options)
+{
+    PNGEncodeParams params;
+    if (!pngInputFormat(image->getFormat(), &params))
+    {
+        VSGSB_DEBUG << "PNG writer: unsupported format " << image->getFormat() << std::endl;
+        return false;
+    }
+    params.width = image->width();
+    params.height = image->height();
+    params.rowStride = static_cast<std::size_t>(params.width) * params.channels * (params.bitDepth / 8);
+    if (params.width == 0 || params.height == 0 || image->depth() > 1
+        || image->dataSize() != params.rowStride * params.height)
+    {
+        VSGSB_DEBUG << "PNG writer: image has no data or an unexpected layout" << std::endl;
+        return false;
+    }
+    params.pixels = static_cast<const unsigned char*>(image->dataPointer());
+    auto origin = ImageOrigin::get(const_cast<vsg::Data*>(image));
+    params.bottomUp = !origin || origin->origin != ImageOrigin::TopLeft;
+
+    unsigned int level = 6;
+    unsigned int filter = static_cast<unsigned int>(PNGFilter::Adaptive);
+    unsigned int numThreads = 0;
+    if (options)
+    {
+        options->getValue(ReaderWriter_png::compressionLevel, level);
+        options->getValue(ReaderWriter_png::filter, filter);
+        options->getValue(ReaderWriter_png::numThreads, numThreads);
+    }
+    params.level = static_cast<int>(std::min(level, 9u));
+    if (filter <= static_cast<unsigned int>(PNGFilter::Paeth))
+        params.filter = static_cast<PNGFilter>(filter);
+    if (numThreads == 0)
+    {
+        numThreads = hardwareThreads();
+    }
+
+    std::string message;
+    if (!encodePNG(params, numThreads, fout, &message))
+    {
+        VSGSB_DEBUG << "PNG writer: " << message << std::endl;
+        return false;
+    }
+    return true;
+}
 }
-#endif
 
 ReaderWriter_png::ReaderWriter_png()
 {}
 
 vsg::ref_ptr<vsg::Object> ReaderWriter_png::read(std::istream& fin,
-                                                 const vsg::ref_ptr<const vsg::Options>) const
+                                                 const vsg::ref_ptr<const vsg::Options> options) const
+{
+    PNGInput input(fin);
+    return readPNG(input, options);
+}
+
+vsg::ref_ptr<vsg::Object> ReaderWriter_png::read(const std::uint8_t* data, std::size_t size,
+                                                 const vsg::ref_ptr<const vsg::Options> options) const
 {
-    return readPNGStream(fin);
+    PNGInput input(data, size);
+    return readPNG(input, options);
 }
 
 vsg::ref_ptr<vsg::Object> ReaderWriter_png::read(const vsg::Path& filename,
@@ -420,28 +845,306 @@ vsg::ref_ptr<vsg::Object> ReaderWriter_png::read(const vsg::Path& filename,
         vsg::Path filenameToUse = options ? findFile(filename, options) : filename;
         if (filenameToUse.empty()) return {};
 
+        MappedFile mappedFile(filenameToUse);
+        if (mappedFile.valid())
+            return read(mappedFile.data(), mappedFile.size(), options);
+
         std::ifstream fin(filenameToUse, std::ios::in | std::ios::binary);
         if (!fin) return {};
-        return readPNGStream(fin);
+        return read(fin, options);
     }
     return {};
 }
 
-#if 0
-virtual WriteResult writeImage(const osg::Image& img,std::ostream& fout,const osgDB::ReaderWriter::Options *options) const
+vsg::ref_ptr<ImageInfo> ReaderWriter_png::probe(std::istream& fin,
+                                                const vsg::ref_ptr<const vsg::Options> options) const
+{
+    PNGInput input(fin);
+    return probePNG(input, options);
+}
+
+vsg::ref_ptr<ImageInfo> ReaderWriter_png::probe(const std::uint8_t* data, std::size_t size,
+                                                const vsg::ref_ptr<const vsg::Options> options) const
 {
-    WriteResult::WriteStatus ws = writePngStream(fout,img,getCompressionLevel(options));
-    return ws;
+    PNGInput input(data, size);
+    return probePNG(input, options);
 }
 
-virtual WriteResult writeImage(const osg::Image &img,const std::string& fileName, const osgDB::ReaderWriter::Options *options) const
+vsg::ref_ptr<ImageInfo> ReaderWriter_png::probe(const vsg::Path& filename,
+                                                const vsg::ref_ptr<const vsg::Options> options) const
 {
-    std::string ext = osgDB::getFileExtension(fileName);
-    if (!acceptsExtension(ext)) return WriteResult::FILE_NOT_HANDLED;
+    auto ext = vsg::fileExtension(filename);
+    if (ext == "png")
+    {
+        vsg::Path filenameToUse = options ? findFile(filename, options) : filename;
+        if (filenameToUse.empty()) return {};
 
-    osgDB::ofstream fout(fileName.c_str(), std::ios::out | std::ios::binary);
-    if(!fout) return WriteResult::ERROR_IN_WRITING_FILE;
+        MappedFile mappedFile(filenameToUse);
+        if (mappedFile.valid())
+            return probe(mappedFile.data(), mappedFile.size(), options);
 
-    return writeImage(img,fout,options);
+        std::ifstream fin(filenameToUse, std::ios::in | std::ios::binary);
+        if (!fin) return {};
+        return probe(fin, options);
+    }
+    return {};
+}
+
+bool ReaderWriter_png::write(const vsg::Object* object, std::ostream& fout,
+                             const vsg::ref_ptr<const vsg::Options> options) const
+{
+    auto image = dynamic_cast<const vsg::Data*>(object);
+    if (!image) return false;
+    return writePNG(image, fout, options);
 }
+
+bool ReaderWriter_png::write(const vsg::Object* object, const vsg::Path& filename,
+                             const vsg::ref_ptr<const vsg::Options> options) const
+{
+    auto ext = vsg::fileExtension(filename);
+    if (ext == "png")
+    {
+        auto image = dynamic_cast<const vsg::Data*>(object);
+        if (!image) return false;
+
+        std::ofstream fout(filename, std::ios::out | std::ios::binary);
+        if (!fout) return false;
+        return writePNG(image, fout, options);
+    }
+    return false;
+}
+
+// An incremental decode. libpng's progressive reader calls back into
+// it as it gets through the data given to png_process_data().
+struct IncrementalPNGDecoder::Implementation
+{
+    Implementation(vsg::ref_ptr<const vsg::Options> in_options)
+        : options(in_options), quality(requestedQuality(in_options)), topDown(requestedTopDown(in_options))
+    {
+        png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+        png_set_error_fn(png, png_get_error_ptr(png), user_error_fn, user_warning_fn);
+        info = png_create_info_struct(png);
+        setDecodeQuality(png, quality);
+        png_set_progressive_read_fn(png, this, infoCallback, rowCallback, endCallback);
+#ifdef PNG_READ_USER_CHUNKS_SUPPORTED
+        png_set_read_user_chunk_fn(png, this, chunkCallback);
 #endif
+    }
+
+    ~Implementation()
+    {
+        release();
+    }
+
+    // libpng's state isn't needed once the decode has finished
+    void release()
+    {
+        if (png)
+            png_destroy_read_struct(&png, &info, NULL);
+        png = NULL;
+        info = NULL;
+    }
+
+    void decode(const unsigned char* data, std::size_t size)
+    {
+        try
+        {
+            png_process_data(png, info, const_cast<png_bytep>(data), size);
+        }
+        catch (PNGError& err)
+        {
+            fail(err);
+        }
+        if (status != NeedMoreData)
+            release();
+    }
+
+    void fail(const PNGError& err)
+    {
+        std::ostringstream stream;
+        stream << err;
+        message = stream.str();
+        VSGSB_DEBUG << message << std::endl;
+        status = Failed;
+    }
+
+    unsigned char* row(png_uint_32 y) const
+    {
+        if (!topDown)
+            y = height - 1 - y;
+        return buffer + y * rowBytes;
+    }
+
+    // Rows are converted to sRGB once they are final, unless their
+    // palette was converted instead
+    void finishRows(png_uint_32 end)
+    {
+        for (; rows < end; ++rows)
+        {
+            if (convert)
+                transform.convert(row(rows), width, channels, bgr);
+        }
+    }
+
+    static void infoCallback(png_structp png, png_infop info)
+    {
+        auto impl = static_cast<Implementation*>(png_get_progressive_ptr(png));
+        int depth, color, interlace;
+        png_get_IHDR(png, info, &impl->width, &impl->height, &depth, &color, &interlace, NULL, NULL);
+        preparePNGTransform(png, info, impl->options, &impl->transform);
+        const bool keepPalette = requestedKeepPalette(png, info, impl->options);
+        const bool convert = impl->transform.status() == ColorTransform::Convert;
+        impl->bgr = setReadTransforms(png, info, PNG_ALPHA, requestedFormat(impl->options),
+                                      !convert && impl->quality != DecodeQuality::Fast, keepPalette);
+        impl->convert = convert && !keepPalette;
+        impl->interlaced = interlace != PNG_INTERLACE_NONE;
+        png_set_interlace_handling(png);
+        png_read_update_info(png, info);
+
+        vsg::ref_ptr<ImagePalette> palette;
+        if (keepPalette)
+            palette = pngPalette(png, info, impl->transform);
+        impl->imageInfo = pngImageInfo(png, info, impl->transform, impl->bgr, impl->topDown, impl->quality, palette);
+        if (impl->orientation != EXIF::TopLeft)
+            impl->imageInfo->exif = EXIF::create(impl->orientation);
+        impl->channels = png_get_channels(png, info);
+        impl->rowBytes = png_get_rowbytes(png, info);
+        impl->buffer = new unsigned char [impl->rowBytes * impl->height]();
+        impl->image = createPNGArray(impl->width, impl->height, impl->channels, png_get_bit_depth(png, info),
+                                     impl->buffer, impl->imageInfo->format);
+        if (!impl->image)
+        {
+            delete [] impl->buffer;
+            impl->buffer = nullptr;
+            png_error(png, "Unsupported pixel layout");
+        }
+        EXIF::set(impl->image, impl->imageInfo->exif);
+        if (impl->imageInfo->origin)
+            ImageOrigin::set(impl->image, impl->imageInfo->origin);
+        if (impl->imageInfo->iccProfile)
+            ICCProfile::set(impl->image, impl->imageInfo->iccProfile);
+        if (impl->imageInfo->palette)
+            ImagePalette::set(impl->image, impl->imageInfo->palette);
+        DecodeQuality::set(impl->image, impl->imageInfo->quality);
+    }
+
+    // libpng's progressive reader doesn't store eXIf chunks, but
+    // passes them here with the chunks that it doesn't know.
+    static int chunkCallback(png_structp png, png_unknown_chunkp chunk)
+    {
+        auto impl = static_cast<Implementation*>(png_get_user_chunk_ptr(png));
+        if (std::memcmp(chunk->name, "eXIf", 4) != 0)
+            return 0;
+        if (!impl->image)
+        {
+            int orientation = EXIF_Orientation(chunk->data, static_cast<unsigned int>(chunk->size));
+            if (orientation >= EXIF::TopLeft && orientation <= EXIF::LeftBottom)
+                impl->orientation = static_cast<EXIF::Orientation>(orientation);
+        }
+        return 1;
+    }
+
+    // For an interlaced image, libpng calls this for every row in
+    // every pass, with newRow null for rows that the pass doesn't
+    // touch; rows are only final in the last pass.
+    static void rowCallback(png_structp png, png_bytep newRow, png_uint_32 rowNum, int pass)
+    {
+        auto impl = static_cast<Implementation*>(png_get_progressive_ptr(png));
+        if (rowNum >= impl->height)
+            return;
+        if (newRow)
+            png_progressive_combine_row(png, impl->row(rowNum), newRow);
+        if (!impl->interlaced || pass == 6)
+            impl->finishRows(rowNum + 1);
+        if (rowNum == impl->height - 1)
+            impl->passes = impl->interlaced ? pass + 1 : 1;
+    }
+
+    static void endCallback(png_structp png, png_infop /*info*/)
+    {
+        auto impl = static_cast<Implementation*>(png_get_progressive_ptr(png));
+        impl->finishRows(impl->height);
+        impl->passes = impl->interlaced ? 7 : 1;
+        impl->status = Complete;
+    }
+
+    vsg::ref_ptr<const vsg::Options> options;
+    const DecodeQuality::Quality quality;
+    const bool topDown;
+    png_structp png = NULL;
+    png_infop info = NULL;
+    Status status = NeedMoreData;
+    ColorTransform transform;
+    bool convert = false;
+    bool bgr = false;
+    bool interlaced = false;
+    EXIF::Orientation orientation = EXIF::TopLeft;
+    png_uint_32 width = 0;
+    png_uint_32 height = 0;
+    int channels = 0;
+    std::size_t rowBytes = 0;
+    unsigned char* buffer = nullptr;    // owned by the image
+    png_uint_32 rows = 0;
+    unsigned int passes = 0;
+    vsg::ref_ptr<ImageInfo> imageInfo;
+    vsg::ref_ptr<vsg::Data> image;
+    std::string message;
+};
+
+IncrementalPNGDecoder::IncrementalPNGDecoder(vsg::ref_ptr<const vsg::Options> options)
+    : _implementation(new Implementation(options))
+{
+}
+
+IncrementalPNGDecoder::~IncrementalPNGDecoder()
+{
+}
+
+IncrementalPNGDecoder::Status IncrementalPNGDecoder::push(const void* data, std::size_t size)
+{
+    Implementation& impl = *_implementation;
+    if (impl.status == NeedMoreData && size > 0)
+        impl.decode(static_cast<const unsigned char*>(data), size);
+    return impl.status;
+}
+
+IncrementalPNGDecoder::Status IncrementalPNGDecoder::finish()
+{
+    Implementation& impl = *_implementation;
+    if (impl.status == NeedMoreData)
+    {
+        impl.fail(PNGError("Data ended before the image was complete"));
+        impl.release();
+    }
+    return impl.status;
+}
+
+IncrementalPNGDecoder::Status IncrementalPNGDecoder::status() const
+{
+    return _implementation->status;
+}
+
+vsg::ref_ptr<ImageInfo> IncrementalPNGDecoder::info() const
+{
+    return _implementation->imageInfo;
+}
+
+vsg::ref_ptr<vsg::Data> IncrementalPNGDecoder::image() const
+{
+    return _implementation->image;
+}
+
+std::uint32_t IncrementalPNGDecoder::rowsDecoded() const
+{
+    return _implementation->rows;
+}
+
+unsigned int IncrementalPNGDecoder::passesDecoded() const
+{
+    return _implementation->passes;
+}
+
+const std::string& IncrementalPNGDecoder::message() const
+{
+    return _implementation->message;
+}
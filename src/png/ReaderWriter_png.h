@@ -1,16 +1,164 @@
 #pragma once
 
 #include <vsgsandbox/Export.h>
+#include <vsg/core/Data.h>
 #include <vsg/io/ReaderWriter.h>
 
+#include "ReaderWriter_sandbox/ImageMetadata.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
 namespace vsgsandbox
 {
+    // The filters that ReaderWriter_png::write() can apply to the
+    // rows of an image before compressing them; see
+    // ReaderWriter_png::filter.
+    enum class PNGFilter : unsigned int
+    {
+        // A filter chosen for each row, as libpng does
+        Adaptive,
+        None,
+        Sub,
+        Up,
+        Average,
+        Paeth
+    };
+
     class VSGSANDBOX_DECLSPEC ReaderWriter_png : public vsg::Inherit<vsg::ReaderWriter, ReaderWriter_png>
     {
     public:
+        // Key of a vsg::Options value understood by read(): unsigned
+        // int, a VkFormat giving the pixel layout that images should
+        // be decoded to, as for ReaderWriter_jpeg::outputFormat. 16
+        // bit images get an alpha channel if one is asked for, but
+        // stay in RGB order.
+        static constexpr const char* outputFormat = "image_output_format";
+        // bool: store the image top row first, as for
+        // ReaderWriter_jpeg::topDown.
+        static constexpr const char* topDown = "image_top_down";
+        // bool: convert images with an ICC profile to sRGB, as for
+        // ReaderWriter_jpeg::convertToSRGB. 16 bit images keep their
+        // profile.
+        static constexpr const char* convertToSRGB = "image_convert_to_srgb";
+        // std::string: the DecodeQuality, as for
+        // ReaderWriter_jpeg::decodeQuality. "balanced" doesn't check
+        // the CRCs of the chunks or the checksum of the image data,
+        // so it gives the same pixels as "exact" for files that
+        // aren't corrupt; "fast" doesn't apply the file's gAMA
+        // either, and returns the samples as they are stored.
+        static constexpr const char* decodeQuality = "image_decode_quality";
+        // bool: read palette images as their indices, one byte per
+        // pixel whatever their bit depth, into a VK_FORMAT_R8_UINT
+        // image with the palette attached as an ImagePalette,
+        // instead of expanding them to RGB or RGBA. That takes a
+        // quarter of the memory of RGBA, and the colors can be
+        // looked up in the fragment shader. outputFormat doesn't
+        // apply to these images; others are read as usual.
+        static constexpr const char* keepPalette = "png_keep_palette";
+
+        // Keys of vsg::Options values understood by write().
+        //
+        // unsigned int: the zlib compression level, from 0, which
+        // stores the image data without compressing it, to 9. The
+        // default is 6, as for libpng.
+        static constexpr const char* compressionLevel = "png_compression_level";
+        // unsigned int, a PNGFilter: the filter applied to every row.
+        // Adaptive, the default, usually compresses best; None is
+        // the fastest, and is often as good for images with few
+        // colors, such as screenshots of a user interface.
+        static constexpr const char* filter = "png_filter";
+        // unsigned int: the number of threads that may be used to
+        // compress one large image. 0, the default, uses one per
+        // hardware core; 1 always compresses serially.
+        static constexpr const char* numThreads = "png_threads";
+
         ReaderWriter_png();
-        // Returns a vsg::Data object.
+        // Returns a vsg::Data object. Files are mapped into memory
+        // and decoded in place, as with read(data, size), if they
+        // can be.
         vsg::ref_ptr<vsg::Object> read(const vsg::Path& filename, vsg::ref_ptr<const vsg::Options> options = {}) const override;
         vsg::ref_ptr<vsg::Object> read(std::istream& fin, vsg::ref_ptr<const vsg::Options> = {}) const override;
+        // Read a PNG held in memory, such as the contents of a
+        // vsg::Data or an image in a glTF buffer, without copying it
+        // or going through a stream. The memory is only used until
+        // this returns. Plain 8 bit gray and RGB(A) images, which
+        // are most of them, are decoded without libpng; see
+        // PNG_Direct.h.
+        vsg::ref_ptr<vsg::Object> read(const std::uint8_t* data, std::size_t size, vsg::ref_ptr<const vsg::Options> options = {}) const;
+        // Read the chunks before the image data and return what
+        // read() would produce, or null if the file isn't a PNG.
+        vsg::ref_ptr<ImageInfo> probe(const vsg::Path& filename, vsg::ref_ptr<const vsg::Options> options = {}) const;
+        vsg::ref_ptr<ImageInfo> probe(std::istream& fin, vsg::ref_ptr<const vsg::Options> = {}) const;
+        vsg::ref_ptr<ImageInfo> probe(const std::uint8_t* data, std::size_t size, vsg::ref_ptr<const vsg::Options> options = {}) const;
+        // Write a vsg::Data in one of the formats that read() returns:
+        // 8 bit R, RG, RGB, BGR, RGBA or BGRA, UNORM or SRGB, or 16
+        // bit R, RG, RGB or RGBA UNORM, stored bottom row first, or
+        // top row first if its ImageOrigin says so. Large images are
+        // compressed in bands of rows on several threads; see
+        // PNG_Encode.h.
+        bool write(const vsg::Object* object, const vsg::Path& filename, vsg::ref_ptr<const vsg::Options> options = {}) const override;
+        bool write(const vsg::Object* object, std::ostream& fout, vsg::ref_ptr<const vsg::Options> = {}) const override;
+    };
+
+    // Decodes a PNG whose data arrives in pieces, as
+    // IncrementalJPEGDecoder does for JPEGs, with libpng's
+    // progressive reader: push() decodes as far as the data allows
+    // and returns, so one thread can drive any number of decoders.
+    //
+    // The rows of an image that isn't interlaced become available
+    // from the top down. An interlaced image is filled in a pass at
+    // a time: after each of the seven passes, every pixel of the
+    // image holds a preview in which the pixels decoded so far are
+    // drawn as blocks, which later passes refine. Images that are
+    // converted to sRGB stay in their own color space until their
+    // rows are final.
+    class VSGSANDBOX_DECLSPEC IncrementalPNGDecoder : public vsg::Inherit<vsg::Object, IncrementalPNGDecoder>
+    {
+    public:
+        enum Status
+        {
+            NeedMoreData,
+            Complete,
+            Failed
+        };
+        // Of the ReaderWriter_png options, outputFormat, topDown,
+        // convertToSRGB, decodeQuality and keepPalette are used.
+        IncrementalPNGDecoder(vsg::ref_ptr<const vsg::Options> options = {});
+        // Add the next size bytes of the file and decode as much as
+        // possible. Data pushed after the image is complete is
+        // ignored.
+        Status push(const void* data, std::size_t size);
+        // Say that no more data will come. An image that isn't
+        // complete fails, as it does with read(), but keeps what has
+        // been decoded of it.
+        Status finish();
+        Status status() const;
+        // What the chunks before the image data say about the image,
+        // once they have been read; null until then.
+        vsg::ref_ptr<ImageInfo> info() const;
+        // The image, allocated as soon as the chunks before the
+        // image data have been read, and null until then; pixels
+        // that haven't been decoded are 0. Like the images that
+        // read() returns, its bottom row is stored first unless
+        // topDown is set.
+        vsg::ref_ptr<vsg::Data> image() const;
+        // The number of rows from the top that are final
+        std::uint32_t rowsDecoded() const;
+        // The number of passes over the image that are complete: up
+        // to 7 for an interlaced image, and 1 for any other once its
+        // last row has been decoded.
+        unsigned int passesDecoded() const;
+        // libpng's message, if decoding failed
+        const std::string& message() const;
+
+    protected:
+        virtual ~IncrementalPNGDecoder();
+
+    private:
+        struct Implementation;
+        std::unique_ptr<Implementation> _implementation;
     };
 }